@@ -8,6 +8,7 @@ static_assert(__cplusplus >= 201703L, "C++17 or higher is required");
 
 #define EZGZ_HAS_CPP20 (__cplusplus >= 202002L)
 #define EZGZ_HAS_CONCEPTS (__cpp_concepts >= 201907L)
+#define EZGZ_HAS_COROUTINES (__cpp_impl_coroutine >= 201902L && __cpp_lib_coroutine >= 201902L)
 
 #include <deque>
 #include <array>
@@ -26,9 +27,66 @@ static_assert(__cplusplus >= 201703L, "C++17 or higher is required");
 #include <memory>
 #include <istream>
 #include <chrono>
+#include <exception>
+#if EZGZ_HAS_CPP20
+#include <version>
+#endif
+#if EZGZ_HAS_COROUTINES
+#include <coroutine>
+#endif
 #ifndef EZGZ_NO_FILE
 #include <fstream>
 #endif
+#ifndef EZGZ_NO_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define EZGZ_HAS_MMAP 1
+#else
+#define EZGZ_HAS_MMAP 0
+#endif
+#if defined(__linux__) && !defined(EZGZ_NO_MIRRORED_MEMORY)
+#define EZGZ_HAS_MIRRORED_MEMORY 1
+#else
+#define EZGZ_HAS_MIRRORED_MEMORY 0
+#endif
+#if defined(__linux__) && !defined(EZGZ_NO_IO_URING) && !defined(EZGZ_NO_FILE) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define EZGZ_HAS_IO_URING 1
+#else
+#define EZGZ_HAS_IO_URING 0
+#endif
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(EZGZ_NO_SIMD)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#define EZGZ_HAS_X86_CLMUL 1
+#define EZGZ_HAS_X86_SIMD 1
+#else
+#define EZGZ_HAS_X86_CLMUL 0
+#define EZGZ_HAS_X86_SIMD 0
+#endif
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32) && !defined(EZGZ_NO_SIMD)
+#include <arm_acle.h>
+#define EZGZ_HAS_ARM_CRC32 1
+#else
+#define EZGZ_HAS_ARM_CRC32 0
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define EZGZ_TARGET(features) __attribute__((target(features)))
+#else
+#define EZGZ_TARGET(features)
+#endif
 
 #if ! EZGZ_HAS_CPP20
 namespace std {
@@ -151,6 +209,7 @@ concept DecompressionSettings = std::constructible_from<typename T::Checksum> &&
 	int(checksum());
 	int(checksum(std::span<const uint8_t>()));
 	bool(T::verifyChecksum);
+	int(T::huffmanTableRootBits);
 };
 #else
 #define StreamSettings typename
@@ -168,6 +227,23 @@ concept BasicStringType = std::constructible_from<T> && requires(T value) {
 #define BasicStringType typename
 #endif
 
+#if EZGZ_HAS_CONCEPTS
+// Fills a batch of input and returns how many bytes it has written, zero at the end of data
+template <typename T>
+concept InputSource = requires(T source, std::span<uint8_t> batch) {
+	int(source(batch));
+};
+
+// Takes a batch of output
+template <typename T>
+concept OutputSink = requires(T sink, std::span<const char> batch) {
+	sink(batch);
+};
+#else
+#define InputSource typename
+#define OutputSink typename
+#endif
+
 struct NoChecksum { // Noop
 	int operator() () { return 0; }
 	int operator() (std::span<const uint8_t>) { return 0; }
@@ -186,6 +262,7 @@ struct MinDecompressionSettings {
 
 	using Checksum = NoChecksum;
 	constexpr static bool verifyChecksum = false;
+	constexpr static int huffmanTableRootBits = 0;
 	using StringType = std::string;
 };
 
@@ -262,6 +339,10 @@ class FastCrc32 {
 	};
 
 public:
+	FastCrc32() = default;
+	// Continues from the checksum of some preceding data
+	explicit FastCrc32(uint32_t previous) : state(~previous) {}
+
 	uint32_t operator() () { return ~state; }
 	uint32_t operator() (std::span<const uint8_t> input) {
 		ptrdiff_t position = 0;
@@ -292,6 +373,411 @@ public:
 	}
 };
 
+namespace Detail {
+// Product of two polynomials modulo the CRC32 polynomial, in the bit-reversed representation the checksum uses
+constexpr uint32_t crc32Multiply(uint32_t first, uint32_t second) {
+	uint32_t product = 0;
+	for (uint32_t bit = 0x80000000u; bit != 0; bit >>= 1) {
+		if (first & bit) {
+			product ^= second;
+		}
+		second = (second & 1) ? (second >> 1) ^ 0xedb88320u : second >> 1;
+	}
+	return product;
+}
+
+// The polynomial x raised to 2 to the power of index, modulo the CRC32 polynomial
+constexpr std::array<uint32_t, 32> crc32PowersOfX = [] {
+	std::array<uint32_t, 32> powers = {0x40000000u}; // x
+	for (int i = 1; i < std::ssize(powers); i++) {
+		powers[i] = crc32Multiply(powers[i - 1], powers[i - 1]);
+	}
+	return powers;
+}();
+} // namespace Detail
+
+// Checksum of two pieces of data following each other, computed from their checksums and the length of the second one
+constexpr uint32_t crc32Combine(uint32_t first, uint32_t second, size_t secondLength) {
+	uint32_t shift = 0x80000000u; // The polynomial 1, multiplied by x to the power of the number of bits in the second piece
+	for (int exponent = 3; secondLength > 0; secondLength >>= 1, exponent++) {
+		if (secondLength & 1) {
+			shift = Detail::crc32Multiply(Detail::crc32PowersOfX[exponent & 31], shift);
+		}
+	}
+	return Detail::crc32Multiply(shift, first) ^ second;
+}
+
+namespace Detail {
+#if EZGZ_HAS_X86_CLMUL
+// Folding with carry-less multiplication, as described in Intel's paper Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction
+// Constants are x to the power of some multiple of 32 modulo the polynomial, bit-reversed, their use is explained in the paper
+struct alignas(64) ClmulCrc32Constants {
+	std::array<uint64_t, 8> foldBy4x512 = {0x11542778a, 0x1322d1430, 0x11542778a, 0x1322d1430, 0x11542778a, 0x1322d1430, 0x11542778a, 0x1322d1430};
+	std::array<uint64_t, 8> foldBy512 = {0x154442bd4, 0x1c6e41596, 0x154442bd4, 0x1c6e41596, 0x154442bd4, 0x1c6e41596, 0x154442bd4, 0x1c6e41596};
+	std::array<uint64_t, 2> foldBy4x128 = {0x154442bd4, 0x1c6e41596};
+	std::array<uint64_t, 2> foldBy128 = {0x1751997d0, 0xccaa009e};
+	std::array<uint64_t, 2> foldBy64 = {0x163cd6124, 0};
+	std::array<uint64_t, 2> barrett = {0x1db710641, 0x1f7011641}; // The polynomial and x to the power of 64 divided by it
+};
+inline constexpr ClmulCrc32Constants clmulCrc32Constants = {};
+
+// Folds 16 bytes into the accumulated value, which represents the same remainder 16 bytes further
+EZGZ_TARGET("pclmul,sse4.1") inline __m128i clmulFold(__m128i folded, __m128i constants, __m128i added) {
+	__m128i low = _mm_clmulepi64_si128(folded, constants, 0x00);
+	__m128i high = _mm_clmulepi64_si128(folded, constants, 0x11);
+	return _mm_xor_si128(_mm_xor_si128(low, high), added);
+}
+
+// Folds the remaining 16 byte blocks and reduces the result to the 32 bits of the checksum
+EZGZ_TARGET("pclmul,sse4.1") inline uint32_t clmulFinishCrc32(__m128i folded, const uint8_t*& data, size_t& size) {
+	const __m128i foldBy128 = _mm_load_si128(reinterpret_cast<const __m128i*>(clmulCrc32Constants.foldBy128.data()));
+	for ( ; size >= 16; data += 16, size -= 16) {
+		folded = clmulFold(folded, foldBy128, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+	}
+
+	// 128 bits to 64
+	const __m128i lowerHalves = _mm_setr_epi32(~0, 0, ~0, 0);
+	folded = _mm_xor_si128(_mm_srli_si128(folded, 8), _mm_clmulepi64_si128(folded, foldBy128, 0x10));
+	const __m128i foldBy64 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(clmulCrc32Constants.foldBy64.data()));
+	folded = _mm_xor_si128(_mm_srli_si128(folded, 4), _mm_clmulepi64_si128(_mm_and_si128(folded, lowerHalves), foldBy64, 0x00));
+
+	// Barrett reduction to 32 bits
+	const __m128i barrett = _mm_load_si128(reinterpret_cast<const __m128i*>(clmulCrc32Constants.barrett.data()));
+	__m128i quotient = _mm_clmulepi64_si128(_mm_and_si128(folded, lowerHalves), barrett, 0x10);
+	folded = _mm_xor_si128(folded, _mm_clmulepi64_si128(_mm_and_si128(quotient, lowerHalves), barrett, 0x00));
+	return uint32_t(_mm_extract_epi32(folded, 1));
+}
+
+// Needs at least 64 bytes, leaves less than 16 unprocessed, the state is the inverted checksum
+EZGZ_TARGET("pclmul,sse4.1") inline uint32_t clmulCrc32(uint32_t state, const uint8_t*& data, size_t& size) {
+	auto load = [] (const uint8_t* from) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+	};
+	__m128i first = _mm_xor_si128(load(data), _mm_cvtsi32_si128(int(state)));
+	__m128i second = load(data + 16);
+	__m128i third = load(data + 32);
+	__m128i fourth = load(data + 48);
+	data += 64;
+	size -= 64;
+
+	const __m128i foldBy4x128 = _mm_load_si128(reinterpret_cast<const __m128i*>(clmulCrc32Constants.foldBy4x128.data()));
+	for ( ; size >= 64; data += 64, size -= 64) {
+		first = clmulFold(first, foldBy4x128, load(data));
+		second = clmulFold(second, foldBy4x128, load(data + 16));
+		third = clmulFold(third, foldBy4x128, load(data + 32));
+		fourth = clmulFold(fourth, foldBy4x128, load(data + 48));
+	}
+
+	const __m128i foldBy128 = _mm_load_si128(reinterpret_cast<const __m128i*>(clmulCrc32Constants.foldBy128.data()));
+	__m128i folded = clmulFold(clmulFold(clmulFold(first, foldBy128, second), foldBy128, third), foldBy128, fourth);
+	return clmulFinishCrc32(folded, data, size);
+}
+
+EZGZ_TARGET("avx512f,vpclmulqdq") inline __m512i vclmulFold(__m512i folded, __m512i constants, __m512i added) {
+	__m512i low = _mm512_clmulepi64_epi128(folded, constants, 0x00);
+	__m512i high = _mm512_clmulepi64_epi128(folded, constants, 0x11);
+	return _mm512_ternarylogic_epi64(low, high, added, 0x96); // Xor of all three
+}
+
+// Same with 512 bit registers, needs at least 256 bytes
+EZGZ_TARGET("avx512f,vpclmulqdq,pclmul,sse4.1") inline uint32_t vclmulCrc32(uint32_t state, const uint8_t*& data, size_t& size) {
+	__m512i first = _mm512_xor_si512(_mm512_loadu_si512(data), _mm512_castsi128_si512(_mm_cvtsi32_si128(int(state))));
+	__m512i second = _mm512_loadu_si512(data + 64);
+	__m512i third = _mm512_loadu_si512(data + 128);
+	__m512i fourth = _mm512_loadu_si512(data + 192);
+	data += 256;
+	size -= 256;
+
+	const __m512i foldBy4x512 = _mm512_load_si512(clmulCrc32Constants.foldBy4x512.data());
+	for ( ; size >= 256; data += 256, size -= 256) {
+		first = vclmulFold(first, foldBy4x512, _mm512_loadu_si512(data));
+		second = vclmulFold(second, foldBy4x512, _mm512_loadu_si512(data + 64));
+		third = vclmulFold(third, foldBy4x512, _mm512_loadu_si512(data + 128));
+		fourth = vclmulFold(fourth, foldBy4x512, _mm512_loadu_si512(data + 192));
+	}
+
+	const __m512i foldBy512 = _mm512_load_si512(clmulCrc32Constants.foldBy512.data());
+	__m512i folded = vclmulFold(vclmulFold(vclmulFold(first, foldBy512, second), foldBy512, third), foldBy512, fourth);
+	for ( ; size >= 64; data += 64, size -= 64) {
+		folded = vclmulFold(folded, foldBy512, _mm512_loadu_si512(data));
+	}
+
+	// The four lanes are consecutive 16 byte blocks
+	alignas(64) std::array<uint64_t, 8> lanes;
+	_mm512_store_si512(lanes.data(), folded);
+	auto lane = [&lanes] (int index) {
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.data() + 2 * index));
+	};
+	const __m128i foldBy128 = _mm_load_si128(reinterpret_cast<const __m128i*>(clmulCrc32Constants.foldBy128.data()));
+	__m128i reduced = clmulFold(clmulFold(clmulFold(lane(0), foldBy128, lane(1)), foldBy128, lane(2)), foldBy128, lane(3));
+	return clmulFinishCrc32(reduced, data, size);
+}
+
+enum class ClmulSupport {
+	NONE,
+	CLMUL,
+	WIDE_CLMUL,
+};
+
+inline ClmulSupport detectClmulSupport() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	std::array<int, 4> registers = {};
+	__cpuid(registers.data(), 1);
+	const bool hasClmul = (registers[2] & (1 << 1)) && (registers[2] & (1 << 19)); // PCLMULQDQ and SSE4.1
+	const bool osSavesRegisters = (registers[2] & (1 << 27)) && (_xgetbv(0) & 0xe6) == 0xe6; // Including the AVX-512 state
+	__cpuidex(registers.data(), 7, 0);
+	const bool hasWideClmul = osSavesRegisters && (registers[1] & (1 << 16)) && (registers[2] & (1 << 10)); // AVX-512F and VPCLMULQDQ
+#else
+	__builtin_cpu_init();
+	const bool hasClmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+	const bool hasWideClmul = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+#endif
+	if (!hasClmul) {
+		return ClmulSupport::NONE;
+	}
+	return hasWideClmul ? ClmulSupport::WIDE_CLMUL : ClmulSupport::CLMUL;
+}
+#endif
+} // namespace Detail
+
+// Uses carry-less multiplication on x86-64 or the CRC32 instructions on ARM if the processor has them, otherwise the same as FastCrc32
+class HardwareCrc32 {
+	uint32_t state = 0xffffffffu;
+
+public:
+	HardwareCrc32() = default;
+	// Continues from the checksum of some preceding data
+	explicit HardwareCrc32(uint32_t previous) : state(~previous) {}
+
+	uint32_t operator() () { return ~state; }
+	uint32_t operator() (std::span<const uint8_t> input) {
+		const uint8_t* data = input.data();
+		size_t size = input.size();
+#if EZGZ_HAS_X86_CLMUL
+		static const Detail::ClmulSupport support = Detail::detectClmulSupport();
+		if (support == Detail::ClmulSupport::WIDE_CLMUL && size >= 256) {
+			state = Detail::vclmulCrc32(state, data, size);
+		} else if (support != Detail::ClmulSupport::NONE && size >= 64) {
+			state = Detail::clmulCrc32(state, data, size);
+		}
+#elif EZGZ_HAS_ARM_CRC32
+		for ( ; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+			uint64_t word = 0;
+			memcpy(&word, data, sizeof(word));
+			state = __crc32d(state, word);
+		}
+#endif
+		state = ~FastCrc32(~state)(std::span<const uint8_t>(data, size));
+		return ~state;
+	}
+};
+
+#ifndef EZGZ_NO_THREADS
+// Splits large batches between threads and combines their checksums, can be the checksum in settings
+class ParallelCrc32 {
+	HardwareCrc32 sequential;
+	int threadCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+
+public:
+	constexpr static size_t minPieceSize = 1024 * 1024; // Smaller pieces aren't worth starting a thread
+
+	ParallelCrc32() = default;
+	explicit ParallelCrc32(int threadCount) : threadCount(std::max(threadCount, 1)) {}
+
+	uint32_t operator() () { return sequential(); }
+	uint32_t operator() (std::span<const uint8_t> input) {
+		const size_t pieces = std::min<size_t>(threadCount, input.size() / minPieceSize);
+		if (pieces <= 1) {
+			return sequential(input);
+		}
+		const size_t pieceSize = input.size() / pieces;
+		auto piece = [&] (size_t index) {
+			return input.subspan(index * pieceSize, (index + 1 < pieces) ? pieceSize : input.size() - index * pieceSize);
+		};
+		std::vector<std::future<uint32_t>> others;
+		for (size_t index = 1; index < pieces; index++) {
+			others.push_back(std::async(std::launch::async, [part = piece(index)] {
+				return HardwareCrc32()(part);
+			}));
+		}
+		uint32_t combined = sequential(piece(0));
+		for (size_t index = 1; index < pieces; index++) {
+			combined = crc32Combine(combined, others[index - 1].get(), piece(index).size());
+		}
+		sequential = HardwareCrc32(combined);
+		return combined;
+	}
+};
+#endif
+
+namespace Detail {
+constexpr uint32_t adler32Modulo = 65521;
+constexpr size_t adler32MaxRun = 5552; // The most bytes whose sums can't overflow 32 bits before taking the modulo
+
+// The low half of the state is the sum of the bytes plus one, the high half is the sum of these sums
+inline uint32_t scalarAdler32(uint32_t state, const uint8_t* data, size_t size) {
+	uint32_t sum = state & 0xffff;
+	uint32_t sumOfSums = state >> 16;
+	while (size > 0) {
+		size_t run = std::min(size, adler32MaxRun);
+		size -= run;
+		for ( ; run >= 8; run -= 8, data += 8) {
+			for (int i = 0; i < 8; i++) {
+				sum += data[i];
+				sumOfSums += sum;
+			}
+		}
+		for ( ; run > 0; run--, data++) {
+			sum += *data;
+			sumOfSums += sum;
+		}
+		sum %= adler32Modulo;
+		sumOfSums %= adler32Modulo;
+	}
+	return sum | (sumOfSums << 16);
+}
+
+#if EZGZ_HAS_X86_SIMD
+inline uint32_t sumLanes(__m128i lanes) {
+	lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+	lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+	return uint32_t(_mm_cvtsi128_si32(lanes));
+}
+
+// Processes 32 byte blocks, leaves the rest unprocessed. Each block adds the sum before it 32 times to the sum of sums,
+// those are accumulated and multiplied at the end, the sums within the block are a dot product with descending weights
+EZGZ_TARGET("ssse3") inline uint32_t ssse3Adler32(uint32_t state, const uint8_t*& data, size_t& size) {
+	uint32_t sum = state & 0xffff;
+	uint32_t sumOfSums = state >> 16;
+	const __m128i firstWeights = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i secondWeights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+	size_t blocks = size / 32;
+	size -= blocks * 32;
+	while (blocks > 0) {
+		size_t run = std::min(blocks, adler32MaxRun / 32);
+		blocks -= run;
+		__m128i previousSums = _mm_cvtsi32_si128(int(sum * run));
+		__m128i sums = zero;
+		__m128i weightedSums = _mm_cvtsi32_si128(int(sumOfSums));
+		for ( ; run > 0; run--, data += 32) {
+			const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+			previousSums = _mm_add_epi32(previousSums, sums);
+			sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_sad_epu8(first, zero), _mm_sad_epu8(second, zero)));
+			weightedSums = _mm_add_epi32(weightedSums, _mm_madd_epi16(_mm_maddubs_epi16(first, firstWeights), ones));
+			weightedSums = _mm_add_epi32(weightedSums, _mm_madd_epi16(_mm_maddubs_epi16(second, secondWeights), ones));
+		}
+		weightedSums = _mm_add_epi32(weightedSums, _mm_slli_epi32(previousSums, 5));
+		sum = (sum + sumLanes(sums)) % adler32Modulo;
+		sumOfSums = sumLanes(weightedSums) % adler32Modulo;
+	}
+	return sum | (sumOfSums << 16);
+}
+
+EZGZ_TARGET("avx2") inline uint32_t sumWideLanes(__m256i lanes) {
+	return sumLanes(_mm_add_epi32(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1)));
+}
+
+// Same with 256 bit registers
+EZGZ_TARGET("avx2") inline uint32_t avx2Adler32(uint32_t state, const uint8_t*& data, size_t& size) {
+	uint32_t sum = state & 0xffff;
+	uint32_t sumOfSums = state >> 16;
+	const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+			16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+	size_t blocks = size / 32;
+	size -= blocks * 32;
+	while (blocks > 0) {
+		size_t run = std::min(blocks, adler32MaxRun / 32);
+		blocks -= run;
+		__m256i previousSums = _mm256_setr_epi32(int(sum * run), 0, 0, 0, 0, 0, 0, 0);
+		__m256i sums = zero;
+		__m256i weightedSums = _mm256_setr_epi32(int(sumOfSums), 0, 0, 0, 0, 0, 0, 0);
+		for ( ; run > 0; run--, data += 32) {
+			const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			previousSums = _mm256_add_epi32(previousSums, sums);
+			sums = _mm256_add_epi32(sums, _mm256_sad_epu8(bytes, zero));
+			weightedSums = _mm256_add_epi32(weightedSums, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+		}
+		weightedSums = _mm256_add_epi32(weightedSums, _mm256_slli_epi32(previousSums, 5));
+		sum = (sum + sumWideLanes(sums)) % adler32Modulo;
+		sumOfSums = sumWideLanes(weightedSums) % adler32Modulo;
+	}
+	return sum | (sumOfSums << 16);
+}
+
+enum class Adler32Support {
+	NONE,
+	SSSE3,
+	AVX2,
+};
+
+inline Adler32Support detectAdler32Support() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	std::array<int, 4> registers = {};
+	__cpuid(registers.data(), 1);
+	const bool hasSsse3 = (registers[2] & (1 << 9));
+	const bool osSavesRegisters = (registers[2] & (1 << 27)) && (_xgetbv(0) & 0x06) == 0x06; // The AVX state
+	__cpuidex(registers.data(), 7, 0);
+	const bool hasAvx2 = osSavesRegisters && (registers[1] & (1 << 5));
+#else
+	__builtin_cpu_init();
+	const bool hasSsse3 = __builtin_cpu_supports("ssse3");
+	const bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+	if (hasAvx2) {
+		return Adler32Support::AVX2;
+	}
+	return hasSsse3 ? Adler32Support::SSSE3 : Adler32Support::NONE;
+}
+#endif
+} // namespace Detail
+
+// The Adler-32 checksum used by zlib streams
+class Adler32 {
+	uint32_t state = 1;
+
+public:
+	Adler32() = default;
+	// Continues from the checksum of some preceding data
+	explicit Adler32(uint32_t previous) : state(previous) {}
+
+	uint32_t operator() () { return state; }
+	uint32_t operator() (std::span<const uint8_t> input) {
+		state = Detail::scalarAdler32(state, input.data(), input.size());
+		return state;
+	}
+};
+
+// Uses AVX2 or SSSE3 on x86-64 if the processor has them, otherwise the same as Adler32
+class HardwareAdler32 {
+	uint32_t state = 1;
+
+public:
+	HardwareAdler32() = default;
+	// Continues from the checksum of some preceding data
+	explicit HardwareAdler32(uint32_t previous) : state(previous) {}
+
+	uint32_t operator() () { return state; }
+	uint32_t operator() (std::span<const uint8_t> input) {
+		const uint8_t* data = input.data();
+		size_t size = input.size();
+#if EZGZ_HAS_X86_SIMD
+		static const Detail::Adler32Support support = Detail::detectAdler32Support();
+		if (support == Detail::Adler32Support::AVX2) {
+			state = Detail::avx2Adler32(state, data, size);
+		} else if (support == Detail::Adler32Support::SSSE3) {
+			state = Detail::ssse3Adler32(state, data, size);
+		}
+#endif
+		state = Detail::scalarAdler32(state, data, size);
+		return state;
+	}
+};
+
 struct DefaultDecompressionSettings : MinDecompressionSettings {
 	struct Output {
 		constexpr static int maxSize = 100000;
@@ -303,8 +789,9 @@ struct DefaultDecompressionSettings : MinDecompressionSettings {
 		constexpr static int minSize = 0;
 	};
 
-	using Checksum = FastCrc32;
+	using Checksum = HardwareCrc32;
 	constexpr static bool verifyChecksum = true;
+	constexpr static int huffmanTableRootBits = 10;
 };
 
 namespace Detail {
@@ -326,6 +813,82 @@ private:
 	}
 };
 
+// Stream settings can enable mirrored memory by containing constexpr static bool mirrored = true
+template <typename T, typename = void>
+constexpr bool usesMirroredMemory = false;
+template <typename T>
+constexpr bool usesMirroredMemory<T, std::void_t<decltype(T::mirrored)>> = T::mirrored;
+
+// Stream settings can make files be read or written through io_uring by containing constexpr static bool ioUring = true
+template <typename T, typename = void>
+constexpr bool usesIoUring = false;
+template <typename T>
+constexpr bool usesIoUring<T, std::void_t<decltype(T::ioUring)>> = T::ioUring;
+
+// Memory mapped twice in a row, so that a range of up to period() bytes starting anywhere in the first mapping is contiguous,
+// it's a usual allocation if not supported by the system
+class MirroredMemory {
+	uint8_t* memory = nullptr;
+	size_t periodSize = 0;
+	bool mirrored = false;
+
+public:
+	explicit MirroredMemory(size_t minimumSize) {
+#if EZGZ_HAS_MIRRORED_MEMORY
+		size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+		periodSize = (minimumSize + pageSize - 1) / pageSize * pageSize;
+		int file = memfd_create("ezgz", MFD_CLOEXEC);
+		if (file >= 0) {
+			if (ftruncate(file, off_t(periodSize)) == 0) {
+				// Reserve space for both mappings and then map the file into both halves
+				void* reserved = mmap(nullptr, periodSize * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (reserved != MAP_FAILED) {
+					uint8_t* start = reinterpret_cast<uint8_t*>(reserved);
+					if (mmap(start, periodSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, file, 0) != MAP_FAILED
+							&& mmap(start + periodSize, periodSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, file, 0) != MAP_FAILED) {
+						memory = start;
+						mirrored = true;
+					} else {
+						munmap(reserved, periodSize * 2);
+					}
+				}
+			}
+			close(file); // The mappings keep it alive
+		}
+		if (mirrored)
+			return;
+#endif
+		periodSize = minimumSize;
+		memory = new uint8_t[periodSize];
+	}
+	MirroredMemory(const MirroredMemory&) = delete;
+	MirroredMemory& operator=(const MirroredMemory&) = delete;
+	~MirroredMemory() {
+#if EZGZ_HAS_MIRRORED_MEMORY
+		if (mirrored) {
+			munmap(memory, periodSize * 2);
+			return;
+		}
+#endif
+		delete[] memory;
+	}
+
+	uint8_t* data() const {
+		return memory;
+	}
+	size_t period() const {
+		return periodSize;
+	}
+	bool isMirrored() const {
+		return mirrored;
+	}
+};
+
+template <size_t Size>
+struct MirroredBuffer : MirroredMemory {
+	MirroredBuffer() : MirroredMemory(Size) {}
+};
+
 static constexpr std::array<uint8_t, 19> codeCodingReorder = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
 static constexpr std::array<uint8_t, 19> codeCodingReorderInverse = {3, 17, 15, 13, 11, 9, 7, 5, 4, 6, 8, 10, 12, 14, 16, 18, 0, 1, 2};
 
@@ -335,17 +898,29 @@ static constexpr std::array<uint8_t, 256> reversedBytes = ArrayFiller([] (int un
 
 class ByteInput {
 	std::span<uint8_t> buffer = {};
-	std::function<int(std::span<uint8_t> batch)> readMore;
+	bool readsInPlace = false;
 	int position = 0;
 	int filled = 0;
 	ptrdiff_t positionStart = 0;
 	int minSize = 0;
 	int lookAheadSize = 0;
 	std::function<void(int offset)> notifyInvalidation = [] (int) {};
+	uint8_t* mirroredMemory = nullptr; // If set, the buffer moves through it instead of moving the data
+	int mirroredPeriod = 0;
+	std::span<const uint8_t> inPlaceData = {}; // If reading in place, the buffer is a part of it
+	std::function<void(size_t position)> seekSource; // Makes the source continue from another position, if possible
+	int initialLookAheadSize = 0;
+	constexpr static size_t inPlaceWindow = size_t(1) << 30; // Positions are ints, so larger data are read in parts
+	constexpr static int returnableSize = sizeof(uint64_t);
+
+	// The bit reader may give back some bytes it has taken at the end of deflate data, they must not be discarded if the buffer isn't tiny
+	int keptBehindPosition() const {
+		return std::max(minSize, std::min(returnableSize, int(buffer.size()) / 2));
+	}
 
 	void ensureSize(int bytes) {
 		while (position + bytes + lookAheadSize > filled) [[unlikely]] {
-			int refilled = refillSome(readMore);
+			int refilled = refillSome();
 			if (refilled == 0 && lookAheadSize == 0) {
 				throw std::runtime_error("Unexpected end of stream");
 			}
@@ -354,14 +929,21 @@ class ByteInput {
 
 public:
 
-	ByteInput(std::span<uint8_t> buffer, std::function<int(std::span<uint8_t> batch)> readMoreFunction, int minSize, int lookAheadSize)
-		: buffer(buffer), readMore(std::move(readMoreFunction)), minSize(minSize), lookAheadSize(lookAheadSize) {}
+	using SourceType = std::function<int(std::span<uint8_t> batch)>;
+
+	ByteInput(std::span<uint8_t> buffer, int minSize, int lookAheadSize)
+		: buffer(buffer), minSize(minSize), lookAheadSize(lookAheadSize), initialLookAheadSize(lookAheadSize) {}
+
+	// Reads all the data in place, they are never written into
+	explicit ByteInput(std::span<const uint8_t> allData) : readsInPlace(true), inPlaceData(allData) {
+		seek(0);
+	}
 
 	// Note: May not get as many bytes as necessary, would need to be called multiple times
 	template <typename ByteType = uint8_t>
 	std::span<const ByteType> getRange(int size) {
 		if (position + size + lookAheadSize > filled) {
-			refillSome(readMore);
+			refillSome();
 		}
 		ptrdiff_t start = position;
 		int available = std::min<int>(size, int(filled - start));
@@ -369,6 +951,10 @@ public:
 		return {reinterpret_cast<const ByteType*>(buffer.data()) + start, size_t(available)};
 	}
 
+	int bytesBuffered() const {
+		return filled - position;
+	}
+
 	bool hasMoreDataInBuffer() const {
 		return position + lookAheadSize < filled;
 	}
@@ -424,22 +1010,62 @@ public:
 		return lookAheadSize == 0 && !availableAhead();
 	}
 
-	int refillSome(const std::function<int(std::span<uint8_t> batch)>& readMoreFunction) {
-		int added = readMoreFunction(startFilling());
-		return doneFilling(added);
+	// Reads more data if necessary to find out if there are any left
+	bool hasMoreData() {
+		while (position >= filled) {
+			if (refillSome() == 0 && lookAheadSize == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int refillSome() {
+		if (readsInPlace) {
+			return moveInPlaceWindow(); // All data are already in memory
+		}
+		return doneFilling(readMore(startFilling()));
+	}
+	// Fills the buffer from another source than its own
+	template <InputSource Source>
+	int refillSome(Source&& source) {
+		return doneFilling(source(startFilling()));
 	}
 	std::span<uint8_t> startFilling() {
-		if (position + lookAheadSize >= filled) {
-			int offset = std::max(0, position - minSize);
+		// A full buffer must be moved too, otherwise a read near its end can't get more bytes
+		if (position + lookAheadSize >= filled || filled == int(buffer.size())) {
+			int offset = std::max(0, position - keptBehindPosition());
 			notifyInvalidation(offset);
 			positionStart += offset;
 			filled -= offset;
-			memmove(buffer.data(), buffer.data() + offset, filled);
+			if (mirroredMemory) {
+				ptrdiff_t start = (buffer.data() - mirroredMemory + offset) % mirroredPeriod;
+				buffer = std::span<uint8_t>(mirroredMemory + start, buffer.size());
+			} else {
+				memmove(buffer.data(), buffer.data() + offset, filled);
+			}
 			position -= offset;
 		}
 		return buffer.subspan(filled);
 	}
 
+	// Moves the buffer forward through data read in place
+	int moveInPlaceWindow() {
+		const uint8_t* end = inPlaceData.data() + inPlaceData.size();
+		if (buffer.data() + filled == end) {
+			return 0;
+		}
+		int offset = std::max(0, position - keptBehindPosition());
+		notifyInvalidation(offset);
+		size_t size = std::min<size_t>(end - (buffer.data() + offset), inPlaceWindow);
+		int added = int(size) - (filled - offset);
+		buffer = std::span<uint8_t>(buffer.data() + offset, size);
+		positionStart += offset;
+		position -= offset;
+		filled = int(size);
+		return added;
+	}
+
 	int doneFilling(int added) {
 		addToChecksum(std::span<uint8_t>(reinterpret_cast<uint8_t*>(buffer.data() + filled), added));
 		if (added == 0) {
@@ -454,1346 +1080,2572 @@ public:
 		notifyInvalidation = notification;
 	}
 
+	void setSeekFunction(std::function<void(size_t position)> seekFunction) {
+		seekSource = std::move(seekFunction);
+	}
+
+	// Forgets the data read so far to read other data, the buffer is kept as it is
+	void startOver() {
+		position = 0;
+		filled = 0;
+		positionStart = 0;
+		lookAheadSize = initialLookAheadSize;
+		seekSource = nullptr;
+	}
+	void startOver(std::span<const uint8_t> allData) {
+		inPlaceData = allData;
+		seek(0);
+	}
+
+	// Continues reading from another position in the input, throws if the input can't do it
+	void seek(size_t bytePosition) {
+		if (readsInPlace) {
+			if (bytePosition > inPlaceData.size()) {
+				throw std::runtime_error("Seeking past the end of data");
+			}
+			std::span<const uint8_t> part = inPlaceData.subspan(bytePosition, std::min(inPlaceData.size() - bytePosition, inPlaceWindow));
+			buffer = std::span<uint8_t>(const_cast<uint8_t*>(part.data()), part.size());
+			filled = int(part.size());
+		} else {
+			if (!seekSource) {
+				throw std::runtime_error("This input can't seek");
+			}
+			seekSource(bytePosition);
+			filled = 0;
+			lookAheadSize = initialLookAheadSize;
+		}
+		position = 0;
+		positionStart = ptrdiff_t(bytePosition);
+	}
+
 	template <int MaxTableSize>
 	auto encodedTable(int realSize, const std::array<uint8_t, 256>& codeCodingLookup, const std::array<uint8_t, codeCodingReorder.size()>& codeCodingLengths);
 
 protected:
 	virtual void addToChecksum(std::span<uint8_t> batch) = 0;
-};
+	// Called once per refill of the whole buffer, not when reading in place
+	virtual int readMore(std::span<uint8_t> batch) = 0;
 
-// Provides access to input stream as chunks of contiguous data
-template <InputStreamSettings Settings, typename Checksum>
-class ByteInputWithBuffer : private std::array<uint8_t, Settings::maxSize + Settings::lookAheadSize>, public ByteInput {
-	static_assert(Settings::minSize < Settings::maxSize);
-	std::array<uint8_t, Settings::maxSize + Settings::lookAheadSize> buffer = {};
-	Checksum crc = {};
-
-	void addToChecksum(std::span<uint8_t> batch) override {
-		crc(batch);
+	void useMirroredMemory(const MirroredMemory& memory) {
+		if (memory.isMirrored() && memory.period() >= buffer.size()) {
+			mirroredMemory = memory.data();
+			mirroredPeriod = int(memory.period());
+		}
 	}
+};
 
-public:
-	ByteInputWithBuffer(std::function<int(std::span<uint8_t> batch)> readMoreFunction)
-		: ByteInput(*this, std::move(readMoreFunction), Settings::minSize, Settings::lookAheadSize) {}
-
-	uint32_t checksum() {
-		return crc();
+// Source of a buffer that's only filled from outside through refillSome()
+struct NoMoreInput {
+	int operator()(std::span<uint8_t>) const {
+		return 0;
 	}
 };
 
-constexpr static std::array<int, 30> distanceOffsets = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33,
-		49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
-
-#if EZGZ_HAS_CONCEPTS
-template <typename T>
-concept ByteReader = requires(T reader) {
-	reader.returnBytes(1);
-	std::span<const uint8_t>(reader.getRange(6));
+// Function filling batches of input and a function that makes it continue from another position
+struct SeekableSource {
+	std::function<int(std::span<uint8_t> batch)> read;
+	std::function<void(size_t position)> seek;
 };
-#else
-#define ByteReader typename
-#endif
-
-static constexpr std::array<uint16_t, 17> upperRemovals = {0x0000, 0x0001, 0x0003, 0x0007, 0x000f, 0x001f, 0x003f, 0x007f, 0x00ff,
-		0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff, 0xffff};
 
-// Provides optimised access to data from a ByteInput by bits
-class BitReader {
-	ByteInput* input;
-	int bitsLeft = 0;
-	uint64_t data = 0; // Invariant - lowest bit is the first valid
-	static constexpr int minimumBits = 16; // The specification doesn't require any reading by bits that are longer than 16 bits
+inline SeekableSource readFromSpan(std::span<const uint8_t> data) {
+	auto remaining = std::make_shared<std::span<const uint8_t>>(data);
+	return {[remaining] (std::span<uint8_t> batch) {
+		int copying = int(std::min(batch.size(), remaining->size()));
+		if (copying == 0) {
+			return 0;
+		}
+		memcpy(batch.data(), remaining->data(), copying);
+		*remaining = remaining->subspan(copying);
+		return copying;
+	}, [remaining, data] (size_t position) {
+		if (position > data.size()) {
+			throw std::runtime_error("Seeking past the end of data");
+		}
+		*remaining = data.subspan(position);
+	}};
+}
 
-	void refillIfNeeded() {
-		if (bitsLeft < minimumBits) {
-			std::span<const uint8_t> added = input->getRange(sizeof(data) - (minimumBits / 8));
-			union {
-				std::array<uint8_t, sizeof(uint64_t)> bytes;
-				uint64_t number = 0;
-			} dataAdded;
-			if constexpr (!IsBigEndian) {
-				memcpy(dataAdded.bytes.data(), added.data(), std::ssize(added));
-			} else {
-				for (int i = 0; i < std::ssize(added); i++) {
-					dataAdded.bytes[sizeof(data) - i] = added[i];
-				}
-			};
-			dataAdded.number <<= bitsLeft;
-			data += dataAdded.number;
-			bitsLeft += int(added.size() << 3);
+#if EZGZ_HAS_IO_URING
+// A minimal io_uring instance used through system calls, it's not valid if the kernel doesn't support it or doesn't allow it
+class IoUring {
+	int ring = -1;
+	void* submissionMapping = MAP_FAILED;
+	size_t submissionMappingSize = 0;
+	void* completionMapping = MAP_FAILED;
+	size_t completionMappingSize = 0;
+	io_uring_sqe* entries = nullptr;
+	size_t entriesSize = 0;
+	unsigned* submissionTail = nullptr;
+	unsigned submissionMask = 0;
+	unsigned* submissionArray = nullptr;
+	unsigned* completionHead = nullptr;
+	unsigned* completionTail = nullptr;
+	unsigned completionMask = 0;
+	io_uring_cqe* completions = nullptr;
+	unsigned queued = 0;
+
+	void release() {
+		if (entries) {
+			munmap(entries, entriesSize);
+		}
+		if (completionMapping != MAP_FAILED) {
+			munmap(completionMapping, completionMappingSize);
+		}
+		if (submissionMapping != MAP_FAILED) {
+			munmap(submissionMapping, submissionMappingSize);
+		}
+		if (ring >= 0) {
+			close(ring);
 		}
+		ring = -1;
 	}
 
-public:
-
-	BitReader(ByteInput* byteInput) : input(byteInput) {}
-	BitReader(BitReader&& other) noexcept : input(other.input), bitsLeft(other.bitsLeft), data(other.data) {
-		other.input = nullptr;
+	template <typename T>
+	static T* at(void* mapping, unsigned offset) {
+		return reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(mapping) + offset);
 	}
-	BitReader(const BitReader&) = delete;
-	BitReader& operator=(BitReader&& other) {
-		if (input)
-			input->returnBytes(bitsLeft >> 3);
-		input = other.input;
-		other.input = nullptr;
-		bitsLeft = other.bitsLeft;
-		data = other.data;
-		return *this;
+
+public:
+	explicit IoUring(unsigned depth) {
+		io_uring_params parameters = {};
+		int created = int(syscall(__NR_io_uring_setup, depth, &parameters));
+		if (created < 0) {
+			return;
+		}
+		ring = created;
+		if (!(parameters.features & IORING_FEAT_RW_CUR_POS)) {
+			release(); // Plain reads and writes came with this feature
+			return;
+		}
+		submissionMappingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+		completionMappingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+		const bool singleMapping = (parameters.features & IORING_FEAT_SINGLE_MMAP);
+		if (singleMapping) {
+			submissionMappingSize = completionMappingSize = std::max(submissionMappingSize, completionMappingSize);
+		}
+		submissionMapping = mmap(nullptr, submissionMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+		if (submissionMapping != MAP_FAILED && !singleMapping) {
+			completionMapping = mmap(nullptr, completionMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+		}
+		entriesSize = parameters.sq_entries * sizeof(io_uring_sqe);
+		void* entriesMapping = mmap(nullptr, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+		void* completionSide = singleMapping ? submissionMapping : completionMapping;
+		if (submissionMapping == MAP_FAILED || completionSide == MAP_FAILED || entriesMapping == MAP_FAILED) {
+			if (entriesMapping != MAP_FAILED) {
+				munmap(entriesMapping, entriesSize);
+			}
+			release();
+			return;
+		}
+		entries = reinterpret_cast<io_uring_sqe*>(entriesMapping);
+		submissionTail = at<unsigned>(submissionMapping, parameters.sq_off.tail);
+		submissionMask = *at<unsigned>(submissionMapping, parameters.sq_off.ring_mask);
+		submissionArray = at<unsigned>(submissionMapping, parameters.sq_off.array);
+		completionHead = at<unsigned>(completionSide, parameters.cq_off.head);
+		completionTail = at<unsigned>(completionSide, parameters.cq_off.tail);
+		completionMask = *at<unsigned>(completionSide, parameters.cq_off.ring_mask);
+		completions = at<io_uring_cqe>(completionSide, parameters.cq_off.cqes);
 	}
-	BitReader& operator=(const BitReader&) = delete;
-	~BitReader() {
-		if (input)
-			input->returnBytes(bitsLeft >> 3);
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+	~IoUring() {
+		release();
 	}
 
-	// Up to 16 bits, unwanted bits blanked
-	uint16_t getBits(int amount) {
-		refillIfNeeded();
-		if (bitsLeft < amount) {
-			throw std::runtime_error("Run out of data");
-		}
-		uint16_t result = uint16_t(data);
-		data >>= amount;
-		bitsLeft -= amount;
-		result &= upperRemovals[amount];
-		return result;
+	bool valid() const {
+		return ring >= 0;
 	}
 
-	// Provides 8 bits, the functor must return how many of them were actually wanted
-	template <typename ReadAndTellHowMuchToConsume>
-	void peekAByteAndConsumeSome(const ReadAndTellHowMuchToConsume& readAndTellHowMuchToConsume) {
-		refillIfNeeded();
-		uint8_t pulled = uint8_t(data);
-		auto consumed = readAndTellHowMuchToConsume(pulled);
-		if (bitsLeft < consumed) [[unlikely]] {
-			throw std::runtime_error("Run out of data");
-		}
-		data >>= consumed;
-		bitsLeft -= consumed;
+	// Prepares a read or a write, it's submitted with the next call of submitAndWait(), must not be called more times than the depth
+	void queue(uint8_t operation, int file, const void* data, unsigned size, uint64_t offset, uint64_t userData) {
+		const unsigned tail = *submissionTail + queued;
+		const unsigned index = tail & submissionMask;
+		io_uring_sqe& entry = entries[index];
+		memset(&entry, 0, sizeof(entry));
+		entry.opcode = operation;
+		entry.fd = file;
+		entry.addr = uint64_t(reinterpret_cast<uintptr_t>(data));
+		entry.len = size;
+		entry.off = offset;
+		entry.user_data = userData;
+		submissionArray[index] = index;
+		queued++;
 	}
 
-	// Uses the table in the specification to determine how many bytes are copied
-	int parseLongerSize(int partOfSize) {
-		if (partOfSize != 31) {
-			// Sizes in this range take several extra bits
-			int size = partOfSize;
-			int nextBits = (size - 7) >> 2;
-			auto additionalBits = getBits(nextBits);
-			size++; // Will ease the next line
-			size = ((((size & 0x3) << nextBits) | additionalBits)) + ((1 << (size >> 2)) + 3); // This is a generalisation of the size table at 3.2.5
-			return size;
-		} else {
-			return 258; // If the value is maximmum, it means the size is 258
+	// Submits the queued operations and waits until at least the given number of operations completes
+	void submitAndWait(unsigned waitFor = 0) {
+		if (queued == 0 && waitFor == 0) {
+			return;
+		}
+		__atomic_store_n(submissionTail, *submissionTail + queued, __ATOMIC_RELEASE);
+		unsigned submitting = queued;
+		queued = 0;
+		while (true) {
+			int result = int(syscall(__NR_io_uring_enter, ring, submitting, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+			if (result >= 0) {
+				submitting -= std::min<unsigned>(submitting, unsigned(result));
+				if (submitting == 0) {
+					return;
+				}
+			} else if (errno != EINTR) {
+				throw std::runtime_error("Can't submit operations to io_uring");
+			}
 		}
 	}
 
-	// Uses the table in the specification to determine distance from where bytes are copied
-	int parseLongerDistance(int partOfDistance) {
-		int readMore = (partOfDistance - 3) >> 1;
-		auto moreBits = getBits(readMore);
-		int distance = distanceOffsets[partOfDistance - 1] + moreBits;
-		return distance;
+	// Calls the function with the user data and the result of every completed operation
+	template <typename Function>
+	void forCompleted(const Function& function) {
+		unsigned head = *completionHead;
+		const unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+		for ( ; head != tail; head++) {
+			const io_uring_cqe& completion = completions[head & completionMask];
+			function(completion.user_data, completion.res);
+		}
+		__atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
 	}
 };
 
-constexpr int maximumCopyLength = 258;
-constexpr int maximumCopyDistance = 32768;
-
-struct DeduplicatingStreamSection {
-	int position = 0; // public
-	constexpr static std::array<int, 29> lengthLengthArray = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
-	inline static const int* lengthLength = lengthLengthArray.data() - 257; // Accessing other words than copy words is undefined behaviour
+// Keeps several large reads in flight ahead of the position where the file is being read
+class IoUringFileReader {
+	constexpr static int slotCount = 4;
+	constexpr static unsigned slotSize = 1 << 20;
+	struct Slot {
+		std::unique_ptr<uint8_t[]> data = std::unique_ptr<uint8_t[]>(new uint8_t[slotSize]);
+		size_t offset = 0;
+		unsigned size = 0;
+		unsigned filled = 0;
+		unsigned consumed = 0;
+		bool inFlight = false;
+		bool failed = false;
+	};
+	IoUring ring = IoUring(slotCount);
+	int file = -1;
+	size_t fileSize = 0;
+	size_t nextOffset = 0;
+	std::array<Slot, slotCount> slots;
+	int first = 0; // The slot being read, the following ones hold the data after it
+	int used = 0;
+
+	void requestRest(int index) {
+		Slot& slot = slots[index];
+		slot.inFlight = true;
+		ring.queue(IORING_OP_READ, file, slot.data.get() + slot.filled, slot.size - slot.filled, slot.offset + slot.filled, uint64_t(index));
+	}
 
-	constexpr static std::array<int, 30> distanceLengthArray = {13, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8, 7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0, 0, 0};
-	inline static const int* distanceLength = distanceLengthArray.data() + distanceLengthArray.size(); // Accessing other indexes than between -30 and -1 is UB
+	void request(int index) {
+		Slot& slot = slots[index];
+		slot.offset = nextOffset;
+		slot.size = unsigned(std::min<size_t>(slotSize, fileSize - nextOffset));
+		slot.filled = 0;
+		slot.consumed = 0;
+		slot.failed = false;
+		nextOffset += slot.size;
+		used++;
+		requestRest(index);
+	}
 
-	DeduplicatingStreamSection(std::span<const int16_t> section) : section(section) {}
+	void requestAhead() {
+		while (used < slotCount && nextOffset < fileSize) {
+			request((first + used) % slotCount);
+		}
+		ring.submitAndWait();
+	}
 
-	struct CodeRemainderWithLength {
-		int remainder = 0;
-		int length = 0;
-	};
+	void collect() {
+		ring.forCompleted([this] (uint64_t index, int result) {
+			Slot& slot = slots[index];
+			slot.inFlight = false;
+			if (result < 0) {
+				slot.failed = true;
+			} else if (result == 0) {
+				slot.size = slot.filled; // The file was truncated meanwhile
+			} else {
+				slot.filled += unsigned(result);
+				if (slot.filled < slot.size) {
+					requestRest(int(index));
+				}
+			}
+		});
+	}
 
-	template <typename OnDuplication> // Three arguments, copy length - 1, distance word (range between -1 and -30), distance length - 1
-	int16_t readWord(const OnDuplication& onDuplication) {
-		int16_t word = section[position];
-		if (word >= 257) {
-			CodeRemainderWithLength lengthRemainder{ (-section[position + 1] & upperRemovals[lengthLength[word]]), lengthLength[word] };
-			int distanceWord = section[position + 2];
-			CodeRemainderWithLength distanceRemainder{ (-section[position + 3] & upperRemovals[distanceLength[distanceWord]]), distanceLength[distanceWord] };
-			onDuplication(lengthRemainder, section[position + 2], distanceRemainder);
-			position += 4;
-		} else {
-			position++;
+	void waitForAll() {
+		while (std::any_of(slots.begin(), slots.end(), [] (const Slot& slot) { return slot.inFlight; })) {
+			ring.submitAndWait(1);
+			collect();
 		}
-		return word;
 	}
 
-	bool atEnd() const {
-		return position == std::ssize(section);
+public:
+	// Returns false if the file can't be read this way
+	bool open(const std::string& fileName) {
+		if (!ring.valid()) {
+			return false;
+		}
+		file = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+		struct stat status = {};
+		if (file < 0 || fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+			return false;
+		}
+		fileSize = size_t(status.st_size);
+		requestAhead();
+		return true;
 	}
-	int endPosition() const {
-		return int(std::ssize(section));
+	IoUringFileReader() = default;
+	IoUringFileReader(const IoUringFileReader&) = delete;
+	IoUringFileReader& operator=(const IoUringFileReader&) = delete;
+	~IoUringFileReader() {
+		try {
+			waitForAll(); // The kernel must not write into freed buffers
+		} catch (...) {}
+		if (file >= 0) {
+			close(file);
+		}
 	}
 
-private:
-	std::span<const int16_t> section = {};
-};
+	int read(std::span<uint8_t> batch) {
+		if (used == 0) {
+			return 0;
+		}
+		Slot& slot = slots[first];
+		while (slot.inFlight) {
+			ring.submitAndWait(1);
+			collect();
+			ring.submitAndWait(); // Reads that came short
+		}
+		if (slot.failed) {
+			throw std::runtime_error("Can't read file");
+		}
+		const unsigned copied = std::min<unsigned>(unsigned(batch.size()), slot.size - slot.consumed);
+		memcpy(batch.data(), slot.data.get() + slot.consumed, copied);
+		slot.consumed += copied;
+		if (slot.consumed == slot.size) {
+			first = (first + 1) % slotCount;
+			used--;
+			requestAhead();
+		}
+		return int(copied);
+	}
 
-struct IDeduplicatedStream {
-	virtual void flush() = 0;
-	virtual void addByte(uint8_t value) = 0;
-	virtual void addDuplication(int length, int distance) = 0;
-	virtual ~IDeduplicatedStream() = default;
+	void seek(size_t position) {
+		waitForAll();
+		nextOffset = std::min(position, fileSize);
+		used = 0;
+		requestAhead();
+	}
 };
 
-template <StreamSettings Settings>
-class DeduplicatedStream : public IDeduplicatedStream {
-	std::array<int16_t, Settings::maxSize> deduplicated = {};
-	int position = 0;
+// Copies written data into large buffers and writes them while the next ones are being filled
+class IoUringFileWriter {
+	constexpr static int slotCount = 4;
+	constexpr static unsigned slotSize = 1 << 20;
+	struct Slot {
+		std::unique_ptr<uint8_t[]> data = std::unique_ptr<uint8_t[]>(new uint8_t[slotSize]);
+		size_t offset = 0;
+		unsigned size = 0;
+		unsigned written = 0;
+		bool inFlight = false;
+	};
+	IoUring ring = IoUring(slotCount);
+	int file = -1;
+	size_t nextOffset = 0;
+	std::array<Slot, slotCount> slots;
+	int current = 0; // The slot being filled
+	bool failed = false;
+
+	void requestRest(int index) {
+		Slot& slot = slots[index];
+		slot.inFlight = true;
+		ring.queue(IORING_OP_WRITE, file, slot.data.get() + slot.written, slot.size - slot.written, slot.offset + slot.written, uint64_t(index));
+	}
 
-private:
-	std::function<int(DeduplicatingStreamSection, bool DeduplicatingStreamSection)> submit = {};
+	void collect() {
+		ring.forCompleted([this] (uint64_t index, int result) {
+			Slot& slot = slots[index];
+			slot.inFlight = false;
+			if (result <= 0) {
+				failed = true;
+				return;
+			}
+			slot.written += unsigned(result);
+			if (slot.written < slot.size) {
+				requestRest(int(index));
+			}
+		});
+	}
 
-	void add(int16_t value) {
-		deduplicated[position] = value;
-		position++;
+	void waitFor(const Slot& slot) {
+		while (slot.inFlight) {
+			ring.submitAndWait(1);
+			collect();
+			ring.submitAndWait(); // Writes that came short
+		}
 	}
 
-	void ensureSize(int size) {
-		if (position + size > std::ssize(deduplicated)) [[unlikely]] {
-			DeduplicatingStreamSection section(std::span<const int16_t>(deduplicated.begin(), deduplicated.begin() + position));
-			int consumed = submit(section, false);
-			if (consumed < std::ssize(deduplicated) - position - size)
-				throw std::runtime_error("DeduplicatedStream must have a submit callback that consumes at least 4 bytes");
-			memmove(deduplicated.data(), deduplicated.data() + consumed, (position - consumed) * sizeof(int16_t));
-			position -= consumed;
+	void writeCurrent() {
+		Slot& slot = slots[current];
+		if (slot.size == 0) {
+			return;
 		}
+		slot.offset = nextOffset;
+		slot.written = 0;
+		nextOffset += slot.size;
+		requestRest(current);
+		ring.submitAndWait();
+		current = (current + 1) % slotCount;
+		waitFor(slots[current]);
+		slots[current].size = 0;
 	}
 
 public:
-	DeduplicatedStream(std::function<int(DeduplicatingStreamSection, bool lastCall)> submit) : submit(std::move(submit)) {}
-	~DeduplicatedStream() {
-		flush();
+	// Returns false if the file can't be written this way
+	bool open(const std::string& fileName) {
+		if (!ring.valid()) {
+			return false;
+		}
+		file = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		return file >= 0;
 	}
-
-	void flush() override {
-		if (position > 0) [[likely]] {
-			DeduplicatingStreamSection section(std::span<const int16_t>(deduplicated.begin(), deduplicated.begin() + position));
-			submit(section, true);
+	IoUringFileWriter() = default;
+	IoUringFileWriter(const IoUringFileWriter&) = delete;
+	IoUringFileWriter& operator=(const IoUringFileWriter&) = delete;
+	~IoUringFileWriter() {
+		// Like with std::ofstream, errors while closing are lost
+		try {
+			writeCurrent();
+			for (const Slot& slot : slots) {
+				waitFor(slot);
+			}
+		} catch (...) {}
+		if (file >= 0) {
+			close(file);
 		}
 	}
 
-	void addByte(uint8_t value) override {
-		ensureSize(1);
-		add(value);
+	void write(std::span<const char> batch) {
+		if (failed) {
+			throw std::runtime_error("Can't write file");
+		}
+		while (batch.size() > 0) {
+			Slot& slot = slots[current];
+			const unsigned copied = std::min<unsigned>(unsigned(batch.size()), slotSize - slot.size);
+			memcpy(slot.data.get() + slot.size, batch.data(), copied);
+			slot.size += copied;
+			batch = batch.subspan(copied);
+			if (slot.size == slotSize) {
+				writeCurrent();
+			}
+		}
 	}
+};
+#endif
 
-	void addDuplication(int length, int distance) override {
-		ensureSize(4);
-
-		if (length <= 10) {
-			add(int16_t(254 + length));
-			add(-1);
-		} else if (length == maximumCopyLength) {
-			add(285);
-			add(-1);
-		} else {
-			unsigned int modifiedLength = length - 3;
-			int width = std::bit_width(modifiedLength);
-			int suffixWidth = width - 3;
-			int prefix = modifiedLength >> suffixWidth;
-			int code = 257 + prefix + (suffixWidth << 2);
-			add(int16_t(code));
-			add(-int16_t(modifiedLength));
+#ifndef EZGZ_NO_FILE
+// Reads through io_uring on Linux if asked to and if possible, with std::ifstream otherwise
+inline SeekableSource readFromFile(const std::string& fileName, [[maybe_unused]] bool useIoUring = false) {
+#if EZGZ_HAS_IO_URING
+	if (useIoUring) {
+		auto reader = std::make_shared<IoUringFileReader>();
+		if (reader->open(fileName)) {
+			return {[reader] (std::span<uint8_t> batch) {
+				return reader->read(batch);
+			}, [reader] (size_t position) {
+				reader->seek(position);
+			}};
+		}
+	}
+#endif
+	auto file = std::make_shared<std::ifstream>(fileName, std::ios::binary);
+	return {[file] (std::span<uint8_t> batch) {
+		if (file->eof()) {
+			return 0; // It may be asked again after the end was reached
+		}
+		if (!file->good()) {
+			throw std::runtime_error("Can't read file");
+		}
+		file->read(reinterpret_cast<char*>(batch.data()), batch.size());
+		int bytesRead = int(file->gcount());
+		return bytesRead;
+	}, [file] (size_t position) {
+		file->clear();
+		if (!file->seekg(std::streamoff(position))) {
+			throw std::runtime_error("Can't seek in file");
 		}
+	}};
+}
 
-		if (distance <= 4) {
-			add(int16_t(-distance));
-			add(-1);
-		} else {
-			unsigned int modifiedDistance = distance - 1;
-			int width = std::bit_width(modifiedDistance);
-			int suffixWidth = width - 2;
-			int prefix = modifiedDistance >> suffixWidth;
-			int code = prefix + (suffixWidth << 1);
-			add(int16_t(- code - 1));
-			add(-int16_t(modifiedDistance));
+// Writes through io_uring on Linux if asked to and if possible, with std::ofstream otherwise
+inline std::function<void(std::span<const char> batch)> writeToFile(const std::string& fileName, [[maybe_unused]] bool useIoUring = false) {
+#if EZGZ_HAS_IO_URING
+	if (useIoUring) {
+		auto writer = std::make_shared<IoUringFileWriter>();
+		if (writer->open(fileName)) {
+			return [writer] (std::span<const char> batch) {
+				writer->write(batch);
+			};
 		}
 	}
-};
+#endif
+	return [file = std::make_shared<std::ofstream>(fileName, std::ios::binary)] (std::span<const char> batch) {
+		if (!file->good()) {
+			throw std::runtime_error("Can't write file");
+		}
+		file->write(batch.data(), batch.size());
+	};
+}
+#endif
 
-// Handles output of decompressed data, filling bytes from past bytes and chunking. Consume needs to be called to empty it
-template <StreamSettings Settings, typename Checksum>
-class ByteOutput {
-	std::array<char, Settings::maxSize> buffer = {};
-	int used = 0; // Number of bytes filled in the buffer (valid data must start at index 0)
-	int kept = 0;
-	bool expectsMore = true; // If we expect more data to be present
-	Checksum checksum = {};
-	int writtenOut = 0; // TOOD: Remove
+// Provides access to input stream as chunks of contiguous data, the source's type can be given to avoid wrapping it in a std::function
+// The decoder still reaches the source through one virtual call per refill of the buffer
+template <InputStreamSettings Settings, typename Checksum, InputSource Source = ByteInput::SourceType>
+class ByteInputWithBuffer : private std::conditional_t<usesMirroredMemory<Settings>, MirroredBuffer<Settings::maxSize + Settings::lookAheadSize>,
+		std::array<uint8_t, Settings::maxSize + Settings::lookAheadSize>>, public ByteInput {
+	static_assert(Settings::minSize < Settings::maxSize);
+	using Storage = std::conditional_t<usesMirroredMemory<Settings>, MirroredBuffer<Settings::maxSize + Settings::lookAheadSize>,
+		std::array<uint8_t, Settings::maxSize + Settings::lookAheadSize>>;
+	Checksum crc = {};
+	Source source;
 
-	void checkSize(int added = 1) {
-		if (used + added > std::ssize(buffer)) [[unlikely]] {
-			throw std::logic_error("Writing more bytes than available, probably an internal bug");
-		}
+	void addToChecksum(std::span<uint8_t> batch) override {
+		crc(batch);
+	}
+	int readMore(std::span<uint8_t> batch) override {
+		return source(batch);
 	}
 
 public:
-	int available() {
-		return int(buffer.size() - used);
+	using SourceType = Source;
+
+	ByteInputWithBuffer(Source readMoreFunction)
+		: ByteInput(std::span<uint8_t>(Storage::data(), Settings::maxSize + Settings::lookAheadSize), Settings::minSize, Settings::lookAheadSize),
+		source(std::move(readMoreFunction)) {
+		if constexpr (usesMirroredMemory<Settings>) {
+			useMirroredMemory(*this);
+		}
 	}
+	ByteInputWithBuffer(SeekableSource source) : ByteInputWithBuffer(std::move(source.read)) {
+		setSeekFunction(std::move(source.seek));
+	}
+	ByteInputWithBuffer(std::span<const uint8_t> data) : ByteInputWithBuffer(readFromSpan(data)) {}
+#ifndef EZGZ_NO_FILE
+	ByteInputWithBuffer(const std::string& fileName) : ByteInputWithBuffer(readFromFile(fileName, usesIoUring<Settings>)) {}
+#endif
 
-	int minSize() {
-		return expectsMore ? Settings::minSize : 0;
+	// Reads from another source, without initialising the buffer again
+	void reset(Source readMoreFunction) {
+		source = std::move(readMoreFunction);
+		crc = {};
+		startOver();
+	}
+	void reset(SeekableSource seekableSource) {
+		reset(std::move(seekableSource.read));
+		setSeekFunction(std::move(seekableSource.seek));
+	}
+	void reset(std::span<const uint8_t> data) {
+		reset(readFromSpan(data));
 	}
 
-	std::span<const char> getBuffer() {
-		return std::span<const char>(buffer.data() + kept, used - kept);
+	uint32_t checksum() {
+		return crc();
 	}
+};
 
-	void cleanBuffer(int leave = 0) {
-		leave = std::max(leave, expectsMore? Settings::minSize : 0);
-		if (used - leave <= 0) {
+#ifndef EZGZ_NO_FILE
+// Provides read-only access to a file's contents, mapping it into memory if possible
+class MappedFile {
+	const uint8_t* mapped = nullptr;
+	size_t mappedSize = 0;
+	std::vector<uint8_t> contents; // If it can't be mapped
+
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& fileName) {
+#if EZGZ_HAS_MMAP
+		int descriptor = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+		if (descriptor < 0) {
+			throw std::runtime_error("Can't read file");
+		}
+		struct stat fileStatus = {};
+		if (fstat(descriptor, &fileStatus) != 0) {
+			close(descriptor);
+			throw std::runtime_error("Can't read file");
+		}
+		if (fileStatus.st_size > 0) {
+			void* mapping = mmap(nullptr, size_t(fileStatus.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (mapping != MAP_FAILED) {
+				mapped = reinterpret_cast<const uint8_t*>(mapping);
+				mappedSize = size_t(fileStatus.st_size);
+				madvise(mapping, mappedSize, MADV_SEQUENTIAL); // Only a hint to read ahead, failure doesn't matter
+			}
+		}
+		close(descriptor); // The mapping keeps it alive
+		if (mapped || fileStatus.st_size == 0) {
 			return;
 		}
-		if (leave == 0) {
-			checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer.data()), used));
-			writtenOut += used;
-			used = 0;
-			kept = 0;
-		} else {
-			checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer.data()), used - leave));
-			memmove(buffer.data(), buffer.data() + used - leave, leave);
-			writtenOut += used - leave;
-			used = leave;
-			kept = leave;
+#endif
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file.good()) {
+			throw std::runtime_error("Can't read file");
 		}
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
 	}
-
-	void addByte(char byte) {
-		checkSize();
-		buffer[used] = byte;
-		used++;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() {
+#if EZGZ_HAS_MMAP
+		if (mapped) {
+			munmap(const_cast<uint8_t*>(mapped), mappedSize);
+		}
+#endif
 	}
 
-	void addBytes(std::span<const char> bytes) {
-		checkSize(int(bytes.size()));
-		memcpy(buffer.data() + used, bytes.data(), bytes.size());
-		used += int(bytes.size());
+	std::span<const uint8_t> data() const {
+		if (mapped) {
+			return std::span<const uint8_t>(mapped, mappedSize);
+		}
+		return contents;
 	}
+};
+#else
+class MappedFile {};
+#endif
 
-	void repeatSequence(int length, int distance) {
-		checkSize(length);
-		int written = 0;
-		while (written < length) {
-			if (distance > used) {
-				throw std::runtime_error("Looking back too many bytes, corrupted archive or insufficient buffer size");
-			}
-			int toWrite = std::min(distance, length - written);
-			memmove(buffer.data() + used, buffer.data() + used - distance, toWrite);
-			used += toWrite;
-			written += toWrite;
-		}
+// Reads data already in memory without copying them, either from a span provided by the caller or from a file mapped into memory
+class ByteInputFromMemory : private MappedFile, public ByteInput {
+	std::span<const uint8_t> allData;
+
+	void addToChecksum(std::span<uint8_t>) override {}
+	int readMore(std::span<uint8_t>) override {
+		return 0; // Never called, the data are read in place
 	}
 
-	auto& getChecksum() {
-		return checksum;
+public:
+	ByteInputFromMemory(std::span<const uint8_t> data) : ByteInput(data), allData(data) {}
+#ifndef EZGZ_NO_FILE
+	ByteInputFromMemory(const std::string& fileName) : MappedFile(fileName), ByteInput(MappedFile::data()), allData(MappedFile::data()) {}
+#endif
+
+	std::span<const uint8_t> contents() const {
+		return allData;
 	}
 
-	void done() { // Called when the whole buffer can be consumed because the data won't be needed anymore
-		expectsMore = false;
+	void reset(std::span<const uint8_t> data) {
+		allData = data;
+		startOver(data);
 	}
 };
 
-template <StreamSettings Settings, typename Checksum>
-class BitOutput {
-	uint64_t data = 0;
-	int filled = 0;
-	ByteOutput<Settings, Checksum>& output;
+constexpr static std::array<int, 30> distanceOffsets = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33,
+		49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
 
-	void doEmpty(int bytes) {
-		const char* dataAsBytes = reinterpret_cast<char*>(&data);
+#if EZGZ_HAS_CONCEPTS
+template <typename T>
+concept ByteReader = requires(T reader) {
+	reader.returnBytes(1);
+	std::span<const uint8_t>(reader.getRange(6));
+};
+#else
+#define ByteReader typename
+#endif
+
+static constexpr std::array<uint16_t, 17> upperRemovals = {0x0000, 0x0001, 0x0003, 0x0007, 0x000f, 0x001f, 0x003f, 0x007f, 0x00ff,
+		0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff, 0xffff};
+
+// Provides optimised access to data from a ByteInput by bits
+class BitReader {
+	ByteInput* input;
+	int bitsLeft = 0;
+	uint64_t data = 0; // Invariant - lowest bit is the first valid, bits above bitsLeft are either zero or the bits that follow
+	static constexpr int minimumBits = 16; // The specification doesn't require any reading by bits that are longer than 16 bits
+
+	void addBytes(std::span<const uint8_t> added) {
+		union {
+			std::array<uint8_t, sizeof(uint64_t)> bytes;
+			uint64_t number = 0;
+		} dataAdded;
 		if constexpr (!IsBigEndian) {
-			std::array<char, 8> moved = {};
-			for (int i = 0; i < bytes; i++)
-				moved[i] = dataAsBytes[i];
-//			output.addBytes(moved);
-			output.addBytes(std::span<const char>(dataAsBytes, bytes));
+			memcpy(dataAdded.bytes.data(), added.data(), std::ssize(added));
 		} else {
-			std::array<char, 8> invertedBytes = {};
-			for (int i = 0; i < bytes; i++) {
-				invertedBytes[bytes - i] = dataAsBytes[i];
-				output.addBytes(std::span<const char>(invertedBytes.data(), bytes));
+			for (int i = 0; i < std::ssize(added); i++) {
+				dataAdded.bytes[sizeof(data) - 1 - i] = added[i];
 			}
-		}
+		};
+		dataAdded.number <<= bitsLeft;
+		data |= dataAdded.number;
+		bitsLeft += int(added.size() << 3);
 	}
 
-	void emptyIfNeeded() {
-		if (filled > 48) [[unlikely]] { // Will always keep space for 16 bits
-			int removingBytes = filled / 8; // Rounded down
-			doEmpty(removingBytes);
-			int removingBits = removingBytes * 8;
-			data >>= removingBits;
-			filled -= removingBits;
+	void refillIfNeeded() {
+		while (bitsLeft < minimumBits) {
+			std::span<const uint8_t> added = input->getRange(sizeof(data) - (minimumBits / 8));
+			if (added.size() == 0) {
+				break;
+			}
+			addBytes(added);
 		}
 	}
 
 public:
-	BitOutput(ByteOutput<Settings, Checksum>& output) : output(output) {}
 
-	~BitOutput() {
-		doEmpty((filled + 7) / 8); // Round up before dividing by 8
+	BitReader(ByteInput* byteInput) : input(byteInput) {}
+	BitReader(BitReader&& other) noexcept : input(other.input), bitsLeft(other.bitsLeft), data(other.data) {
+		other.input = nullptr;
 	}
-
-	void addBits(uint64_t value, int size) { // More than 16 bits is actually not supported (there is no use case for more)
-		data += value << filled;
-		filled += size;
-		emptyIfNeeded();
+	BitReader(const BitReader&) = delete;
+	BitReader& operator=(BitReader&& other) {
+		if (input)
+			input->returnBytes(bitsLeft >> 3);
+		input = other.input;
+		other.input = nullptr;
+		bitsLeft = other.bitsLeft;
+		data = other.data;
+		return *this;
+	}
+	BitReader& operator=(const BitReader&) = delete;
+	~BitReader() {
+		if (input)
+			input->returnBytes(bitsLeft >> 3);
 	}
 
-	void addBitsAndCrop(uint64_t value, int size) { // More than 16 bits is actually not supported (there is no use case for more)
-		data += (value & upperRemovals[size]) << filled;
-		filled += size;
-		emptyIfNeeded();
+	// Up to 16 bits, unwanted bits blanked
+	uint16_t getBits(int amount) {
+		refillIfNeeded();
+		if (bitsLeft < amount) {
+			throw std::runtime_error("Run out of data");
+		}
+		uint16_t result = uint16_t(data);
+		data >>= amount;
+		bitsLeft -= amount;
+		result &= upperRemovals[amount];
+		return result;
 	}
-};
 
-// Represents a table encoding Huffman codewords and can parse the stream by bits
-template <int MaxSize>
-class EncodedTable {
-	BitReader& reader;
-	struct CodeIndexEntry {
-		int16_t word = 0;
-		int8_t length = 0;
-		bool valid = false;
-	};
-	std::array<CodeIndexEntry, 256> codesIndex = {}; // If value is greater than MaxSize, it's a remainder at index value minus MaxSize
-	struct CodeRemainder {
-		uint8_t remainder = 0;
-		uint8_t bitsLeft = 0;
-		uint16_t index = 0; // bit or with 0x8000 if it's the last one in sequence
-	};
-	std::array<CodeRemainder, MaxSize> remainders = {};
+	// Provides 8 bits, the functor must return how many of them were actually wanted
+	template <typename ReadAndTellHowMuchToConsume>
+	void peekAByteAndConsumeSome(const ReadAndTellHowMuchToConsume& readAndTellHowMuchToConsume) {
+		refillIfNeeded();
+		uint8_t pulled = uint8_t(data);
+		auto consumed = readAndTellHowMuchToConsume(pulled);
+		if (bitsLeft < consumed) [[unlikely]] {
+			throw std::runtime_error("Run out of data");
+		}
+		data >>= consumed;
+		bitsLeft -= consumed;
+	}
 
-public:
-	EncodedTable(BitReader& reader, int realSize, std::array<uint8_t, 256> codeCodingLookup, std::array<uint8_t, codeCodingReorder.size()> codeCodingLengths)
-	: reader(reader) {
-		std::array<int, 17> quantities = {};
-		struct CodeEntry {
-			uint8_t start = 0;
-			uint8_t ending = 0;
-			uint8_t length = 0;
-		};
-		std::array<CodeEntry, MaxSize> codes = {};
+	// Provides up to 16 bits (bits past the end of data are zero), the functor must return how many of them were actually wanted
+	template <int PeekedBits, typename ReadAndTellHowMuchToConsume>
+	void peekAndConsumeSome(const ReadAndTellHowMuchToConsume& readAndTellHowMuchToConsume) {
+		static_assert(PeekedBits <= minimumBits);
+		refillIfNeeded();
+		uint16_t pulled = uint16_t(data) & upperRemovals[PeekedBits];
+		auto consumed = readAndTellHowMuchToConsume(pulled);
+		if (bitsLeft < consumed) [[unlikely]] {
+			throw std::runtime_error("Run out of data");
+		}
+		data >>= consumed;
+		bitsLeft -= consumed;
+	}
 
-		// Read the Huffman-encoded Huffman codes
-		for (int i = 0; i < realSize; ) {
-			int length = 0;
-			reader.peekAByteAndConsumeSome([&] (uint8_t peeked) {
-				length = codeCodingLookup[peeked];
-				return codeCodingLengths[length];
-			});
-			if (length < 16) {
-				codes[i].length = uint8_t(length);
-				i++;
-				quantities[length]++;
-			} else if (length == 16) {
-				if (i == 0) [[unlikely]]
-					throw std::runtime_error("Invalid lookback position");
-				int copy = reader.getBits(2) + 3;
-				for (int j = i; j < i + copy; j++) {
-					codes[j].length = codes[i - 1].length;
-				}
-				quantities[codes[i - 1].length] += copy;
-				i += copy;
-			} else if (length > 16) {
-				int zeroCount = 0;
-				if (length == 17) {
-					zeroCount = reader.getBits(3) + 3;
-				} else {
-					int sevenBitsValue = reader.getBits(7);
-					zeroCount = sevenBitsValue + 11;
-				};
-				for (int j = i; j < i + zeroCount; j++) {
-					codes[j].length = 0;
+	// Loads whole bytes until at least 56 bits are available (unless the data is running out) if fewer than the given amount is available
+	void refillIfBelow(int amount) {
+		if (bitsLeft < amount) {
+			if constexpr (!IsBigEndian) {
+				// Loading a whole word is faster than copying a variable number of bytes
+				std::span<const uint8_t> added = input->getRange(sizeof(data));
+				input->returnBytes(int(added.size()));
+				if (added.size() == sizeof(data)) [[likely]] {
+					refillUnchecked();
+					return;
 				}
-				i += zeroCount;
 			}
+			// The source may provide fewer bytes than requested, so it's asked again until there are enough or the data end
+			do {
+				std::span<const uint8_t> added = input->getRange((int(sizeof(data)) * 8 - 1 - bitsLeft) >> 3);
+				if (added.size() == 0) {
+					break;
+				}
+				addBytes(added);
+			} while (bitsLeft < amount);
 		}
+	}
 
-		struct UnindexedEntry {
-			int quantity = 0;
-			int startIndex = 0;
-			int filled = 0;
-		};
-		std::array<UnindexedEntry, 256> unindexedEntries = {};
+	// Whether refillUnchecked() can be used
+	bool canRefillUnchecked() const {
+		return !IsBigEndian && input->bytesBuffered() >= int(sizeof(data));
+	}
 
-		// Generate the codes
-		int nextCode = 0;
-		for (int size = 1; size <= 16; size++) {
-			if (quantities[size] > 0) {
-				for (int i = 0; i <= realSize; i++) {
-					if (codes[i].length == size) {
-						if (nextCode >= (1 << size)) [[unlikely]]
-								throw std::runtime_error("Bad Huffman encoding, run out of Huffman codes");
-						uint8_t firstPart = uint8_t(nextCode);
-						if (size <= 8) [[likely]] {
-							codes[i].start = reversedBytes[firstPart];
-							for (int code = codes[i].start >> (8 - size); code < std::ssize(codesIndex); code += (1 << size)) {
-								codesIndex[code].word = int16_t(i);
-								codesIndex[code].length = int8_t(size);
-								codesIndex[code].valid = true;
-							}
-						} else {
-							uint8_t start = reversedBytes[uint8_t(nextCode >> (size - 8))];
-							codes[i].start = start;
-							codesIndex[start].valid = true;
-							unindexedEntries[start].quantity++;
-							codes[i].ending = reversedBytes[uint8_t(nextCode)] >> (16 - size);
-						}
-						nextCode++;
-					}
-				}
-			}
-			nextCode <<= 1;
-		}
+	// Loads whole bytes until at least 56 bits are available, only if canRefillUnchecked() is true
+	void refillUnchecked() {
+		int added = (int(sizeof(data)) * 8 - 1 - bitsLeft) >> 3;
+		data |= input->getEightBytesAtPosition(input->getPosition()) << bitsLeft;
+		input->advancePosition(added);
+		bitsLeft += added * 8;
+	}
 
-		// Calculate ranges of the longer parts
-		int currentStartIndex = 0;
-		for (auto& entry : unindexedEntries) {
-			entry.startIndex = currentStartIndex;
-			currentStartIndex += entry.quantity;
-		}
+	// All loaded bits, the bits above them may already hold the following input bytes, or zeroes past the end of data
+	uint64_t peekBits() const {
+		return data;
+	}
 
-		// Index the longer parts
-		for (int i = 0; i < std::ssize(codes); i++) {
-			CodeEntry& code = codes[i];
-			if (code.length > 8) {
-				UnindexedEntry& unindexedEntry = unindexedEntries[code.start];
-				CodeRemainder& remainder = remainders[unindexedEntry.startIndex + unindexedEntry.filled];
-				codesIndex[code.start].word = int16_t(MaxSize + unindexedEntry.startIndex);
-				unindexedEntry.filled++;
-				remainder.remainder = code.ending; // The upper bits are cut
-				remainder.bitsLeft = code.length - 8;
-				remainder.index = uint16_t(i);
-				if (unindexedEntry.filled == unindexedEntry.quantity)
-					remainder.index |= 0x8000;
-			}
+	// Position of the next bit to be read since the start of input
+	ptrdiff_t bitPosition() const {
+		return (input->getPositionStart() + input->getPosition()) * 8 - bitsLeft;
+	}
+
+	// Up to 56 bits, must be preceded by a refill, the check can be skipped if a refill was guaranteed to load enough bits
+	template <bool Unchecked = false>
+	void consumeBits(int amount) {
+		if (!Unchecked && bitsLeft < amount) [[unlikely]] {
+			throw std::runtime_error("Run out of data");
 		}
+		data >>= amount;
+		bitsLeft -= amount;
 	}
 
-	int readWord() {
-		int word = 0;
-		reader.peekAByteAndConsumeSome([&] (uint8_t peeked) {
-			const CodeIndexEntry entry = codesIndex[peeked];
-			word = entry.word;
-			if (word >= MaxSize) {
-				return 8;
-			} else if (!entry.valid) {
-				throw std::runtime_error("Unknown Huffman code (not even first 8 bits)");
-			}
-			return int(entry.length);
-		});
+	// Uses the table in the specification to determine how many bytes are copied
+	int parseLongerSize(int partOfSize) {
+		if (partOfSize != 31) {
+			// Sizes in this range take several extra bits
+			int size = partOfSize;
+			int nextBits = (size - 7) >> 2;
+			auto additionalBits = getBits(nextBits);
+			size++; // Will ease the next line
+			size = ((((size & 0x3) << nextBits) | additionalBits)) + ((1 << (size >> 2)) + 3); // This is a generalisation of the size table at 3.2.5
+			return size;
+		} else {
+			return 258; // If the value is maximmum, it means the size is 258
+		}
+	}
 
-		// Longer codes than a byte are indexed specially
-		static constexpr std::array<uint8_t, 9> endMasks = { 0x00, 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff };
-		if (word >= MaxSize) {
-			reader.peekAByteAndConsumeSome([&] (uint8_t peeked) {
-				for (int i = word - MaxSize; i < MaxSize * 2; i++) {
-					if ((peeked & endMasks[remainders[i].bitsLeft]) == remainders[i].remainder) {
-						word = remainders[i].index & 0x7fff;
-						return remainders[i].bitsLeft;
-					}
+	// Uses the table in the specification to determine distance from where bytes are copied
+	int parseLongerDistance(int partOfDistance) {
+		int readMore = (partOfDistance - 3) >> 1;
+		auto moreBits = getBits(readMore);
+		int distance = distanceOffsets[partOfDistance - 1] + moreBits;
+		return distance;
+	}
+};
 
-					if (remainders[i].index & 0x8000) {
-						throw std::runtime_error("Unknown Huffman code (ending bits don't fit)");
-					}
-				}
-				throw std::runtime_error("Unknown Huffman code (bad prefix)");
-			});
+constexpr int maximumCopyLength = 258;
+constexpr int maximumCopyDistance = 32768;
+
+struct DeduplicatingStreamSection {
+	int position = 0; // public
+	constexpr static std::array<int, 29> lengthLengthArray = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	inline static const int* lengthLength = lengthLengthArray.data() - 257; // Accessing other words than copy words is undefined behaviour
+
+	constexpr static std::array<int, 30> distanceLengthArray = {13, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8, 7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+	inline static const int* distanceLength = distanceLengthArray.data() + distanceLengthArray.size(); // Accessing other indexes than between -30 and -1 is UB
+
+	DeduplicatingStreamSection(std::span<const int16_t> section) : section(section) {}
+
+	struct CodeRemainderWithLength {
+		int remainder = 0;
+		int length = 0;
+	};
+
+	template <typename OnDuplication> // Three arguments, copy length - 1, distance word (range between -1 and -30), distance length - 1
+	int16_t readWord(const OnDuplication& onDuplication) {
+		int16_t word = section[position];
+		if (word >= 257) {
+			CodeRemainderWithLength lengthRemainder{ (-section[position + 1] & upperRemovals[lengthLength[word]]), lengthLength[word] };
+			int distanceWord = section[position + 2];
+			CodeRemainderWithLength distanceRemainder{ (-section[position + 3] & upperRemovals[distanceLength[distanceWord]]), distanceLength[distanceWord] };
+			onDuplication(lengthRemainder, section[position + 2], distanceRemainder);
+			position += 4;
+		} else {
+			position++;
 		}
 		return word;
 	}
-};
 
-template <int MaxTableSize>
-auto ByteInput::encodedTable(int realSize, const std::array<uint8_t, 256>& codeCodingLookup, const std::array<uint8_t, codeCodingReorder.size()>& codeCodingLengths) {
-	return EncodedTable<MaxTableSize>(*this, realSize, codeCodingLookup, codeCodingLengths);
-}
+	bool atEnd() const {
+		return position == std::ssize(section);
+	}
+	int endPosition() const {
+		return int(std::ssize(section));
+	}
 
-struct RepetitionChecker {
-	virtual bool checkIfStillValid(ptrdiff_t oldPosition, ptrdiff_t currentPosition) = 0;
-	virtual int getMatchLength(ptrdiff_t oldPosition, ptrdiff_t currentPosition, int alreadyVerified = 0) = 0;
-	virtual ~RepetitionChecker() = default;
+private:
+	std::span<const int16_t> section = {};
 };
 
-#if EZGZ_HAS_CONCEPTS
-template <typename Index>
-concept DeduplicatingSearch = requires(Index index, RepetitionChecker& repetitionChecker, ptrdiff_t position, int distance, int length, uint64_t sequence, int offset) {
-	Index(repetitionChecker);
-	std::tie(distance, length) = index.indexValueAndLocateBestMatch(position, sequence);
-	index.indexValue(position, sequence);
+struct IDeduplicatedStream {
+	virtual void flush() = 0;
+	virtual void addByte(uint8_t value) = 0;
+	virtual void addDuplication(int length, int distance) = 0;
+	virtual ~IDeduplicatedStream() = default;
 };
 
-template <typename T>
-concept Deduplicator = requires(T deduplicator, ByteInput& input, IDeduplicatedStream& output) {
-	T(input, output);
-	deduplicator.deduplicateSome();
-};
-#else
-#define DeduplicatingSearch typename
-#define Deduplicator typename
-#endif
+template <StreamSettings Settings>
+class DeduplicatedStream : public IDeduplicatedStream {
+	std::array<int16_t, Settings::maxSize> deduplicated; // Not initialised, it's written before being read
+	int position = 0;
 
-struct LastRepetitionEntry {
-	struct Repository{};
-	ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
-	uint64_t sequence = 0;
-	void indexValue(Repository&, uint64_t newSequence, ptrdiff_t position) {
-		location = position;
-		sequence = newSequence;
-	}
-	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository& repository, uint64_t newSequence, ptrdiff_t position) {
-		uint64_t mismatch = sequence ^ newSequence;
-		int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
-		ptrdiff_t oldLocation = location;
-		matchLength /= 8;
-		indexValue(repository, newSequence, position);
-		if (!repetitionChecker.checkIfStillValid(oldLocation, position)) {
-			return {0, oldLocation};
-		}
-		return {matchLength, oldLocation};
-	}
-};
+private:
+	std::function<int(DeduplicatingStreamSection, bool DeduplicatingStreamSection)> submit = {};
 
-template <int HistorySize = 2>
-struct StatelessRepetitionCircularBuffer {
-	struct RepetitionEntry {
-		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
-		uint64_t sequence = 0;
-	};
-	struct Repository{};
-	std::array<RepetitionEntry, HistorySize> repetitions = {};
-	void indexValue(Repository&, uint64_t sequence, ptrdiff_t position) {
-		int oldest = 0;
-		ptrdiff_t oldestEntry = std::numeric_limits<ptrdiff_t>::max();
-		for (int i = 0; i < std::ssize(repetitions); i++) {
-			if (repetitions[i].location < oldestEntry) {
-				oldest = i;
-				oldestEntry = repetitions[i].location;
-			}
-		}
-		repetitions[oldest].location = position;
-		repetitions[oldest].sequence = sequence;
+	void add(int16_t value) {
+		deduplicated[position] = value;
+		position++;
 	}
-	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository&, uint64_t sequence, ptrdiff_t position) {
-		int oldest = 0;
-		ptrdiff_t oldestEntry = std::numeric_limits<ptrdiff_t>::max();
-		int bestMatch = 0;
-		ptrdiff_t bestMatchLocation = 0;
-		for (int i = 0; i < std::ssize(repetitions); i++) {
-			if (repetitions[i].location < oldestEntry) {
-				oldest = i;
-				oldestEntry = repetitions[i].location;
-			}
-			if (!repetitionChecker.checkIfStillValid(repetitions[i].location, position)) {
-				continue;
-			}
-			uint64_t mismatch = repetitions[i].sequence ^ sequence;
-			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
-			matchLength /= 8;
-			if (matchLength == 8) {
-				matchLength = repetitionChecker.getMatchLength(repetitions[i].location, position, 8);
-			}
-			if (matchLength > bestMatch) {
-				bestMatch = matchLength;
-				bestMatchLocation = repetitions[i].location;
-			}
+
+	void ensureSize(int size) {
+		if (position + size > std::ssize(deduplicated)) [[unlikely]] {
+			DeduplicatingStreamSection section(std::span<const int16_t>(deduplicated.begin(), deduplicated.begin() + position));
+			int consumed = submit(section, false);
+			if (consumed < std::ssize(deduplicated) - position - size)
+				throw std::runtime_error("DeduplicatedStream must have a submit callback that consumes at least 4 bytes");
+			memmove(deduplicated.data(), deduplicated.data() + consumed, (position - consumed) * sizeof(int16_t));
+			position -= consumed;
 		}
-		repetitions[oldest].location = position;
-		repetitions[oldest].sequence = sequence;
-		return {bestMatch, bestMatchLocation};
 	}
-};
 
-template <int HistorySize = 5>
-struct RepetitionCircularBuffer {
-	struct RepetitionEntry {
-		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
-		uint64_t sequence = 0;
-	};
-	struct Repository{};
-	std::array<RepetitionEntry, HistorySize> repetitions = {};
-	int lastEntry = 0;
-	void indexValue(Repository&, uint64_t sequence, ptrdiff_t position) {
-		lastEntry++;
-		lastEntry = (lastEntry == std::ssize(repetitions)) ? 0 : lastEntry;
-		repetitions[lastEntry].location = position;
-		repetitions[lastEntry].sequence = sequence;
+public:
+	DeduplicatedStream(std::function<int(DeduplicatingStreamSection, bool lastCall)> submit) : submit(std::move(submit)) {}
+	~DeduplicatedStream() {
+		flush();
 	}
-	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository&, uint64_t sequence, ptrdiff_t position) {
-		int bestMatch = 0;
-		ptrdiff_t bestMatchLocation = 0;
-		for (int i = 0; i < std::ssize(repetitions); i++) {
-			if (!repetitionChecker.checkIfStillValid(repetitions[i].location, position)) {
-				continue;
-			}
-			uint64_t mismatch = repetitions[i].sequence ^ sequence;
-			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
-			matchLength /= 8;
-			if (matchLength == 8) {
-				matchLength = repetitionChecker.getMatchLength(repetitions[i].location, position, 8);
-			}
-			if (matchLength > bestMatch) {
-				bestMatch = matchLength;
-				bestMatchLocation = repetitions[i].location;
-			}
+
+	void flush() override {
+		if (position > 0) [[likely]] {
+			DeduplicatingStreamSection section(std::span<const int16_t>(deduplicated.begin(), deduplicated.begin() + position));
+			submit(section, true);
 		}
-		lastEntry++;
-		lastEntry = (lastEntry == std::ssize(repetitions)) ? 0 : lastEntry;
-		repetitions[lastEntry].location = position;
-		repetitions[lastEntry].sequence = sequence;
-		return {bestMatch, bestMatchLocation};
 	}
-};
 
-struct QueueHistoryBuffer {
-	struct RepetitionEntry {
-		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
-		uint64_t sequence = 0;
-	};
-	struct Repository{};
-	std::deque<RepetitionEntry> repetitions = {};
-	void indexValue(Repository&, uint64_t sequence, ptrdiff_t position) {
-		repetitions.emplace_back(RepetitionEntry{position, sequence});
+	void addByte(uint8_t value) override {
+		ensureSize(1);
+		add(value);
 	}
-	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository& repository, uint64_t sequence, ptrdiff_t position) {
-		while (!repetitions.empty() && !repetitionChecker.checkIfStillValid(repetitions.front().location, position)) {
-			repetitions.pop_front();
+
+	void addDuplication(int length, int distance) override {
+		ensureSize(4);
+
+		if (length <= 10) {
+			add(int16_t(254 + length));
+			add(-1);
+		} else if (length == maximumCopyLength) {
+			add(285);
+			add(-1);
+		} else {
+			unsigned int modifiedLength = length - 3;
+			int width = std::bit_width(modifiedLength);
+			int suffixWidth = width - 3;
+			int prefix = modifiedLength >> suffixWidth;
+			int code = 257 + prefix + (suffixWidth << 2);
+			add(int16_t(code));
+			add(-int16_t(modifiedLength));
 		}
-		int bestMatch = 0;
-		ptrdiff_t bestMatchLocation = 0;
-		for (const RepetitionEntry& it : repetitions) {
-			uint64_t mismatch = it.sequence ^ sequence;
-			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
-			matchLength /= 8;
-			if (matchLength == 8) {
-				matchLength = repetitionChecker.getMatchLength(it.location, position, 8);
-			}
-			if (matchLength > bestMatch) {
-				bestMatch = matchLength;
-				bestMatchLocation = it.location;
-			}
+
+		if (distance <= 4) {
+			add(int16_t(-distance));
+			add(-1);
+		} else {
+			unsigned int modifiedDistance = distance - 1;
+			int width = std::bit_width(modifiedDistance);
+			int suffixWidth = width - 2;
+			int prefix = modifiedDistance >> suffixWidth;
+			int code = prefix + (suffixWidth << 1);
+			add(int16_t(- code - 1));
+			add(-int16_t(modifiedDistance));
 		}
-		indexValue(repository, sequence, position);
-		return {bestMatch, bestMatchLocation};
 	}
 };
 
-template <int MaxIterations = maximumCopyDistance, int QueueSize = maximumCopyDistance>
-struct CircularQueueHistoryBuffer {
-	struct RepetitionEntry {
-		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
-		uint64_t sequence = 0;
-		int nextIndex = QueueSize;
-	};
-	struct Repository {
-		int nextIndex = 0;
-		std::array<RepetitionEntry, QueueSize + 1> entries = {}; // Last element is never assigned and always discarded because of bad address
-	};
-	RepetitionEntry last = {};
-	void indexValue(Repository& repository, uint64_t sequence, ptrdiff_t position) {
-		repository.entries[repository.nextIndex] = last;
-		last.nextIndex = repository.nextIndex;
-		last.sequence = sequence;
-		last.location = position;
-		repository.nextIndex = (repository.nextIndex + 1) % QueueSize; // TODO: Check if this is done through a bitmask
-	}
-	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository& repository, uint64_t sequence, ptrdiff_t position) {
-		if (!repetitionChecker.checkIfStillValid(last.location, position)) {
-			last.nextIndex = QueueSize;
-			last.sequence = sequence;
-			last.location = position;
-			return {0, 0};
+constexpr int repetitionSlack = 16; // Repetitions are copied in chunks that may write up to this many bytes past the end
+
+// Repeats a sequence that ends at the destination, there must be repetitionSlack bytes of space after the repeated sequence
+inline void repeatSequenceWithSlack(char* destination, int length, int distance) {
+	const char* source = destination - distance;
+	if (distance >= repetitionSlack) {
+		// Every chunk is copied from bytes that were already written
+		for (int i = 0; i < length; i += repetitionSlack) {
+			memcpy(destination + i, source + i, repetitionSlack);
 		}
-		int bestMatch = 0;
-		ptrdiff_t bestMatchLocation = 0;
-		auto checkIfBest = [&] (const RepetitionEntry& entry) {
-			uint64_t mismatch = entry.sequence ^ sequence;
-			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
-			matchLength /= 8;
-			if (matchLength == 8) {
-				matchLength = repetitionChecker.getMatchLength(entry.location, position, 8);
-			}
-			if (matchLength > bestMatch) {
-				bestMatch = matchLength;
-				bestMatchLocation = entry.location;
-			}
-		};
-		checkIfBest(last);
-		int iterations = 0;
-		ptrdiff_t lastPosition = std::numeric_limits<ptrdiff_t>::max();
-		for (int index = last.nextIndex; repetitionChecker.checkIfStillValid(repository.entries[index].location, position); index = repository.entries[index].nextIndex) {
-			checkIfBest(repository.entries[index]);
-			if constexpr(QueueSize != maximumCopyDistance) {
-				if (lastPosition <= repository.entries[index].location) {
-					break;
-				}
-				lastPosition = repository.entries[index].location;
-			}
-			if constexpr(MaxIterations < maximumCopyDistance) {
-				iterations++;
-				if (iterations >= MaxIterations) {
-					break;
-				}
-			}
-			if (bestMatch == maximumCopyLength) {
-				break;
-			}
+	} else {
+		// Short distances repeat a pattern, it's stored as many times as it fits into a chunk, so that any chunk can be written as a whole
+		std::array<char, repetitionSlack> pattern = {};
+		for (int i = 0; i < distance; i++) {
+			pattern[i] = source[i];
+		}
+		for (int i = distance; i < repetitionSlack; i++) {
+			pattern[i] = pattern[i - distance];
+		}
+		int period = repetitionSlack - repetitionSlack % distance;
+		for (int i = 0; i < length; i += period) {
+			memcpy(destination + i, pattern.data(), repetitionSlack);
 		}
-		indexValue(repository, sequence, position);
-		return {bestMatch, bestMatchLocation};
 	}
-};
+}
 
-template <typename Entry, int Bits = 16>
-class PrefixBasedDuplicationIndex {
-	constexpr static int IndexSize = 1u << Bits;
+// Handles output of decompressed data, filling bytes from past bytes and chunking. Consume needs to be called to empty it
+template <StreamSettings Settings, typename Checksum>
+class ByteOutput {
+	constexpr static int bufferSize = Settings::maxSize + repetitionSlack;
+	std::conditional_t<usesMirroredMemory<Settings>, MirroredBuffer<bufferSize>, std::array<char, bufferSize>> storage; // Not initialised, only written data are read
+	char* buffer = reinterpret_cast<char*>(storage.data()); // Moves through mirrored memory instead of moving the data
+	int used = 0; // Number of bytes filled in the buffer (valid data must start at index 0)
+	int kept = 0;
+	bool expectsMore = true; // If we expect more data to be present
+	Checksum checksum = {};
+	int checksummed = 0; // Bytes at the start of the buffer that are already included in the checksum
+	int writtenOut = 0; // TOOD: Remove
 
-	std::array<Entry, IndexSize> index = {};
-	RepetitionChecker& repetitionChecker;
-	typename Entry::Repository repository = {};
+	void checkSize(int added = 1) {
+		if (used + added > Settings::maxSize) [[unlikely]] {
+			throw std::logic_error("Writing more bytes than available, probably an internal bug");
+		}
+	}
 
-	Entry& getEntry(uint64_t sequence) {
-		constexpr uint64_t Mask = (!IsBigEndian) ? ~(0xffffffffffffffff << Bits) : ~(0xffffffffffffffff >> Bits);
-		uint64_t prefix = (!IsBigEndian) ? sequence & Mask : (sequence & Mask) >> (64 - Bits);
-		static_assert((!IsBigEndian) ? (~(0xffffffffffffffff << Bits) < IndexSize) : (0xffffffffffffffff >> (64 - Bits) < IndexSize));
-		return index[prefix];
+	void discardStart(int removed) {
+		if constexpr (usesMirroredMemory<Settings>) {
+			if (storage.isMirrored()) {
+				char* start = reinterpret_cast<char*>(storage.data());
+				buffer = start + (buffer - start + removed) % ptrdiff_t(storage.period());
+				return;
+			}
+		}
+		memmove(buffer, buffer + removed, used - removed);
 	}
 
 public:
-	PrefixBasedDuplicationIndex(RepetitionChecker& repetitionChecker) : repetitionChecker(repetitionChecker) {}
+	ByteOutput() = default;
+	ByteOutput(const ByteOutput&) = delete; // The buffer can point into its own storage
+	ByteOutput& operator=(const ByteOutput&) = delete;
 
-	void indexValue(ptrdiff_t position, uint64_t sequence) {
-		getEntry(sequence).indexValue(repository, sequence, position);
+	int available() {
+		return Settings::maxSize - used;
 	}
 
-	std::pair<ptrdiff_t, int> indexValueAndLocateBestMatch(ptrdiff_t position, uint64_t sequence) {
-		Entry& selected = getEntry(sequence);
-		auto [bestMatch, bestMatchLocation] = selected.indexValueAndLocateBestMatch(repetitionChecker, repository, sequence, position);
+	int minSize() {
+		return expectsMore ? Settings::minSize : 0;
+	}
 
-		if (bestMatch > 4) { // Everything in the sequence matches
-			return {bestMatchLocation, bestMatch};
-		} else if (bestMatch >= 3) { // 3 bytes are enough to write a duplication
-			return {bestMatchLocation, bestMatch};
-		} else { // No match
-			return {position, 0};
+	std::span<const char> getBuffer() {
+		return std::span<const char>(buffer + kept, used - kept);
+	}
+
+	void cleanBuffer(int leave = 0) {
+		leave = std::max(leave, expectsMore? Settings::minSize : 0);
+		if (used - leave <= 0) {
+			kept = used; // Nothing can be discarded yet, but the data were already given out
+			return;
+		}
+		if (leave == 0) {
+			checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer) + checksummed, used - checksummed));
+			checksummed = 0;
+			writtenOut += used;
+			used = 0;
+			kept = 0;
+		} else {
+			if (used - leave > checksummed) {
+				checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer) + checksummed, used - leave - checksummed));
+			}
+			checksummed = std::max(0, checksummed - (used - leave));
+			discardStart(used - leave);
+			writtenOut += used - leave;
+			used = leave;
+			kept = leave;
 		}
 	}
-};
 
-class DeduplicatorBase : protected RepetitionChecker {
-protected:
-	ptrdiff_t positionStart = 0;
-	ByteInput& input;
+	// Unchecked versions are for callers that ensure there is enough space in advance
+	template <bool Unchecked = false>
+	void addByte(char byte) {
+		if constexpr (!Unchecked)
+			checkSize();
+		buffer[used] = byte;
+		used++;
+	}
 
-	bool checkIfStillValid(ptrdiff_t oldPosition, ptrdiff_t currentPosition) override {
-		return (currentPosition <= oldPosition + maximumCopyDistance && positionStart <= oldPosition);
+	void addBytes(std::span<const char> bytes) {
+		checkSize(int(bytes.size()));
+		memcpy(buffer + used, bytes.data(), bytes.size());
+		used += int(bytes.size());
 	}
-	int getMatchLength(ptrdiff_t oldPosition, ptrdiff_t currentPosition, int alreadyVerified) override {
-		for ( ; alreadyVerified < maximumCopyLength; alreadyVerified++) { // TODO: Don't go past end
-			if (input.getAtPosition(oldPosition - positionStart + alreadyVerified) != input.getAtPosition(currentPosition - positionStart + alreadyVerified)) {
-				return alreadyVerified;
-			}
+
+	template <bool Unchecked = false>
+	void repeatSequence(int length, int distance) {
+		if constexpr (!Unchecked)
+			checkSize(length);
+		if (distance > used) [[unlikely]] {
+			throw std::runtime_error("Looking back too many bytes, corrupted archive or insufficient buffer size");
 		}
-		return alreadyVerified;
+		repeatSequenceWithSlack(buffer + used, length, distance);
+		used += length;
 	}
-	DeduplicatorBase(ByteInput& input) : input(input) { }
-};
 
-enum DeduplicationFlags : uint32_t {
-	NO_DUPLICATION_FLAGS = 0x0,
-	INDEX_DUPLICATES = 0x1,
-	INCLUDE_SMALL_DUPLICATES = 0x2,
-};
+	// Checksums the data written since the last time, so that they don't have to be loaded from memory again later
+	void updateChecksum() {
+		checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer) + checksummed, used - checksummed));
+		checksummed = used;
+	}
 
-template <DeduplicatingSearch DuplicationIndex, DeduplicationFlags deduplicationFlags>
-class EagerDeduplicator : private DeduplicatorBase {
-	IDeduplicatedStream& output;
-	DuplicationIndex search = {*this};
+	auto& getChecksum() {
+		updateChecksum();
+		return checksum;
+	}
 
-public:
-	EagerDeduplicator(ByteInput& input, IDeduplicatedStream& output) : DeduplicatorBase(input), output(output) {
-		input.setInvalidationNotification([this] (int offset) {
-			positionStart += offset;
-		});
+	void done() { // Called when the whole buffer can be consumed because the data won't be needed anymore
+		expectsMore = false;
 	}
 
-	void deduplicateSome() {
-		do {
-			uint64_t sequence = input.getEightBytesFromCurrentPosition();
-			int position = input.getPosition() - 1;
-			int location = 0;
-			int matchLength = 0;
-			std::tie(location, matchLength) = search.indexValueAndLocateBestMatch(position + positionStart, sequence);
-			location -= positionStart;
-			matchLength = std::min(matchLength, input.availableAhead());
-			int distance = position - location;
+	// Continues with another stream, the data written so far aren't included in its checksum
+	void startNextStream() {
+		expectsMore = true;
+		checksum = {};
+		checksummed = used;
+	}
 
-			if constexpr(deduplicationFlags & INCLUDE_SMALL_DUPLICATES) {
-				if (matchLength == 3 && distance > 64) {
-					matchLength = 0; // Turns out this is not worth the 5 extra bits of distance encoding
-				}
-			}
-			if (matchLength >= 3) {
-				if constexpr(deduplicationFlags & INDEX_DUPLICATES) {
-					if (matchLength >= 3) {
-						for (ptrdiff_t indexingAt = position + 1; indexingAt < position + matchLength - 1; indexingAt++) {
-							search.indexValue(indexingAt + positionStart, input.getEightBytesAtPosition(indexingAt));
-						}
-					}
-				}
-				if (distance < 0) {
-					throw std::runtime_error("We screwed up");
-				}
-				output.addDuplication(matchLength, distance);
-				input.advancePosition(matchLength - 1);
-			} else {
-				output.addByte(input.getAtPosition(position));
-			}
-		} while (input.hasMoreDataInBuffer());
+	// The last bytes written, up to the number that is available
+	std::span<const char> history(int size) const {
+		int available = std::min(size, used);
+		return std::span<const char>(buffer + used - available, available);
 	}
 
-	void flush() {}
+	// Starts anew with the given data already written and given out, so that they can be repeated
+	void restart(std::span<const char> window) {
+		checkSize(int(window.size()) - used);
+		if (window.size() > 0) {
+			memcpy(buffer, window.data(), window.size());
+		}
+		used = int(window.size());
+		kept = used;
+		expectsMore = true;
+		checksum = {};
+		checksummed = used;
+	}
+
+	// Marks some data from the start of the buffer as given out, without giving them out
+	void skip(int bytes) {
+		kept += bytes;
+	}
 };
 
-template <DeduplicatingSearch DuplicationIndex, int MaxSize, DeduplicationFlags deduplicationFlags>
-struct PickyDeduplicator : private DeduplicatorBase {
-	IDeduplicatedStream& output;
+// Decompressed data are written directly into a contiguous buffer provided by the user, the data already written serve as the window for repetitions
+template <typename Checksum>
+class ContiguousByteOutput {
+	std::span<char> buffer = {};
+	size_t used = 0;
+	size_t checksummed = 0;
+	Checksum checksum = {};
 
-	DuplicationIndex search = {*this};
+	void checkSize(size_t added) {
+		if (used + added > buffer.size()) [[unlikely]] {
+			throw std::logic_error("Writing more bytes than available, probably an internal bug");
+		}
+	}
 
-	struct RepetitionEntry {
-		int position = 0;
-		int16_t length = 0;
-		uint16_t distance = 0;
-	};
-	std::array<RepetitionEntry, MaxSize> repetitions = {};
-	int repetitionsUsed = 0;
+public:
+	ContiguousByteOutput(std::span<char> buffer = {}) : buffer(buffer) {}
 
-	int flushedUntil = 0;
-	int unflushedData = 0;
+	// The new buffer must start with the data written so far, useful for growing it
+	void setBuffer(std::span<char> newBuffer) {
+		if (newBuffer.size() < used) [[unlikely]] {
+			throw std::logic_error("The new buffer can't hold the data already written");
+		}
+		buffer = newBuffer;
+	}
 
-public:
-	PickyDeduplicator(ByteInput& input, IDeduplicatedStream& output) : DeduplicatorBase(input), output(output) {
-		input.setInvalidationNotification([this] (int offset) {
-			flush();
-			positionStart += offset;
-			flushedUntil -= offset;
-		});
+	size_t size() const {
+		return used;
 	}
-	~PickyDeduplicator() {
-		flush();
+
+	int available() {
+		return int(std::min<size_t>(buffer.size() - used, std::numeric_limits<int>::max()));
 	}
 
-	void deduplicateSome() {
-		do {
-			uint64_t sequence = input.getEightBytesFromCurrentPosition();
-			int position = input.getPosition() - 1;
-			int location = 0;
-			int matchLength = 0;
-			std::tie(location, matchLength) = search.indexValueAndLocateBestMatch(position + positionStart, sequence);
-			location -= positionStart;
-			matchLength = std::min(matchLength, input.availableAhead());
-			int distance = position - location;
+	template <bool Unchecked = false>
+	void addByte(char byte) {
+		if constexpr (!Unchecked)
+			checkSize(1);
+		buffer[used] = byte;
+		used++;
+	}
 
-			if constexpr(deduplicationFlags & INCLUDE_SMALL_DUPLICATES) {
-				if (matchLength == 3 && distance > 64) {
-					matchLength = 0; // Turns out this is not worth the 5 extra bits of distance encoding
-				}
-			}
-			if (matchLength >= 3) {
-				if (distance < 0) {
-					throw std::runtime_error("We screwed up");
-				}
-				repetitions[repetitionsUsed] = RepetitionEntry{position, int16_t(matchLength), uint16_t(distance)};
-				repetitionsUsed++;
-				if (repetitionsUsed >= std::ssize(repetitions)) {
-					flush();
-				}
-			}
-			unflushedData++;
-		} while (input.hasMoreDataInBuffer());
+	void addBytes(std::span<const char> bytes) {
+		checkSize(bytes.size());
+		memcpy(buffer.data() + used, bytes.data(), bytes.size());
+		used += bytes.size();
 	}
 
-	void flush() {
-		// Make sure duplications don't overlap with the next step
-		int endAt = flushedUntil + unflushedData;
-		for (int i = repetitionsUsed - 1; i >= 0; i--) {
-			int fromEnd = repetitions[i].position + repetitions[i].length - endAt;
-			if (fromEnd > 0) {
-				repetitions[i].length -= fromEnd;
-				if (repetitions[i].length < 3) {
-					repetitions[i].length = 0;
-				}
-			}
-			if (repetitions[i].position + maximumCopyLength <= endAt) {
-				break;
-			}
+	template <bool Unchecked = false>
+	void repeatSequence(int length, int distance) {
+		if constexpr (!Unchecked)
+			checkSize(length);
+		if (size_t(distance) > used) [[unlikely]] {
+			throw std::runtime_error("Looking back too many bytes, corrupted archive");
 		}
-
-		// Prune duplications
-		if (repetitionsUsed >= 2) {
-			int previousRepetitionUsed = 0;
-			for (int i = 1; i < repetitionsUsed; i++) {
-				RepetitionEntry& current = repetitions[i];
-				RepetitionEntry& previous = repetitions[previousRepetitionUsed];
-				if (previous.position + previous.length < current.position) {
-					previousRepetitionUsed = i;
-					continue; // No overlap;
-				}
-				int remainderOfTheLast = previous.position + previous.length - current.position;
-				if (remainderOfTheLast < current.length) {
-					if (previous.length - remainderOfTheLast > 3) {
-						previous.length -= remainderOfTheLast; // Shorten it
-						previousRepetitionUsed = i;
-					} else {
-						// One of them has to be removed, this strategy is not optimal
-						if (current.length > previous.length) {
-							previous = RepetitionEntry{};
-							previousRepetitionUsed = i;
-						} else {
-							current = RepetitionEntry{};
-						}
-					}
-				} else {
-					current = RepetitionEntry{}; // The repetition is a subset of another one
-				}
+		if (used + length + repetitionSlack <= buffer.size()) [[likely]] {
+			repeatSequenceWithSlack(buffer.data() + used, length, distance);
+		} else {
+			for (int i = 0; i < length; i++) {
+				buffer[used + i] = buffer[used + i - distance];
 			}
 		}
+		used += length;
+	}
 
-		// Write into the stream
-		int lastRepetitionEnd = flushedUntil;
-		auto writeRangeWithoutDuplications = [&] (int until) {
-			for (int i = lastRepetitionEnd; i < until; i++) {
-				output.addByte(input.getAtPosition(i));
-			}
-		};
-		for (int i = 0; i < repetitionsUsed; i++) {
-			if (repetitions[i].length) {
-				writeRangeWithoutDuplications(repetitions[i].position);
-				output.addDuplication(repetitions[i].length, repetitions[i].distance);
-				if (repetitions[i].length < 3) {
-					throw std::runtime_error("We screwed up");
-				}
-				lastRepetitionEnd = repetitions[i].position + repetitions[i].length;
-				repetitions[i] = RepetitionEntry{};
-			}
-		}
-		repetitionsUsed = 0;
-		writeRangeWithoutDuplications(flushedUntil + unflushedData);
-		flushedUntil += unflushedData;
-		unflushedData = 0;
+	void updateChecksum() {
+		checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer.data()) + checksummed, used - checksummed));
+		checksummed = used;
 	}
-};
 
-// Higher level class handling the overall state of parsing. Implemented as a state machine to allow pausing when output is full.
-template <DecompressionSettings Settings>
-class DeflateReader {
-	ByteInput& input;
-	ByteOutput<typename Settings::Output, typename Settings::Checksum>& output;
+	auto& getChecksum() {
+		updateChecksum();
+		return checksum;
+	}
 
-	struct CopyState {
-		int copyDistance = 0;
-		int copyLength = 0;
+	void done() {}
 
-		bool restart(decltype(DeflateReader::output)& output) {
-			int copying = int(std::min(output.available(), copyLength));
-			output.repeatSequence(copying, copyDistance);
-			copyLength -= copying;
-			return (copyLength == 0);
-		}
-		bool copy(decltype(DeflateReader::output)& output, int length, int distance) {
-			copyLength = length;
-			copyDistance = distance;
-			return restart(output);
-		}
-	};
+	void startNextStream() {
+		checksum = {};
+		checksummed = used;
+	}
+};
 
-	struct LiteralState {
-		int bytesLeft = 0;
-		LiteralState(DeflateReader* parent) {
-			int length = int(parent->input.getBytes(2));
-			int antiLength = int(parent->input.getBytes(2));
-			if ((~length & 0xffff) != antiLength) {
-				throw std::runtime_error("Corrupted data, inverted length of literal block is mismatching");
-			}
-			bytesLeft = length;
-		}
+template <StreamSettings Settings, typename Checksum>
+class BitOutput {
+	uint64_t data = 0;
+	int filled = 0;
+	ByteOutput<Settings, Checksum>& output;
 
-		bool parseSome(DeflateReader* parent) {
-			if (parent->output.available() > bytesLeft) {
-				std::span<const uint8_t> chunk = parent->input.getRange(bytesLeft);
-				parent->output.addBytes(std::span<const char>(reinterpret_cast<const char*>(chunk.data()), (chunk.size())));
-				bytesLeft -= int(chunk.size());
-				return (bytesLeft > 0);
-			} else {
-				std::span<const uint8_t> chunk = parent->input.getRange(parent->output.available());
-				bytesLeft -= int(chunk.size());
-				parent->output.addBytes(std::span<const char>(reinterpret_cast<const char*>(chunk.data()), (chunk.size())));
-				return true;
+	void doEmpty(int bytes) {
+		const char* dataAsBytes = reinterpret_cast<char*>(&data);
+		if constexpr (!IsBigEndian) {
+			std::array<char, 8> moved = {};
+			for (int i = 0; i < bytes; i++)
+				moved[i] = dataAsBytes[i];
+//			output.addBytes(moved);
+			output.addBytes(std::span<const char>(dataAsBytes, bytes));
+		} else {
+			std::array<char, 8> invertedBytes = {};
+			for (int i = 0; i < bytes; i++) {
+				invertedBytes[bytes - i] = dataAsBytes[i];
+				output.addBytes(std::span<const char>(invertedBytes.data(), bytes));
 			}
 		}
-	};
-
-	struct FixedCodeState : CopyState {
-		BitReader input;
-		FixedCodeState(decltype(input)&& input) : input(std::move(input)) {}
+	}
 
-		bool parseSome(DeflateReader* parent) {
-			if (CopyState::copyLength > 0) { // Resume copying if necessary
-				if (CopyState::restart(parent->output)) {
-					return true; // Out of space
-				}
-			}
+	void emptyIfNeeded() {
+		if (filled > 48) [[unlikely]] { // Will always keep space for 16 bits
+			int removingBytes = filled / 8; // Rounded down
+			doEmpty(removingBytes);
+			int removingBits = removingBytes * 8;
+			data >>= removingBits;
+			filled -= removingBits;
+		}
+	}
 
-			struct CodeEntry {
-				int8_t length = 7;
-				int16_t code = 0;
-			};
-			constexpr static std::array<CodeEntry, 256> codeIndex = ArrayFiller([] (uint8_t oneByteReversed) constexpr {
-				uint8_t oneByte = reversedBytes[oneByteReversed];
-				if (oneByte < 0b00000010) {
-					return CodeEntry{7, 256};
-				} else if (oneByte < 0b00110000) {
-					return CodeEntry{7, int16_t((oneByte >> 1) - 1 + 257)};
-				} else if (oneByte < 0b11000000) {
-					return CodeEntry{8, int16_t(oneByte - 0b00110000)};
-				} else if (oneByte < 0b11001000) {
-					return CodeEntry{8, int16_t(oneByte - 0b11000000 + 280)};
-				} else {
-					return CodeEntry{8, int16_t(oneByte - 0b11001000 + 144)};
-				}
-			});
+public:
+	BitOutput(ByteOutput<Settings, Checksum>& output) : output(output) {}
 
-			while (parent->output.available()) {
-				CodeEntry code = {};
-				input.peekAByteAndConsumeSome([&code] (uint8_t peeked) {
-					code = codeIndex[peeked];
-					return code.length;
-				});
+	// Writes out the remaining bits, padding the last byte, this isn't done by the destructor because it may throw if the output is full
+	void flush() {
+		doEmpty((filled + 7) / 8); // Round up before dividing by 8
+		data = 0;
+		filled = 0;
+	}
 
-				if (code.code == 256) [[unlikely]] {
-					break;
-				} else if (code.code > 256) {
-					int length = code.code - 254;
-					if (length > 10) {
-						length = input.parseLongerSize(length);
-					}
-					static constexpr std::array<uint8_t, 32> lengthDictionary = ArrayFiller([] (int uninverted) constexpr {
-						uint8_t reversed = uint8_t((uninverted * uint64_t(0x0202020202) & uint64_t(0x010884422010)) % 0x3ff);
-						return uint8_t((reversed >> 3) + 1); // Convert to length word
-					});
-					int distance = lengthDictionary[input.getBits(5)];
-					if (distance > 4) {
-						distance = input.parseLongerDistance(distance);
-					}
-					CopyState::copy(parent->output, length, distance);
-				} else {
-					if (code.code < 144) {
-						parent->output.addByte(char(code.code));
-					} else {
-						uint8_t full = uint8_t((((code.code - 144)) << 1) + 144 + input.getBits(1));
-						parent->output.addByte(full);
-					}
-				}
-			}
-			return (parent->output.available() == 0);
-		}
-	};
+	void addBits(uint64_t value, int size) { // More than 16 bits is actually not supported (there is no use case for more)
+		data += value << filled;
+		filled += size;
+		emptyIfNeeded();
+	}
 
-	struct DynamicCodeState : CopyState {
-		BitReader input;
-		EncodedTable<288> codes;
-		EncodedTable<31> distanceCode;
+	void addBitsAndCrop(uint64_t value, int size) { // More than 16 bits is actually not supported (there is no use case for more)
+		data += (value & upperRemovals[size]) << filled;
+		filled += size;
+		emptyIfNeeded();
+	}
+};
 
-		DynamicCodeState(decltype(input)&& inputMoved, int codeCount, int distanceCodeCount, const std::array<uint8_t, 256>& codeCodingLookup,
-						const std::array<uint8_t, codeCodingReorder.size()>& codeCodingLengths)
-			: input(std::move(inputMoved))
-			, codes(input, codeCount, codeCodingLookup, codeCodingLengths)
-			, distanceCode(input, distanceCodeCount, codeCodingLookup, codeCodingLengths)
-		{ }
+constexpr int maximumHuffmanCodeLength = 15;
 
-		bool parseSome(DeflateReader* parent) {
-			if (CopyState::copyLength > 0) { // Resume copying if necessary
-				if (CopyState::restart(parent->output)) {
-					return true; // Out of space
-				}
+// Reads the lengths of Huffman codes, which are themselves Huffman-encoded (the repetition codes may span across tables that are read together)
+template <int MaxSize>
+std::array<uint8_t, MaxSize> readCodeLengths(BitReader& reader, int realSize, const std::array<uint8_t, 256>& codeCodingLookup,
+			const std::array<uint8_t, codeCodingReorder.size()>& codeCodingLengths) {
+	if (realSize > MaxSize) [[unlikely]]
+		throw std::runtime_error("Too many Huffman codes");
+	std::array<uint8_t, MaxSize> lengths = {};
+	for (int i = 0; i < realSize; ) {
+		int length = 0;
+		reader.peekAByteAndConsumeSome([&] (uint8_t peeked) {
+			length = codeCodingLookup[peeked];
+			return codeCodingLengths[length];
+		});
+		if (length < 16) {
+			lengths[i] = uint8_t(length);
+			i++;
+		} else {
+			int copy = 0;
+			uint8_t copied = 0;
+			if (length == 16) {
+				if (i == 0) [[unlikely]]
+					throw std::runtime_error("Invalid lookback position");
+				copy = reader.getBits(2) + 3;
+				copied = lengths[i - 1];
+			} else if (length == 17) {
+				copy = reader.getBits(3) + 3;
+			} else {
+				copy = reader.getBits(7) + 11;
 			}
-			while (parent->output.available()) {
-				int word = codes.readWord();
-				if (word < 256) {
-					parent->output.addByte(char(word));
-				} else if (word == 256) [[unlikely]] {
-					break;
-				} else {
-					int length = word - 254;
-					if (length > 10) {
-						length = input.parseLongerSize(length);
-					}
-					int distance = distanceCode.readWord() + 1;
-					if (distance > 4) {
-						distance = input.parseLongerDistance(distance);
-					}
-					CopyState::copy(parent->output, length, distance);
-				}
+			for (int j = i; j < std::min(i + copy, realSize); j++) { // Repetitions past the end are ignored
+				lengths[j] = copied;
 			}
-			return (parent->output.available() == 0);
+			i += copy;
 		}
-	};
+	}
+	return lengths;
+}
 
-	std::variant<std::monostate, LiteralState, FixedCodeState, DynamicCodeState> decodingState = {};
-	bool wasLast = false;
+// Represents a table encoding Huffman codewords and can parse the stream by bits
+template <int MaxSize>
+class EncodedTable {
+	BitReader& reader;
+	struct CodeIndexEntry {
+		int16_t word = 0;
+		int8_t length = 0;
+		bool valid = false;
+	};
+	std::array<CodeIndexEntry, 256> codesIndex = {}; // If value is greater than MaxSize, it's a remainder at index value minus MaxSize
+	struct CodeRemainder {
+		uint8_t remainder = 0;
+		uint8_t bitsLeft = 0;
+		uint16_t index = 0; // bit or with 0x8000 if it's the last one in sequence
+	};
+	std::array<CodeRemainder, MaxSize> remainders = {};
+	uint16_t endOfBlockCode = 0; // The whole code of word 256, reversed so that it can be compared with peeked bits
+	int8_t endOfBlockLength = 0;
 
 public:
-	DeflateReader(decltype(input)& input, decltype(output)& output) : input(input), output(output) {}
+	EncodedTable(BitReader& reader, int realSize, std::array<uint8_t, 256> codeCodingLookup, std::array<uint8_t, codeCodingReorder.size()> codeCodingLengths)
+	: EncodedTable(reader, std::span<const uint8_t>(readCodeLengths<MaxSize>(reader, realSize, codeCodingLookup, codeCodingLengths).data(), realSize)) {}
 
-	// Returns whether there is more work to do
-	bool parseSome() {
-		while (true) {
-			BitReader bitInput(nullptr);
-			if (LiteralState* literalState = std::get_if<LiteralState>(&decodingState)) {
-				if (literalState->parseSome(this)) {
-					return true;
-				}
-				bitInput = decltype(bitInput)(&input);
-			} else if (FixedCodeState* fixedState = std::get_if<FixedCodeState>(&decodingState)) {
-				if (fixedState->parseSome(this)) {
-					return true;
-				}
-				bitInput = std::move(fixedState->input);
-			} else if (DynamicCodeState* dynamicState = std::get_if<DynamicCodeState>(&decodingState)) {
-				if (dynamicState->parseSome(this)) {
-					return true;
+	EncodedTable(BitReader& reader, std::span<const uint8_t> lengths)
+	: reader(reader) {
+		const int realSize = int(lengths.size());
+		std::array<int, 17> quantities = {};
+		struct CodeEntry {
+			uint8_t start = 0;
+			uint8_t ending = 0;
+			uint8_t length = 0;
+		};
+		std::array<CodeEntry, MaxSize> codes = {};
+		for (int i = 0; i < realSize; i++) {
+			codes[i].length = lengths[i];
+			quantities[lengths[i]]++;
+		}
+
+		struct UnindexedEntry {
+			int quantity = 0;
+			int startIndex = 0;
+			int filled = 0;
+		};
+		std::array<UnindexedEntry, 256> unindexedEntries = {};
+
+		// Generate the codes
+		int nextCode = 0;
+		for (int size = 1; size <= 16; size++) {
+			if (quantities[size] > 0) {
+				for (int i = 0; i < realSize; i++) {
+					if (codes[i].length == size) {
+						if (nextCode >= (1 << size)) [[unlikely]]
+								throw std::runtime_error("Bad Huffman encoding, run out of Huffman codes");
+						if (i == 256) {
+							endOfBlockCode = uint16_t(((reversedBytes[nextCode & 0xff] << 8) | reversedBytes[nextCode >> 8]) >> (16 - size));
+							endOfBlockLength = int8_t(size);
+						}
+						uint8_t firstPart = uint8_t(nextCode);
+						if (size <= 8) [[likely]] {
+							codes[i].start = reversedBytes[firstPart];
+							for (int code = codes[i].start >> (8 - size); code < std::ssize(codesIndex); code += (1 << size)) {
+								codesIndex[code].word = int16_t(i);
+								codesIndex[code].length = int8_t(size);
+								codesIndex[code].valid = true;
+							}
+						} else {
+							uint8_t start = reversedBytes[uint8_t(nextCode >> (size - 8))];
+							codes[i].start = start;
+							codesIndex[start].valid = true;
+							unindexedEntries[start].quantity++;
+							codes[i].ending = reversedBytes[uint8_t(nextCode)] >> (16 - size);
+						}
+						nextCode++;
+					}
 				}
-				bitInput = std::move(dynamicState->input);
-			} else {
-				bitInput = decltype(bitInput)(&input);
 			}
-			decodingState = std::monostate();
+			nextCode <<= 1;
+		}
 
-			// No decoding state
-			if (wasLast) {
-				output.done();
-				return false;
-			}
-			wasLast = bitInput.getBits(1);
-			int compressionType = bitInput.getBits(2);
-			if (compressionType == 0b00) {
-				BitReader(std::move(bitInput)); // Move it to a temporary and destroy it
-				decodingState.template emplace<LiteralState>(this);
-			} else if (compressionType == 0b01) {
-				decodingState.template emplace<FixedCodeState>(std::move(bitInput));
-			} else if (compressionType == 0b10) {
-				// Read lengths
-				const int extraCodes = bitInput.getBits(5); // Will be used later
-				constexpr int maximumExtraCodes = 29;
-				if (extraCodes > maximumExtraCodes) [[unlikely]] {
-					throw std::runtime_error("Impossible number of extra codes");
-				}
-				const int distanceCodes = bitInput.getBits(5) + 1; // Will be used later
-				if (distanceCodes > 31) [[unlikely]] {
-					throw std::runtime_error("Impossible number of distance codes");
-				}
-				const int codeLengthCount = bitInput.getBits(4) + 4;
-				if (codeLengthCount > 19) [[unlikely]]
-						throw std::runtime_error("Invalid distance code count");
+		// Calculate ranges of the longer parts
+		int currentStartIndex = 0;
+		for (auto& entry : unindexedEntries) {
+			entry.startIndex = currentStartIndex;
+			currentStartIndex += entry.quantity;
+		}
 
-				// Read Huffman code lengths
-				std::array<uint8_t, codeCodingReorder.size()> codeCodingLengths = {};
-				for (int i = 0; i < codeLengthCount; i++) {
-					codeCodingLengths[codeCodingReorder[i]] = uint8_t(bitInput.getBits(3));
-				}
+		// Index the longer parts
+		for (int i = 0; i < std::ssize(codes); i++) {
+			CodeEntry& code = codes[i];
+			if (code.length > 8) {
+				UnindexedEntry& unindexedEntry = unindexedEntries[code.start];
+				CodeRemainder& remainder = remainders[unindexedEntry.startIndex + unindexedEntry.filled];
+				codesIndex[code.start].word = int16_t(MaxSize + unindexedEntry.startIndex);
+				unindexedEntry.filled++;
+				remainder.remainder = code.ending; // The upper bits are cut
+				remainder.bitsLeft = code.length - 8;
+				remainder.index = uint16_t(i);
+				if (unindexedEntry.filled == unindexedEntry.quantity)
+					remainder.index |= 0x8000;
+			}
+		}
+	}
 
-				// Generate Huffman codes for lengths
-				std::array<int, codeCodingReorder.size()> codeCoding = {};
-				std::array<uint8_t, 256> codeCodingLookup = {};
-				int nextCodeCoding = 0;
-				for (int size = 1; size <= 8; size++) {
-					for (int i = 0; i < std::ssize(codeCoding); i++)
-						if (codeCodingLengths[i] == size) {
+	int readWord() {
+		int word = 0;
+		reader.peekAByteAndConsumeSome([&] (uint8_t peeked) {
+			const CodeIndexEntry entry = codesIndex[peeked];
+			word = entry.word;
+			if (word >= MaxSize) {
+				return 8;
+			} else if (!entry.valid) {
+				throw std::runtime_error("Unknown Huffman code (not even first 8 bits)");
+			}
+			return int(entry.length);
+		});
 
-							for (int code = nextCodeCoding << (8 - size); code < (nextCodeCoding + 1) << (8 - size); code++) {
-								codeCodingLookup[reversedBytes[code]] = uint8_t(i);
-							}
-							codeCoding[i] = reversedBytes[nextCodeCoding];
+		// Longer codes than a byte are indexed specially
+		static constexpr std::array<uint8_t, 9> endMasks = { 0x00, 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff };
+		if (word >= MaxSize) {
+			reader.peekAByteAndConsumeSome([&] (uint8_t peeked) {
+				for (int i = word - MaxSize; i < MaxSize * 2; i++) {
+					if ((peeked & endMasks[remainders[i].bitsLeft]) == remainders[i].remainder) {
+						word = remainders[i].index & 0x7fff;
+						return remainders[i].bitsLeft;
+					}
 
-							nextCodeCoding++;
-						}
-					nextCodeCoding <<= 1;
+					if (remainders[i].index & 0x8000) {
+						throw std::runtime_error("Unknown Huffman code (ending bits don't fit)");
+					}
 				}
-
-				decodingState.template emplace<DynamicCodeState>(std::move(bitInput), 257 + extraCodes, distanceCodes, codeCodingLookup, codeCodingLengths);
-			} else {
-				throw std::runtime_error("Unknown type of block compression");
-			}
+				throw std::runtime_error("Unknown Huffman code (bad prefix)");
+			});
 		}
+		return word;
+	}
+
+	// Consumes the end of block code if it's next, at least 16 bits must be loaded in the reader
+	bool skipEndOfBlockIfNext() {
+		if (endOfBlockLength == 0 || (reader.peekBits() & ((1u << endOfBlockLength) - 1)) != endOfBlockCode)
+			return false;
+		reader.consumeBits(endOfBlockLength);
+		return true;
 	}
 };
 
-template <StreamSettings OutputSettings, StreamSettings DeduplicatedSettings, int BlockSize = 1000000>
-class HuffmanWriter {
-	ByteOutput<OutputSettings, NoChecksum>& byteOutput;
-	std::optional<BitOutput<OutputSettings, NoChecksum>> bitOutput;
+// Bits of a code are read in reverse order, so the code needs to be reversed to be used as an index
+constexpr uint16_t reverseBits(uint16_t code, int length) {
+	return uint16_t(((reversedBytes[code & 0xff] << 8) | reversedBytes[code >> 8]) >> (16 - length));
+}
 
-	template <int Size>
-	struct HuffmanTable {
-		struct Entry {
-			uint16_t code;
-			uint8_t length;
+// What a Huffman code decodes into, the final value is the base plus the number in the extra bits that follow the code
+struct DecodedSymbol {
+	uint16_t base;
+	uint8_t extraBits;
+	bool valid = true;
+};
 
-			Entry() = default;
-			Entry(uint16_t codeUnreversed, uint8_t length) : length(length) {
-				if (length <= 8) {
-					code = reversedBytes[codeUnreversed] >> (8 - length);
-				} else {
-					code = (reversedBytes[codeUnreversed >> 8] >> (16 - length)) | (reversedBytes[codeUnreversed & 0xff] << (length - 8));
-				}
+constexpr int endOfBlockWord = 256;
+constexpr int copyLengthWordOffset = 256; // Added to base copy length in the decoded value to tell it apart from literals and end of block
+
+static constexpr std::array<DecodedSymbol, 288> literalAndLengthSymbols = ArrayFiller([] (int symbol) constexpr {
+	constexpr std::array<uint16_t, 29> lengthBases = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+	if (symbol <= endOfBlockWord)
+		return DecodedSymbol{uint16_t(symbol), 0};
+	int lengthSymbol = symbol - endOfBlockWord - 1;
+	if (lengthSymbol >= int(lengthBases.size()))
+		return DecodedSymbol{0, 0, false};
+	int extraBits = (lengthSymbol < 8 || lengthSymbol == 28) ? 0 : (lengthSymbol >> 2) - 1;
+	return DecodedSymbol{uint16_t(copyLengthWordOffset + lengthBases[lengthSymbol]), uint8_t(extraBits)};
+});
+
+static constexpr std::array<DecodedSymbol, 32> distanceSymbols = ArrayFiller([] (int symbol) constexpr {
+	if (symbol >= int(distanceOffsets.size()))
+		return DecodedSymbol{0, 0, false};
+	return DecodedSymbol{uint16_t(distanceOffsets[symbol]), uint8_t(symbol < 4 ? 0 : (symbol >> 1) - 1)};
+});
+
+// Represents a table encoding Huffman codewords, any code up to RootBits bits long is decoded with a single lookup, longer ones need one more lookup in a subtable
+template <int MaxSize, int RootBits,
+		int Capacity = (1 << RootBits) + ((RootBits < maximumHuffmanCodeLength) ? ((MaxSize / (maximumHuffmanCodeLength + 1 - RootBits) + 1) << (maximumHuffmanCodeLength - RootBits)) : 0)>
+class HuffmanDecodingTable {
+	static_assert(RootBits > 0 && RootBits <= maximumHuffmanCodeLength);
+	static_assert(Capacity >= (1 << RootBits));
+
+public:
+	struct Entry {
+		uint16_t word; // Decoded word (base of the value if extra bits follow) or index of the first entry of the subtable
+		uint8_t length; // Length of the code, zero if there is no such code
+		uint8_t extraBits; // Number of bits following the code that are added to the word, or subtableFlag and the number of bits indexing the subtable
+	};
+	constexpr static uint8_t subtableFlag = 0x80;
+
+private:
+	// Capacity suffices for any complete code, because a subtable indexed by N bits needs at least N + 1 codes
+	std::array<Entry, Capacity> entries;
+
+public:
+	constexpr HuffmanDecodingTable(const std::array<Entry, Capacity>& entries) : entries(entries) {}
+
+	// Without symbols, the decoded words are the indexes of the codes
+	HuffmanDecodingTable(std::span<const uint8_t> lengths, const DecodedSymbol* symbols = nullptr) {
+		if (std::ssize(lengths) > MaxSize) [[unlikely]]
+			throw std::runtime_error("Too many Huffman codes");
+		std::array<int, maximumHuffmanCodeLength + 1> quantities = {};
+		for (uint8_t length : lengths) {
+			quantities[length]++;
+		}
+		quantities[0] = 0;
+
+		// The first code of each length, as in the specification
+		std::array<int, maximumHuffmanCodeLength + 1> nextCodes = {};
+		int unusedCodes = 1;
+		for (int size = 1; size <= maximumHuffmanCodeLength; size++) {
+			unusedCodes = (unusedCodes << 1) - quantities[size];
+			if (unusedCodes < 0) [[unlikely]]
+				throw std::runtime_error("Bad Huffman encoding, run out of Huffman codes");
+			nextCodes[size] = (nextCodes[size - 1] + quantities[size - 1]) << 1;
+		}
+
+		// Assign the codes and find how long the subtables must be
+		std::array<uint16_t, MaxSize> reversedCodes = {};
+		std::array<uint8_t, (1 << RootBits)> subtableLengths = {};
+		for (int i = 0; i < std::ssize(lengths); i++) {
+			int length = lengths[i];
+			if (length == 0)
+				continue;
+			reversedCodes[i] = reverseBits(uint16_t(nextCodes[length]), length);
+			nextCodes[length]++;
+			if (length > RootBits) {
+				uint8_t& subtableLength = subtableLengths[reversedCodes[i] & upperRemovals[RootBits]];
+				subtableLength = std::max(subtableLength, uint8_t(length - RootBits));
 			}
-		};
-		std::array<Entry, Size> codes = {};
+		}
 
-		HuffmanTable() = default;
-		struct UseDefaultLengthEncoding {};
-		constexpr HuffmanTable(UseDefaultLengthEncoding) : codes(ArrayFiller([] (int index) {
-			if (index <= 143) {
-				return Entry(uint16_t(index + 0b00110000), 8);
-			} else if (index <= 255) {
-				return Entry(uint16_t(index - 144 + 0b110010000), 9);
-			} else if (index == 256) {
-				return Entry(0, 7);
-			} else if (index < 279) {
-				return Entry(uint16_t(index - 256), 7);
+		// Place the subtables after the root table
+		std::fill_n(entries.begin(), 1 << RootBits, Entry{0, 0, 0});
+		int subtableStart = 1 << RootBits;
+		for (int i = 0; i < std::ssize(subtableLengths); i++) {
+			if (subtableLengths[i] > 0) {
+				int subtableSize = 1 << subtableLengths[i];
+				if (subtableStart + subtableSize > Capacity) [[unlikely]]
+					throw std::runtime_error("Bad Huffman encoding, too many long codes");
+				entries[i] = Entry{uint16_t(subtableStart), uint8_t(RootBits), uint8_t(subtableFlag | subtableLengths[i])};
+				std::fill_n(entries.begin() + subtableStart, subtableSize, Entry{0, 0, 0});
+				subtableStart += subtableSize;
+			}
+		}
+
+		// Fill the tables, every code fills all entries whose index starts with it
+		for (int i = 0; i < std::ssize(lengths); i++) {
+			int length = lengths[i];
+			if (length == 0) {
+				continue;
+			}
+			Entry entry = {uint16_t(i), uint8_t(length), 0};
+			if (symbols) {
+				if (!symbols[i].valid)
+					continue; // Codes that must not appear are left unknown
+				entry.word = symbols[i].base;
+				entry.extraBits = symbols[i].extraBits;
+			}
+			if (length <= RootBits) {
+				for (int index = reversedCodes[i]; index < (1 << RootBits); index += (1 << length)) {
+					entries[index] = entry;
+				}
 			} else {
-				return Entry(uint16_t(index - 280 + 0b11000000), 8);
+				const Entry& subtable = entries[reversedCodes[i] & upperRemovals[RootBits]];
+				int subtableBits = subtable.extraBits & ~subtableFlag;
+				for (int index = reversedCodes[i] >> RootBits; index < (1 << subtableBits); index += (1 << (length - RootBits))) {
+					entries[subtable.word + index] = entry;
+				}
 			}
-		})) {}
-		struct UseDefaultDistanceEncoding {};
-		constexpr HuffmanTable(UseDefaultDistanceEncoding) : codes(ArrayFiller([] (int index) {
-			return Entry(uint16_t(29 - index), 5);
-		})) {}
+		}
+	}
 
+	// Finds the entry of the code at the start of the bits, its length must be checked against the number of bits available
+	Entry lookup(uint64_t bits) const {
+		Entry entry = entries[bits & upperRemovals[RootBits]];
+		if (entry.extraBits & subtableFlag) [[unlikely]] {
+			entry = entries[entry.word + ((bits >> RootBits) & upperRemovals[entry.extraBits & ~subtableFlag])];
+		}
+		if (entry.length == 0) [[unlikely]] {
+			throw std::runtime_error("Unknown Huffman code");
+		}
+		return entry;
+	}
 
-		template <typename Applied>
-		void runThroughCodeEncoding(int endAt, int increment, const Applied& applied) const {
-			int previousLength = 0;
-			int previousLengthRepeats = 0;
-			auto doneRepeating = [&] {
-				bool repeatAgain = false;
-				do {
-					repeatAgain = false;
-					if (previousLengthRepeats == 1) {
+	// Reads only the code, ignoring extra bits
+	int readWord(BitReader& reader) const {
+		int word = 0;
+		reader.peekAndConsumeSome<maximumHuffmanCodeLength>([&] (uint16_t peeked) {
+			Entry entry = lookup(peeked);
+			word = entry.word;
+			return int(entry.length);
+		});
+		return word;
+	}
+};
+
+// Tables for blocks compressed with fixed codes, all codes fit into the root tables
+using FixedCodeTable = HuffmanDecodingTable<288, 9, (1 << 9)>;
+using FixedDistanceTable = HuffmanDecodingTable<32, 5, (1 << 5)>;
+
+static constexpr FixedCodeTable fixedCodeTable = std::array<FixedCodeTable::Entry, (1 << 9)>(ArrayFiller([] (int index) constexpr {
+	// Codes 0000000 to 0010111 are 256 to 279, 00110000 to 10111111 are 0 to 143, 11000000 to 11000111 are 280 to 287, 110010000 to 111111111 are 144 to 255
+	int symbol = 0;
+	int length = 0;
+	if (int code = reverseBits(uint16_t(index & 0x7f), 7); code < 0b0011000) {
+		symbol = code + 256;
+		length = 7;
+	} else if (code = reverseBits(uint16_t(index & 0xff), 8); code < 0b11000000) {
+		symbol = code - 0b00110000;
+		length = 8;
+	} else if (code < 0b11001000) {
+		symbol = code - 0b11000000 + 280;
+		length = 8;
+	} else {
+		symbol = reverseBits(uint16_t(index), 9) - 0b110010000 + 144;
+		length = 9;
+	}
+	const DecodedSymbol& decoded = literalAndLengthSymbols[symbol];
+	if (!decoded.valid)
+		return FixedCodeTable::Entry{0, 0, 0};
+	return FixedCodeTable::Entry{decoded.base, uint8_t(length), decoded.extraBits};
+}));
+
+static constexpr FixedDistanceTable fixedDistanceTable = std::array<FixedDistanceTable::Entry, (1 << 5)>(ArrayFiller([] (int index) constexpr {
+	const DecodedSymbol& decoded = distanceSymbols[reverseBits(uint16_t(index), 5)];
+	if (!decoded.valid)
+		return FixedDistanceTable::Entry{0, 0, 0};
+	return FixedDistanceTable::Entry{decoded.base, 5, decoded.extraBits};
+}));
+
+template <int MaxTableSize>
+auto ByteInput::encodedTable(int realSize, const std::array<uint8_t, 256>& codeCodingLookup, const std::array<uint8_t, codeCodingReorder.size()>& codeCodingLengths) {
+	return EncodedTable<MaxTableSize>(*this, realSize, codeCodingLookup, codeCodingLengths);
+}
+
+struct RepetitionChecker {
+	virtual bool checkIfStillValid(ptrdiff_t oldPosition, ptrdiff_t currentPosition) = 0;
+	virtual int getMatchLength(ptrdiff_t oldPosition, ptrdiff_t currentPosition, int alreadyVerified = 0) = 0;
+	virtual ~RepetitionChecker() = default;
+};
+
+#if EZGZ_HAS_CONCEPTS
+template <typename Index>
+concept DeduplicatingSearch = requires(Index index, RepetitionChecker& repetitionChecker, ptrdiff_t position, int distance, int length, uint64_t sequence, int offset) {
+	Index(repetitionChecker);
+	std::tie(distance, length) = index.indexValueAndLocateBestMatch(position, sequence);
+	index.indexValue(position, sequence);
+};
+
+template <typename T>
+concept Deduplicator = requires(T deduplicator, ByteInput& input, IDeduplicatedStream& output) {
+	T(input, output);
+	deduplicator.deduplicateSome();
+};
+#else
+#define DeduplicatingSearch typename
+#define Deduplicator typename
+#endif
+
+struct LastRepetitionEntry {
+	struct Repository{};
+	ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
+	uint64_t sequence = 0;
+	void indexValue(Repository&, uint64_t newSequence, ptrdiff_t position) {
+		location = position;
+		sequence = newSequence;
+	}
+	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository& repository, uint64_t newSequence, ptrdiff_t position) {
+		uint64_t mismatch = sequence ^ newSequence;
+		int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
+		ptrdiff_t oldLocation = location;
+		matchLength /= 8;
+		indexValue(repository, newSequence, position);
+		if (!repetitionChecker.checkIfStillValid(oldLocation, position)) {
+			return {0, oldLocation};
+		}
+		return {matchLength, oldLocation};
+	}
+};
+
+template <int HistorySize = 2>
+struct StatelessRepetitionCircularBuffer {
+	struct RepetitionEntry {
+		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
+		uint64_t sequence = 0;
+	};
+	struct Repository{};
+	std::array<RepetitionEntry, HistorySize> repetitions = {};
+	void indexValue(Repository&, uint64_t sequence, ptrdiff_t position) {
+		int oldest = 0;
+		ptrdiff_t oldestEntry = std::numeric_limits<ptrdiff_t>::max();
+		for (int i = 0; i < std::ssize(repetitions); i++) {
+			if (repetitions[i].location < oldestEntry) {
+				oldest = i;
+				oldestEntry = repetitions[i].location;
+			}
+		}
+		repetitions[oldest].location = position;
+		repetitions[oldest].sequence = sequence;
+	}
+	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository&, uint64_t sequence, ptrdiff_t position) {
+		int oldest = 0;
+		ptrdiff_t oldestEntry = std::numeric_limits<ptrdiff_t>::max();
+		int bestMatch = 0;
+		ptrdiff_t bestMatchLocation = 0;
+		for (int i = 0; i < std::ssize(repetitions); i++) {
+			if (repetitions[i].location < oldestEntry) {
+				oldest = i;
+				oldestEntry = repetitions[i].location;
+			}
+			if (!repetitionChecker.checkIfStillValid(repetitions[i].location, position)) {
+				continue;
+			}
+			uint64_t mismatch = repetitions[i].sequence ^ sequence;
+			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
+			matchLength /= 8;
+			if (matchLength == 8) {
+				matchLength = repetitionChecker.getMatchLength(repetitions[i].location, position, 8);
+			}
+			if (matchLength > bestMatch) {
+				bestMatch = matchLength;
+				bestMatchLocation = repetitions[i].location;
+			}
+		}
+		repetitions[oldest].location = position;
+		repetitions[oldest].sequence = sequence;
+		return {bestMatch, bestMatchLocation};
+	}
+};
+
+template <int HistorySize = 5>
+struct RepetitionCircularBuffer {
+	struct RepetitionEntry {
+		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
+		uint64_t sequence = 0;
+	};
+	struct Repository{};
+	std::array<RepetitionEntry, HistorySize> repetitions = {};
+	int lastEntry = 0;
+	void indexValue(Repository&, uint64_t sequence, ptrdiff_t position) {
+		lastEntry++;
+		lastEntry = (lastEntry == std::ssize(repetitions)) ? 0 : lastEntry;
+		repetitions[lastEntry].location = position;
+		repetitions[lastEntry].sequence = sequence;
+	}
+	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository&, uint64_t sequence, ptrdiff_t position) {
+		int bestMatch = 0;
+		ptrdiff_t bestMatchLocation = 0;
+		for (int i = 0; i < std::ssize(repetitions); i++) {
+			if (!repetitionChecker.checkIfStillValid(repetitions[i].location, position)) {
+				continue;
+			}
+			uint64_t mismatch = repetitions[i].sequence ^ sequence;
+			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
+			matchLength /= 8;
+			if (matchLength == 8) {
+				matchLength = repetitionChecker.getMatchLength(repetitions[i].location, position, 8);
+			}
+			if (matchLength > bestMatch) {
+				bestMatch = matchLength;
+				bestMatchLocation = repetitions[i].location;
+			}
+		}
+		lastEntry++;
+		lastEntry = (lastEntry == std::ssize(repetitions)) ? 0 : lastEntry;
+		repetitions[lastEntry].location = position;
+		repetitions[lastEntry].sequence = sequence;
+		return {bestMatch, bestMatchLocation};
+	}
+};
+
+struct QueueHistoryBuffer {
+	struct RepetitionEntry {
+		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
+		uint64_t sequence = 0;
+	};
+	struct Repository{};
+	std::deque<RepetitionEntry> repetitions = {};
+	void indexValue(Repository&, uint64_t sequence, ptrdiff_t position) {
+		repetitions.emplace_back(RepetitionEntry{position, sequence});
+	}
+	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository& repository, uint64_t sequence, ptrdiff_t position) {
+		while (!repetitions.empty() && !repetitionChecker.checkIfStillValid(repetitions.front().location, position)) {
+			repetitions.pop_front();
+		}
+		int bestMatch = 0;
+		ptrdiff_t bestMatchLocation = 0;
+		for (const RepetitionEntry& it : repetitions) {
+			uint64_t mismatch = it.sequence ^ sequence;
+			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
+			matchLength /= 8;
+			if (matchLength == 8) {
+				matchLength = repetitionChecker.getMatchLength(it.location, position, 8);
+			}
+			if (matchLength > bestMatch) {
+				bestMatch = matchLength;
+				bestMatchLocation = it.location;
+			}
+		}
+		indexValue(repository, sequence, position);
+		return {bestMatch, bestMatchLocation};
+	}
+};
+
+template <int MaxIterations = maximumCopyDistance, int QueueSize = maximumCopyDistance>
+struct CircularQueueHistoryBuffer {
+	struct RepetitionEntry {
+		ptrdiff_t location = std::numeric_limits<ptrdiff_t>::min();
+		uint64_t sequence = 0;
+		int nextIndex = QueueSize;
+	};
+	struct Repository {
+		int nextIndex = 0;
+		std::array<RepetitionEntry, QueueSize + 1> entries = {}; // Last element is never assigned and always discarded because of bad address
+	};
+	RepetitionEntry last = {};
+	void indexValue(Repository& repository, uint64_t sequence, ptrdiff_t position) {
+		repository.entries[repository.nextIndex] = last;
+		last.nextIndex = repository.nextIndex;
+		last.sequence = sequence;
+		last.location = position;
+		repository.nextIndex = (repository.nextIndex + 1) % QueueSize; // TODO: Check if this is done through a bitmask
+	}
+	std::pair<int, ptrdiff_t> indexValueAndLocateBestMatch(RepetitionChecker& repetitionChecker, Repository& repository, uint64_t sequence, ptrdiff_t position) {
+		if (!repetitionChecker.checkIfStillValid(last.location, position)) {
+			last.nextIndex = QueueSize;
+			last.sequence = sequence;
+			last.location = position;
+			return {0, 0};
+		}
+		int bestMatch = 0;
+		ptrdiff_t bestMatchLocation = 0;
+		auto checkIfBest = [&] (const RepetitionEntry& entry) {
+			uint64_t mismatch = entry.sequence ^ sequence;
+			int matchLength = (!IsBigEndian) ? std::countr_zero(mismatch) : std::countl_zero(mismatch);
+			matchLength /= 8;
+			if (matchLength == 8) {
+				matchLength = repetitionChecker.getMatchLength(entry.location, position, 8);
+			}
+			if (matchLength > bestMatch) {
+				bestMatch = matchLength;
+				bestMatchLocation = entry.location;
+			}
+		};
+		checkIfBest(last);
+		int iterations = 0;
+		ptrdiff_t lastPosition = std::numeric_limits<ptrdiff_t>::max();
+		for (int index = last.nextIndex; repetitionChecker.checkIfStillValid(repository.entries[index].location, position); index = repository.entries[index].nextIndex) {
+			checkIfBest(repository.entries[index]);
+			if constexpr(QueueSize != maximumCopyDistance) {
+				if (lastPosition <= repository.entries[index].location) {
+					break;
+				}
+				lastPosition = repository.entries[index].location;
+			}
+			if constexpr(MaxIterations < maximumCopyDistance) {
+				iterations++;
+				if (iterations >= MaxIterations) {
+					break;
+				}
+			}
+			if (bestMatch == maximumCopyLength) {
+				break;
+			}
+		}
+		indexValue(repository, sequence, position);
+		return {bestMatch, bestMatchLocation};
+	}
+};
+
+template <typename Entry, int Bits = 16>
+class PrefixBasedDuplicationIndex {
+	constexpr static int IndexSize = 1u << Bits;
+
+	std::array<Entry, IndexSize> index = {};
+	RepetitionChecker& repetitionChecker;
+	typename Entry::Repository repository = {};
+
+	Entry& getEntry(uint64_t sequence) {
+		constexpr uint64_t Mask = (!IsBigEndian) ? ~(0xffffffffffffffff << Bits) : ~(0xffffffffffffffff >> Bits);
+		uint64_t prefix = (!IsBigEndian) ? sequence & Mask : (sequence & Mask) >> (64 - Bits);
+		static_assert((!IsBigEndian) ? (~(0xffffffffffffffff << Bits) < IndexSize) : (0xffffffffffffffff >> (64 - Bits) < IndexSize));
+		return index[prefix];
+	}
+
+public:
+	PrefixBasedDuplicationIndex(RepetitionChecker& repetitionChecker) : repetitionChecker(repetitionChecker) {}
+
+	void indexValue(ptrdiff_t position, uint64_t sequence) {
+		getEntry(sequence).indexValue(repository, sequence, position);
+	}
+
+	std::pair<ptrdiff_t, int> indexValueAndLocateBestMatch(ptrdiff_t position, uint64_t sequence) {
+		Entry& selected = getEntry(sequence);
+		auto [bestMatch, bestMatchLocation] = selected.indexValueAndLocateBestMatch(repetitionChecker, repository, sequence, position);
+
+		if (bestMatch > 4) { // Everything in the sequence matches
+			return {bestMatchLocation, bestMatch};
+		} else if (bestMatch >= 3) { // 3 bytes are enough to write a duplication
+			return {bestMatchLocation, bestMatch};
+		} else { // No match
+			return {position, 0};
+		}
+	}
+};
+
+class DeduplicatorBase : protected RepetitionChecker {
+protected:
+	ptrdiff_t positionStart = 0;
+	ByteInput& input;
+
+	bool checkIfStillValid(ptrdiff_t oldPosition, ptrdiff_t currentPosition) override {
+		return (currentPosition <= oldPosition + maximumCopyDistance && positionStart <= oldPosition);
+	}
+	int getMatchLength(ptrdiff_t oldPosition, ptrdiff_t currentPosition, int alreadyVerified) override {
+		for ( ; alreadyVerified < maximumCopyLength; alreadyVerified++) { // TODO: Don't go past end
+			if (input.getAtPosition(oldPosition - positionStart + alreadyVerified) != input.getAtPosition(currentPosition - positionStart + alreadyVerified)) {
+				return alreadyVerified;
+			}
+		}
+		return alreadyVerified;
+	}
+	DeduplicatorBase(ByteInput& input) : input(input) { }
+};
+
+enum DeduplicationFlags : uint32_t {
+	NO_DUPLICATION_FLAGS = 0x0,
+	INDEX_DUPLICATES = 0x1,
+	INCLUDE_SMALL_DUPLICATES = 0x2,
+};
+
+template <DeduplicatingSearch DuplicationIndex, DeduplicationFlags deduplicationFlags>
+class EagerDeduplicator : private DeduplicatorBase {
+	IDeduplicatedStream& output;
+	DuplicationIndex search = {*this};
+
+public:
+	EagerDeduplicator(ByteInput& input, IDeduplicatedStream& output) : DeduplicatorBase(input), output(output) {
+		input.setInvalidationNotification([this] (int offset) {
+			positionStart += offset;
+		});
+	}
+
+	void deduplicateSome() {
+		do {
+			uint64_t sequence = input.getEightBytesFromCurrentPosition();
+			int position = input.getPosition() - 1;
+			int location = 0;
+			int matchLength = 0;
+			std::tie(location, matchLength) = search.indexValueAndLocateBestMatch(position + positionStart, sequence);
+			location -= positionStart;
+			matchLength = std::min(matchLength, input.availableAhead());
+			int distance = position - location;
+
+			if constexpr(deduplicationFlags & INCLUDE_SMALL_DUPLICATES) {
+				if (matchLength == 3 && distance > 64) {
+					matchLength = 0; // Turns out this is not worth the 5 extra bits of distance encoding
+				}
+			}
+			if (matchLength >= 3) {
+				if constexpr(deduplicationFlags & INDEX_DUPLICATES) {
+					if (matchLength >= 3) {
+						for (ptrdiff_t indexingAt = position + 1; indexingAt < position + matchLength - 1; indexingAt++) {
+							search.indexValue(indexingAt + positionStart, input.getEightBytesAtPosition(indexingAt));
+						}
+					}
+				}
+				if (distance < 0) {
+					throw std::runtime_error("We screwed up");
+				}
+				output.addDuplication(matchLength, distance);
+				input.advancePosition(matchLength - 1);
+			} else {
+				output.addByte(input.getAtPosition(position));
+			}
+		} while (input.hasMoreDataInBuffer());
+	}
+
+	// Only indexes the data before the given position, so that the data after it can refer to them
+	void indexUntil(ptrdiff_t until) {
+		while (input.getPosition() + positionStart < until) {
+			uint64_t sequence = input.getEightBytesFromCurrentPosition();
+			search.indexValue(input.getPosition() - 1 + positionStart, sequence);
+		}
+	}
+
+	void flush() {}
+};
+
+template <DeduplicatingSearch DuplicationIndex, int MaxSize, DeduplicationFlags deduplicationFlags>
+struct PickyDeduplicator : private DeduplicatorBase {
+	IDeduplicatedStream& output;
+
+	DuplicationIndex search = {*this};
+
+	struct RepetitionEntry {
+		int position = 0;
+		int16_t length = 0;
+		uint16_t distance = 0;
+	};
+	std::array<RepetitionEntry, MaxSize> repetitions = {};
+	int repetitionsUsed = 0;
+
+	int flushedUntil = 0;
+	int unflushedData = 0;
+
+public:
+	PickyDeduplicator(ByteInput& input, IDeduplicatedStream& output) : DeduplicatorBase(input), output(output) {
+		input.setInvalidationNotification([this] (int offset) {
+			flush();
+			positionStart += offset;
+			flushedUntil -= offset;
+		});
+	}
+	~PickyDeduplicator() {
+		flush();
+	}
+
+	void deduplicateSome() {
+		do {
+			uint64_t sequence = input.getEightBytesFromCurrentPosition();
+			int position = input.getPosition() - 1;
+			int location = 0;
+			int matchLength = 0;
+			std::tie(location, matchLength) = search.indexValueAndLocateBestMatch(position + positionStart, sequence);
+			location -= positionStart;
+			matchLength = std::min(matchLength, input.availableAhead());
+			int distance = position - location;
+
+			if constexpr(deduplicationFlags & INCLUDE_SMALL_DUPLICATES) {
+				if (matchLength == 3 && distance > 64) {
+					matchLength = 0; // Turns out this is not worth the 5 extra bits of distance encoding
+				}
+			}
+			if (matchLength >= 3) {
+				if (distance < 0) {
+					throw std::runtime_error("We screwed up");
+				}
+				repetitions[repetitionsUsed] = RepetitionEntry{position, int16_t(matchLength), uint16_t(distance)};
+				repetitionsUsed++;
+				if (repetitionsUsed >= std::ssize(repetitions)) {
+					flush();
+				}
+			}
+			unflushedData++;
+		} while (input.hasMoreDataInBuffer());
+	}
+
+	// Only indexes the data before the given position, so that the data after it can refer to them
+	void indexUntil(ptrdiff_t until) {
+		flush();
+		while (input.getPosition() + positionStart < until) {
+			uint64_t sequence = input.getEightBytesFromCurrentPosition();
+			search.indexValue(input.getPosition() - 1 + positionStart, sequence);
+		}
+		flushedUntil = input.getPosition();
+	}
+
+	void flush() {
+		// Make sure duplications don't overlap with the next step
+		int endAt = flushedUntil + unflushedData;
+		for (int i = repetitionsUsed - 1; i >= 0; i--) {
+			int fromEnd = repetitions[i].position + repetitions[i].length - endAt;
+			if (fromEnd > 0) {
+				repetitions[i].length -= fromEnd;
+				if (repetitions[i].length < 3) {
+					repetitions[i].length = 0;
+				}
+			}
+			if (repetitions[i].position + maximumCopyLength <= endAt) {
+				break;
+			}
+		}
+
+		// Prune duplications
+		if (repetitionsUsed >= 2) {
+			int previousRepetitionUsed = 0;
+			for (int i = 1; i < repetitionsUsed; i++) {
+				RepetitionEntry& current = repetitions[i];
+				RepetitionEntry& previous = repetitions[previousRepetitionUsed];
+				if (previous.position + previous.length < current.position) {
+					previousRepetitionUsed = i;
+					continue; // No overlap;
+				}
+				int remainderOfTheLast = previous.position + previous.length - current.position;
+				if (remainderOfTheLast < current.length) {
+					if (previous.length - remainderOfTheLast > 3) {
+						previous.length -= remainderOfTheLast; // Shorten it
+						previousRepetitionUsed = i;
+					} else {
+						// One of them has to be removed, this strategy is not optimal
+						if (current.length > previous.length) {
+							previous = RepetitionEntry{};
+							previousRepetitionUsed = i;
+						} else {
+							current = RepetitionEntry{};
+						}
+					}
+				} else {
+					current = RepetitionEntry{}; // The repetition is a subset of another one
+				}
+			}
+		}
+
+		// Write into the stream
+		int lastRepetitionEnd = flushedUntil;
+		auto writeRangeWithoutDuplications = [&] (int until) {
+			for (int i = lastRepetitionEnd; i < until; i++) {
+				output.addByte(input.getAtPosition(i));
+			}
+		};
+		for (int i = 0; i < repetitionsUsed; i++) {
+			if (repetitions[i].length) {
+				writeRangeWithoutDuplications(repetitions[i].position);
+				output.addDuplication(repetitions[i].length, repetitions[i].distance);
+				if (repetitions[i].length < 3) {
+					throw std::runtime_error("We screwed up");
+				}
+				lastRepetitionEnd = repetitions[i].position + repetitions[i].length;
+				repetitions[i] = RepetitionEntry{};
+			}
+		}
+		repetitionsUsed = 0;
+		writeRangeWithoutDuplications(flushedUntil + unflushedData);
+		flushedUntil += unflushedData;
+		unflushedData = 0;
+	}
+};
+
+// Higher level class handling the overall state of parsing. Implemented as a state machine to allow pausing when output is full.
+template <DecompressionSettings Settings, typename Output = ByteOutput<typename Settings::Output, typename Settings::Checksum>>
+class DeflateReader {
+	ByteInput& input;
+	Output& output;
+
+	struct CopyState {
+		int copyDistance = 0;
+		int copyLength = 0;
+
+		bool restart(decltype(DeflateReader::output)& output) {
+			int copying = int(std::min(output.available(), copyLength));
+			output.repeatSequence(copying, copyDistance);
+			copyLength -= copying;
+			return (copyLength == 0);
+		}
+		bool copy(decltype(DeflateReader::output)& output, int length, int distance) {
+			copyLength = length;
+			copyDistance = distance;
+			return restart(output);
+		}
+	};
+
+	struct LiteralState {
+		int bytesLeft = 0;
+		LiteralState(DeflateReader* parent) {
+			int length = int(parent->input.getBytes(2));
+			int antiLength = int(parent->input.getBytes(2));
+			if ((~length & 0xffff) != antiLength) {
+				throw std::runtime_error("Corrupted data, inverted length of literal block is mismatching");
+			}
+			bytesLeft = length;
+		}
+
+		bool parseSome(DeflateReader* parent) {
+			if (parent->shouldPause()) {
+				return true;
+			}
+			std::span<const uint8_t> chunk = parent->input.getRange(std::min(parent->output.available(), bytesLeft));
+			bytesLeft -= int(chunk.size());
+			parent->output.addBytes(std::span<const char>(reinterpret_cast<const char*>(chunk.data()), (chunk.size())));
+			parent->output.updateChecksum();
+			return (bytesLeft > 0);
+		}
+	};
+
+	constexpr static int maximumCopyBits = maximumHuffmanCodeLength * 2 + 5 + 13; // Longest length and distance codes with their extra bits
+	constexpr static int checksumInterval = 16384; // Output checksummed at once, should fit into the L1 cache
+
+	// Returns false at the end of the block, if unchecked, the caller must ensure the bits are loaded and the longest copy fits into the output
+	template <bool Unchecked, typename CodeTable, typename DistanceTable>
+	bool parseSymbol(CopyState& copyState, BitReader& bitInput, const CodeTable& codes, const DistanceTable& distanceCode) {
+		// Entries contain the base values and numbers of extra bits, so a whole copy is decoded after a single refill
+		if constexpr (!Unchecked) {
+			bitInput.refillIfBelow(maximumCopyBits);
+		}
+		uint64_t bits = bitInput.peekBits();
+		auto entry = codes.lookup(bits);
+		if (entry.word < endOfBlockWord) {
+			bitInput.consumeBits<Unchecked>(entry.length);
+			output.template addByte<Unchecked>(char(entry.word));
+		} else if (entry.word == endOfBlockWord) [[unlikely]] {
+			bitInput.consumeBits<Unchecked>(entry.length);
+			return false;
+		} else {
+			int lengthBits = entry.length + entry.extraBits;
+			int length = entry.word - copyLengthWordOffset + int((bits >> entry.length) & upperRemovals[entry.extraBits]);
+			bits >>= lengthBits;
+			auto distanceEntry = distanceCode.lookup(bits);
+			int distance = distanceEntry.word + int((bits >> distanceEntry.length) & upperRemovals[distanceEntry.extraBits]);
+			bitInput.consumeBits<Unchecked>(lengthBits + distanceEntry.length + distanceEntry.extraBits);
+			if constexpr (Unchecked) {
+				output.template repeatSequence<true>(length, distance);
+			} else {
+				copyState.copy(output, length, distance);
+			}
+		}
+		return true;
+	}
+
+	// Decodes a block compressed with Huffman codes, returns true if out of space
+	template <typename CodeTable, typename DistanceTable>
+	bool parseWithTables(CopyState& copyState, BitReader& bitInput, const CodeTable& codes, const DistanceTable& distanceCode) {
+		if (copyState.copyLength > 0) { // Resume copying if necessary
+			if (copyState.restart(output)) {
+				return true; // Out of space
+			}
+		}
+		// Fast loop while far from the ends of buffers, 56 loaded bits always suffice for a whole copy
+		while (bitInput.canRefillUnchecked() && output.available() >= maximumCopyLength) {
+			// Stops after some output to checksum it while it's in the cache
+			const int stopAt = std::max(maximumCopyLength, output.available() - checksumInterval);
+			while (bitInput.canRefillUnchecked() && output.available() >= stopAt) {
+				bitInput.refillUnchecked();
+				if (!parseSymbol<true>(copyState, bitInput, codes, distanceCode)) {
+					output.updateChecksum();
+					return false;
+				}
+			}
+			output.updateChecksum();
+		}
+		while (output.available()) {
+			if (shouldPause()) {
+				output.updateChecksum();
+				return true;
+			}
+			if (!parseSymbol<false>(copyState, bitInput, codes, distanceCode)) {
+				output.updateChecksum();
+				return false;
+			}
+		}
+		output.updateChecksum();
+		// The block may end exactly when the output is full, which matters if the output can't be emptied
+		if (copyState.copyLength == 0) {
+			bitInput.refillIfBelow(maximumHuffmanCodeLength);
+			auto entry = codes.lookup(bitInput.peekBits());
+			if (entry.word == endOfBlockWord) {
+				bitInput.consumeBits(entry.length);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct FixedCodeState : CopyState {
+		BitReader input;
+		FixedCodeState(decltype(input)&& input) : input(std::move(input)) {}
+
+		bool parseSome(DeflateReader* parent) {
+			return parent->parseWithTables(*this, input, fixedCodeTable, fixedDistanceTable);
+		}
+	};
+
+	struct DynamicCodeState : CopyState {
+		constexpr static bool usesLookupTables = (Settings::huffmanTableRootBits > 0);
+		constexpr static int rootBits = std::max(Settings::huffmanTableRootBits, 1);
+		BitReader input;
+		std::conditional_t<usesLookupTables, HuffmanDecodingTable<288, rootBits>, EncodedTable<288>> codes;
+		std::conditional_t<usesLookupTables, HuffmanDecodingTable<31, rootBits>, EncodedTable<31>> distanceCode;
+
+		template <typename Table>
+		static Table makeTable(BitReader& reader, std::span<const uint8_t> lengths, const DecodedSymbol* symbols) {
+			if constexpr (usesLookupTables) {
+				return Table(lengths, symbols);
+			} else {
+				return Table(reader, lengths);
+			}
+		}
+
+		DynamicCodeState(decltype(input)&& inputMoved, std::span<const uint8_t> codeLengths, std::span<const uint8_t> distanceCodeLengths)
+			: input(std::move(inputMoved))
+			, codes(makeTable<decltype(codes)>(input, codeLengths, literalAndLengthSymbols.data()))
+			, distanceCode(makeTable<decltype(distanceCode)>(input, distanceCodeLengths, distanceSymbols.data()))
+		{ }
+
+		bool parseSome(DeflateReader* parent) {
+			if constexpr (usesLookupTables) {
+				return parent->parseWithTables(*this, input, codes, distanceCode);
+			} else {
+				if (CopyState::copyLength > 0) { // Resume copying if necessary
+					if (CopyState::restart(parent->output)) {
+						return true; // Out of space
+					}
+				}
+				while (parent->output.available()) {
+					if (parent->shouldPause()) {
+						parent->output.updateChecksum();
+						return true;
+					}
+					int word = codes.readWord();
+					if (word < 256) {
+						parent->output.addByte(char(word));
+					} else if (word == 256) [[unlikely]] {
+						parent->output.updateChecksum();
+						return false;
+					} else {
+						int length = word - 254;
+						if (length > 10) {
+							length = input.parseLongerSize(length);
+						}
+						int distance = distanceCode.readWord() + 1;
+						if (distance > 4) {
+							distance = input.parseLongerDistance(distance);
+						}
+						CopyState::copy(parent->output, length, distance);
+					}
+				}
+				parent->output.updateChecksum();
+				// The block may end exactly when the output is full, which matters if the output can't be emptied
+				if (CopyState::copyLength > 0) {
+					return true; // The rest of the copy comes before the end of the block
+				}
+				input.refillIfBelow(maximumHuffmanCodeLength);
+				return !codes.skipEndOfBlockIfNext();
+			}
+		}
+	};
+
+	std::variant<std::monostate, LiteralState, FixedCodeState, DynamicCodeState> decodingState = {};
+	bool wasLast = false;
+	int bitsToSkip = 0;
+	ptrdiff_t stopPosition = std::numeric_limits<ptrdiff_t>::max();
+	ptrdiff_t boundary = 0;
+	std::function<bool()> inputRunsLow = nullptr;
+	bool wasPaused = false;
+
+	// Checked between symbols outside the fast loop and at block boundaries, the fast loop reads only bytes already buffered
+	bool shouldPause() {
+		if (inputRunsLow && inputRunsLow()) [[unlikely]] {
+			wasPaused = true;
+		}
+		return wasPaused;
+	}
+
+public:
+	DeflateReader(decltype(input)& input, decltype(output)& output) : input(input), output(output) {}
+
+	// Skips some bits of the first byte, for starting at a block that doesn't start at a byte boundary
+	void skipBits(int bits) {
+		bitsToSkip = bits;
+	}
+
+	// Forgets the state, for starting again at another block boundary, the input must be moved there afterwards
+	void restart(int skippedBits = 0) {
+		decodingState = std::monostate();
+		wasLast = false;
+		bitsToSkip = skippedBits;
+		stopPosition = std::numeric_limits<ptrdiff_t>::max();
+	}
+
+	// Makes parseSome() stop at the first block boundary at or after this bit position, it can continue afterwards
+	void stopAtBoundaryAfter(ptrdiff_t bitPosition) {
+		stopPosition = bitPosition;
+	}
+
+	// Makes parseSome() return early if the function tells that the input might not suffice for the next symbol or block header,
+	// for input that must be awaited before decoding continues, the function isn't called in the fast loop
+	void pauseWhenInputRunsLow(std::function<bool()> check) {
+		inputRunsLow = std::move(check);
+	}
+
+	// Whether parseSome() returned because the input ran low, rather than because the output was full
+	bool paused() const {
+		return wasPaused;
+	}
+
+	// Bit position of the last block boundary reached, the end of the data if the last block was decoded
+	ptrdiff_t lastBoundary() const {
+		return boundary;
+	}
+
+	// Whether parseSome() returned false because it reached the end of data rather than a boundary set by stopAtBoundaryAfter()
+	bool reachedEnd() const {
+		return wasLast;
+	}
+
+	// Returns whether there is more work to do
+	bool parseSome() {
+		wasPaused = false;
+		while (true) {
+			BitReader bitInput(nullptr);
+			if (LiteralState* literalState = std::get_if<LiteralState>(&decodingState)) {
+				if (literalState->parseSome(this)) {
+					return true;
+				}
+				bitInput = decltype(bitInput)(&input);
+			} else if (FixedCodeState* fixedState = std::get_if<FixedCodeState>(&decodingState)) {
+				if (fixedState->parseSome(this)) {
+					return true;
+				}
+				bitInput = std::move(fixedState->input);
+			} else if (DynamicCodeState* dynamicState = std::get_if<DynamicCodeState>(&decodingState)) {
+				if (dynamicState->parseSome(this)) {
+					return true;
+				}
+				bitInput = std::move(dynamicState->input);
+			} else {
+				bitInput = decltype(bitInput)(&input);
+			}
+			decodingState = std::monostate();
+
+			// No decoding state, this is a block boundary
+			if (bitsToSkip > 0) {
+				bitInput.getBits(bitsToSkip);
+				bitsToSkip = 0;
+			}
+			boundary = bitInput.bitPosition();
+			// Pausing comes first, because the data following the last block are read after it
+			const bool pausing = shouldPause();
+			if (wasLast && !pausing) {
+				output.done();
+				return false;
+			}
+			if (boundary >= stopPosition || pausing) {
+				// Whole bytes are returned to the input, the bits of the last one are skipped when resumed
+				BitReader(std::move(bitInput));
+				if (boundary & 7) {
+					input.returnBytes(1);
+					bitsToSkip = int(boundary & 7);
+				}
+				return pausing;
+			}
+			wasLast = bitInput.getBits(1);
+			int compressionType = bitInput.getBits(2);
+			if (compressionType == 0b00) {
+				BitReader(std::move(bitInput)); // Move it to a temporary and destroy it
+				decodingState.template emplace<LiteralState>(this);
+			} else if (compressionType == 0b01) {
+				decodingState.template emplace<FixedCodeState>(std::move(bitInput));
+			} else if (compressionType == 0b10) {
+				// Read lengths
+				const int extraCodes = bitInput.getBits(5); // Will be used later
+				constexpr int maximumExtraCodes = 29;
+				if (extraCodes > maximumExtraCodes) [[unlikely]] {
+					throw std::runtime_error("Impossible number of extra codes");
+				}
+				const int distanceCodes = bitInput.getBits(5) + 1; // Will be used later
+				if (distanceCodes > 31) [[unlikely]] {
+					throw std::runtime_error("Impossible number of distance codes");
+				}
+				const int codeLengthCount = bitInput.getBits(4) + 4;
+				if (codeLengthCount > 19) [[unlikely]]
+						throw std::runtime_error("Invalid distance code count");
+
+				// Read Huffman code lengths
+				std::array<uint8_t, codeCodingReorder.size()> codeCodingLengths = {};
+				for (int i = 0; i < codeLengthCount; i++) {
+					codeCodingLengths[codeCodingReorder[i]] = uint8_t(bitInput.getBits(3));
+				}
+
+				// Generate Huffman codes for lengths
+				std::array<int, codeCodingReorder.size()> codeCoding = {};
+				std::array<uint8_t, 256> codeCodingLookup = {};
+				int nextCodeCoding = 0;
+				for (int size = 1; size <= 8; size++) {
+					for (int i = 0; i < std::ssize(codeCoding); i++)
+						if (codeCodingLengths[i] == size) {
+
+							for (int code = nextCodeCoding << (8 - size); code < (nextCodeCoding + 1) << (8 - size); code++) {
+								codeCodingLookup[reversedBytes[code]] = uint8_t(i);
+							}
+							codeCoding[i] = reversedBytes[nextCodeCoding];
+
+							nextCodeCoding++;
+						}
+					nextCodeCoding <<= 1;
+				}
+
+				// Both tables are read together because repetitions can span across both of them
+				const int codeCount = 257 + extraCodes;
+				std::array<uint8_t, 288 + 31> codeLengths = readCodeLengths<288 + 31>(bitInput, codeCount + distanceCodes, codeCodingLookup, codeCodingLengths);
+				decodingState.template emplace<DynamicCodeState>(std::move(bitInput), std::span<const uint8_t>(codeLengths.data(), codeCount),
+						std::span<const uint8_t>(codeLengths.data() + codeCount, distanceCodes));
+			} else {
+				throw std::runtime_error("Unknown type of block compression");
+			}
+		}
+	}
+};
+
+template <StreamSettings OutputSettings, StreamSettings DeduplicatedSettings, int BlockSize = 1000000>
+class HuffmanWriter {
+	ByteOutput<OutputSettings, NoChecksum>& byteOutput;
+	std::optional<BitOutput<OutputSettings, NoChecksum>> bitOutput;
+
+	template <int Size>
+	struct HuffmanTable {
+		struct Entry {
+			uint16_t code;
+			uint8_t length;
+
+			Entry() = default;
+			Entry(uint16_t codeUnreversed, uint8_t length) : length(length) {
+				if (length <= 8) {
+					code = reversedBytes[codeUnreversed] >> (8 - length);
+				} else {
+					code = (reversedBytes[codeUnreversed >> 8] >> (16 - length)) | (reversedBytes[codeUnreversed & 0xff] << (length - 8));
+				}
+			}
+		};
+		std::array<Entry, Size> codes = {};
+
+		HuffmanTable() = default;
+		struct UseDefaultLengthEncoding {};
+		constexpr HuffmanTable(UseDefaultLengthEncoding) : codes(ArrayFiller([] (int index) {
+			if (index <= 143) {
+				return Entry(uint16_t(index + 0b00110000), 8);
+			} else if (index <= 255) {
+				return Entry(uint16_t(index - 144 + 0b110010000), 9);
+			} else if (index == 256) {
+				return Entry(0, 7);
+			} else if (index <= 279) {
+				return Entry(uint16_t(index - 256), 7);
+			} else {
+				return Entry(uint16_t(index - 280 + 0b11000000), 8);
+			}
+		})) {}
+		struct UseDefaultDistanceEncoding {};
+		constexpr HuffmanTable(UseDefaultDistanceEncoding) : codes(ArrayFiller([] (int index) {
+			return Entry(uint16_t(29 - index), 5);
+		})) {}
+
+
+		template <typename Applied>
+		void runThroughCodeEncoding(int endAt, int increment, const Applied& applied) const {
+			int previousLength = 0;
+			int previousLengthRepeats = 0;
+			auto doneRepeating = [&] {
+				bool repeatAgain = false;
+				do {
+					repeatAgain = false;
+					if (previousLengthRepeats == 1) {
 						applied(previousLength, 0);
 					} else if (previousLengthRepeats == 2) {
 						applied(previousLength, 0);
@@ -1826,979 +3678,3042 @@ class HuffmanWriter {
 							}
 						}
 					}
-				} while (repeatAgain);
-			};
-			auto checkOne = [&] (Entry code) {
-				if (code.length == previousLength) {
-					previousLengthRepeats++;
+				} while (repeatAgain);
+			};
+			auto checkOne = [&] (Entry code) {
+				if (code.length == previousLength) {
+					previousLengthRepeats++;
+				} else {
+					if (previousLengthRepeats > 0) [[likely]] { // Startup
+						doneRepeating();
+					}
+					previousLength = code.length;
+					previousLengthRepeats = 1;
+				}
+			};
+			if (increment > 0) {
+				for (int i = 0; i < endAt; i += increment) {
+					checkOne(codes[i]);
+				}
+			} else {
+				for (int i = Size - 1; i >= endAt; i += increment) {
+					checkOne(codes[i]);
+				}
+			}
+			doneRepeating();
+		}
+	};
+
+	template <int Size>
+	struct FrequencyCounts {
+		struct Entry {
+			int index = 0;
+			int count = 0;
+			int length = 0;
+		};
+
+		std::array<Entry, Size> counts = ArrayFiller([] (int index) { return Entry{ index, 0 }; });
+
+		HuffmanTable<Size> generateEncoding(int left, bool ascending) { // Trying to do this without the bool flag will bloat the code a lot
+			std::array<Entry, Size> sortedCounts = counts;
+			// Make sure we have enough elements to form a Huffman table
+			int usedCodes = 0;
+			for (Entry& entry : sortedCounts) {
+				if (entry.count > 0)
+					usedCodes++;
+			}
+			HuffmanTable<Size> made = {};
+			if (usedCodes == 0) {
+				return made;
+			}
+
+			int sizeIncrement = 1;
+			int64_t capacity = 0x10000;
+
+			std::sort(sortedCounts.begin(), sortedCounts.end(), [] (Entry first, Entry second) {
+				return first.count > second.count;
+			});
+
+			// Assign lengths, assign as much capacity as possible but not more than the word's proportion in the total number of words
+			for (Entry& word : sortedCounts) {
+				if (word.count == 0) break; // In this case, we're done sooner
+				while (int(0x10000 >> sizeIncrement) * left > word.count * capacity) {
+					// Switch to longer codes
+					sizeIncrement++;
+				}
+				word.length = sizeIncrement;
+				left -= word.count;
+				capacity -= (0x10000 >> sizeIncrement);
+			}
+
+			// Assign leftover capacity to the shortest lengths that can be shortened by taking this capacity
+			int sameLengthRangeBegin = 0;
+			int sameLengthRangeEnd = 0;
+			uint16_t currentCode = 0;
+			auto sortLastLength = [&] () {
+				// Ensure codes of the same length start from the lowest index code
+				if (ascending) {
+					std::sort(sortedCounts.begin() + sameLengthRangeBegin, sortedCounts.begin() + sameLengthRangeEnd,
+							  [] (Entry first, Entry second) {
+						return first.index < second.index;
+					});
+				} else {
+					std::sort(sortedCounts.begin() + sameLengthRangeBegin, sortedCounts.begin() + sameLengthRangeEnd,
+							  [] (Entry first, Entry second) {
+						return first.index > second.index;
+					});
+				}
+				for (int i = sameLengthRangeBegin; i < sameLengthRangeEnd; i++) {
+					made.codes[sortedCounts[i].index] = typename HuffmanTable<Size>::Entry(currentCode, uint8_t(sortedCounts[i].length));
+					currentCode += 1;
+				}
+				sameLengthRangeBegin = sameLengthRangeEnd;
+			};
+			int previousLength = 0;
+			for (Entry& word : sortedCounts) {
+				if (word.count == 0) break; // In this case, we're done sooner
+				if (usedCodes != 1) {
+					int neededToUpgrade = 0x10000 >> word.length;
+					if (neededToUpgrade <= capacity) {
+						capacity -= neededToUpgrade;
+						word.length--;
+					}
+				}
+				if (word.length != previousLength) {
+					sortLastLength();
+					currentCode <<= (word.length) - previousLength;
+					previousLength = word.length;
+				}
+				sameLengthRangeEnd++;
+			}
+			sortLastLength();
+
+			if (capacity < 0) {
+				throw std::logic_error("Didn't generate the Huffman code correctly");
+			}
+			if (capacity > 0 && usedCodes != 1) { // This is not only suboptimal, gunzip requires every Huffman code to be valid (the standard does not)
+				throw std::logic_error("Didn't use all capacity available for Huffman coding");
+			}
+
+			return made;
+		}
+
+		int sizeWithEncoding(const HuffmanTable<Size>& encoding) {
+			int total = 0;
+			for (Entry letter : counts) {
+				total += letter.count * encoding.codes[letter.index].length;
+			}
+			return total;
+		}
+
+		template <int OtherSize>
+		int addToHuffmanTableLengths(HuffmanTable<OtherSize>& encoding, int endAt, int increment) {
+			int totalWords = 0;
+			encoding.runThroughCodeEncoding(endAt, increment, [this, &totalWords] (int word, int) {
+				counts[word].count++;
+				totalWords++;
+			});
+			return totalWords;
+		}
+	};
+
+public:
+	HuffmanWriter(ByteOutput<OutputSettings, NoChecksum>& output) : byteOutput(output) {}
+
+	~HuffmanWriter() {
+		if (std::uncaught_exceptions() == 0) {
+			finalFlush();
+		}
+	}
+
+	void finalFlush() {
+		if (bitOutput) {
+			bitOutput->flush();
+			bitOutput.reset();
+		}
+	}
+
+	// Ends with an empty stored block that isn't last, so that the output ends at a byte boundary and more blocks can follow
+	void syncFlush() {
+		if (!bitOutput) {
+			bitOutput.emplace(byteOutput);
+		}
+		bitOutput->addBits(0b000, 3);
+		bitOutput->flush(); // Pads the last byte
+		bitOutput.reset();
+		constexpr std::array<char, 4> storedSize = {0, 0, char(0xff), char(0xff)};
+		byteOutput.addBytes(storedSize);
+	}
+
+	void writeBatch(DeduplicatingStreamSection& section, bool isLast) {
+		// Baseline, dynamic Hufffman coding won't be used if it's better; TODO: Why not constexpr?
+		static HuffmanTable<286> staticWordEncoding = HuffmanTable<286>(typename HuffmanTable<286>::UseDefaultLengthEncoding());
+		static HuffmanTable<30> staticDistanceEncoding = HuffmanTable<30>(typename HuffmanTable<30>::UseDefaultDistanceEncoding());
+		// Avoid having to convert the oddly positioned distance codes in the range of -30 to -1
+		static typename HuffmanTable<30>::Entry* staticDistanceZero = staticDistanceEncoding.codes.data() + 30;
+
+		struct Counts {
+			FrequencyCounts<286> wordCounts = {};
+			FrequencyCounts<30> distanceCounts = {};
+			int lengthsAfter256 = 1;
+			int lowestDistanceWord = 29;
+			int properEndPos = 0;
+			int words = 0;
+			int distances = 0;
+			int staticLength = 0;
+
+			typename FrequencyCounts<30>::Entry* frequencyDistanceZero() {
+				return distanceCounts.counts.data() + 30;
+			}
+
+			Counts(DeduplicatingStreamSection& section, int startPos, int endPos) {
+				section.position = startPos;
+				while (section.position < endPos) {
+					int word = section.readWord([&] (auto, int distanceWord, auto) {
+						frequencyDistanceZero()[distanceWord].count++;
+						staticLength += staticDistanceZero[distanceWord].length;
+						distances++;
+					});
+					if (word < 0) {
+						throw std::runtime_error("Corrupted stream boundaries");
+					}
+					wordCounts.counts[word].count++;
+					staticLength += staticWordEncoding.codes[word].length;
+					words++;
+				}
+				properEndPos = section.position; // We may have run through some trailers, need to update the start of the following block
+				wordCounts.counts[256].count++; // We need to end the block somewhere
+				words++;
+
+				// We'll need to stop writing lengths from some point
+				for (int i = int(std::ssize(wordCounts.counts)) - 1; i > 257; i--) {
+					if (wordCounts.counts[i].count != 0) {
+						lengthsAfter256 = i - 256;
+						break;
+					}
+				}
+				for (int i = 0; i < std::ssize(distanceCounts.counts); i++) {
+					if (distanceCounts.counts[i].count != 0) {
+						lowestDistanceWord = i;
+						break;
+					}
+				}
+			}
+
+			Counts(const Counts& first, const Counts& second) // MUST be adjacent
+			: lengthsAfter256(std::max(first.lengthsAfter256, second.lengthsAfter256))
+			, lowestDistanceWord(std::min(first.lowestDistanceWord, second.lowestDistanceWord))
+			, properEndPos(std::max(first.properEndPos, second.properEndPos))
+			, words(first.words + second.words)
+			, distances(first.distances + second.distances)
+			, staticLength(first.staticLength + second.staticLength) {
+				for (int i = 0; i <= 256 + lengthsAfter256; i++) {
+					wordCounts.counts[i].count = first.wordCounts.counts[i].count + second.wordCounts.counts[i].count;
+				}
+				for (int i = int(std::ssize(distanceCounts.counts) - 1); i >= lowestDistanceWord; i--) {
+					distanceCounts.counts[i].count = first.distanceCounts.counts[i].count + second.distanceCounts.counts[i].count;
+				}
+
+				wordCounts.counts[256].count--; // One less ending
+				words--;
+			}
+		};
+
+		class Block {
+			DeduplicatingStreamSection* section = nullptr; // Pointer just to allow default assignment
+
+			bool enabled = true;
+			bool last = false;
+			Counts counts;
+			int startPos = 0;
+			int endPos = 0;
+			int total = 0;
+			int codeCodingTableLength = 0;
+
+			bool usesDynamic = false;
+			HuffmanTable<19> codeEncoding = {};
+			HuffmanTable<286> dynamicWordEncoding = {};
+			HuffmanTable<30> dynamicDistanceEncoding = {};
+
+		public:
+			Block(DeduplicatingStreamSection& section, Counts&& counts, int startPos, bool last)
+			: section(&section), last(last), counts(std::move(counts)), startPos(startPos), endPos(counts.properEndPos) {
+				if (startPos >= endPos) {
+					enabled = false;
+					return;
+				}
+
+				dynamicWordEncoding = counts.wordCounts.generateEncoding(counts.words, true /*ascending*/);
+				dynamicDistanceEncoding = counts.distanceCounts.generateEncoding(counts.distances, false /*descending*/);
+
+				// Find distribution and generate encodings for the definition of the Huffman code
+				FrequencyCounts<19> codeCounts = {};
+				int totalCodes = 0;
+				totalCodes += codeCounts.addToHuffmanTableLengths(dynamicWordEncoding, 257 + counts.lengthsAfter256, 1);
+				totalCodes += codeCounts.addToHuffmanTableLengths(dynamicDistanceEncoding, counts.lowestDistanceWord, -1);
+				codeEncoding = codeCounts.generateEncoding(totalCodes, true /*ascending*/);
+
+				for (int i = 0; i < std::ssize(codeCodingReorder); i++) {
+					if (codeEncoding.codes[i].length > 0) {
+						codeCodingTableLength = std::max<int>(codeCodingTableLength, codeCodingReorderInverse[i]);
+					}
+				}
+				codeCodingTableLength = std::max(codeCodingTableLength + 1, 4); // At least 4 codes must be written
+
+				// Now, we can estimate the size of the encoded part (minus the extra bits after some numbers because they're always the same)
+				int dynamicLength = 12 + codeCodingTableLength * 3; // Intro length
+				dynamicLength += codeCounts.sizeWithEncoding(codeEncoding); // Encoded codes
+				dynamicLength += 2 * codeCounts.counts[16].count + 3 * codeCounts.counts[17].count + 7 * codeCounts.counts[18].count; // Extra bits
+				dynamicLength += counts.wordCounts.sizeWithEncoding(dynamicWordEncoding); // Encoded words
+				dynamicLength += counts.distanceCounts.sizeWithEncoding(dynamicDistanceEncoding); // Encoded distances
+
+				// Pick the encoding
+				usesDynamic = (dynamicLength < counts.staticLength);
+				total = std::min(dynamicLength, counts.staticLength);
+			}
+
+			void writeOut(BitOutput<OutputSettings, NoChecksum>& bitOutput) {
+				if (!enabled) {
+					return;
+				}
+
+				const HuffmanTable<286>* wordEncoding = (usesDynamic) ? &dynamicWordEncoding : &staticWordEncoding;
+				const HuffmanTable<30>* distanceEncoding = (usesDynamic) ? &dynamicDistanceEncoding : &staticDistanceEncoding;
+				const typename HuffmanTable<30>::Entry* distanceZero = distanceEncoding->codes.data() + 30;
+
+				bitOutput.addBits(last, 1);
+				if (usesDynamic) {
+					// Intro
+					bitOutput.addBits(0b10, 2);
+					bitOutput.addBits(counts.lengthsAfter256, 5);
+					bitOutput.addBits(29 - counts.lowestDistanceWord, 5);
+					bitOutput.addBits(codeCodingTableLength - 4, 4);
+
+					// Code encoding
+					for (int i = 0; i < codeCodingTableLength; i++) {
+						bitOutput.addBits(codeEncoding.codes[codeCodingReorder[i]].length, 3); // Writing some bullshit here
+					}
+
+					// Code declaration
+					auto encodeCode = [this, &bitOutput] (const auto& code, int endAt, int increment) {
+						code.runThroughCodeEncoding(endAt, increment, [this, &bitOutput] (int word, int extra) {
+							bitOutput.addBits(codeEncoding.codes[word].code, codeEncoding.codes[word].length);
+							if (word == 16) {
+								bitOutput.addBits(extra - 3, 2);
+							} else if (word == 17) {
+								bitOutput.addBits(extra - 3, 3);
+							} else if (word == 18) {
+								bitOutput.addBits(extra - 11, 7);
+							}
+						});
+					};
+
+					encodeCode(dynamicWordEncoding, 257 + counts.lengthsAfter256, 1);
+					encodeCode(dynamicDistanceEncoding, counts.lowestDistanceWord, -1);
 				} else {
-					if (previousLengthRepeats > 0) [[likely]] { // Startup
-						doneRepeating();
+					bitOutput.addBits(0b01, 2);
+				}
+
+				// Encode the actual block
+				section->position = startPos;
+				while (section->position < endPos) {
+					bool alsoOthers = false;
+					typename std::decay_t<decltype(*section)>::CodeRemainderWithLength length = {};
+					int distanceWord = 0;
+					typename std::decay_t<decltype(*section)>::CodeRemainderWithLength distance = {};
+					int word = section->readWord([&] (auto lengthExtraAssigned, int distanceWordAssigned, auto distanceExtraAssigned) {
+						alsoOthers = true;
+						length = lengthExtraAssigned;
+						distanceWord = distanceWordAssigned;
+						distance = distanceExtraAssigned;
+					});
+					bitOutput.addBits(wordEncoding->codes[word].code, wordEncoding->codes[word].length);
+					if (alsoOthers) { // Hopefully this will be optimised out
+						if (word >= 265) {
+							bitOutput.addBitsAndCrop(length.remainder, length.length);
+						}
+						bitOutput.addBits(distanceZero[distanceWord].code, distanceZero[distanceWord].length);
+						if (distanceWord < -4) {
+							bitOutput.addBitsAndCrop(distance.remainder, distance.length);
+						}
 					}
-					previousLength = code.length;
-					previousLengthRepeats = 1;
 				}
-			};
-			if (increment > 0) {
-				for (int i = 0; i < endAt; i += increment) {
-					checkOne(codes[i]);
+				bitOutput.addBits(wordEncoding->codes[256].code, wordEncoding->codes[256].length); // Ending
+			}
+
+			bool getEnabled() const {
+				return enabled;
+			}
+			void setEnabled(bool value) {
+				enabled = value;
+			}
+			int getStart() const {
+				return startPos;
+			}
+			int getEnd() const {
+				return endPos;
+			}
+			int totalSize() const {
+				return total;
+			}
+			bool isLast() const {
+				return last;
+			}
+			const Counts& getCounts() const {
+				return counts;
+			}
+		};
+
+		constexpr static int BlockCount = std::max(DeduplicatedSettings::maxSize / BlockSize, 1);
+		int previousEnd = 0;
+		std::array<Block, BlockCount> blocks = ArrayFiller([&] (int index) -> Block {
+			int end = (index + 1) * BlockSize;
+			bool thisOneIsLast = isLast;
+			if (end > section.endPosition()) {
+				end = section.endPosition();
+			} else thisOneIsLast = false;
+			Block made(section, Counts(section, previousEnd, std::min((index + 1) * BlockSize, section.endPosition())), previousEnd, thisOneIsLast);
+			previousEnd = made.getEnd();
+			return made;
+		});
+
+		auto considerMerge = [&section] (Block& first, Block& second) {
+			Block merged(section, Counts(first.getCounts(), second.getCounts()), first.getStart(), first.isLast() || second.isLast());
+			if (merged.totalSize() < first.totalSize() + second.totalSize()) {
+				first = merged;
+				second.setEnabled(false);
+			}
+		};
+		for (int width = 1; width < std::ssize(blocks) / 2; width *= 2) {
+			for (int start = 0; start < std::ssize(blocks); start += width * 2) {
+				int mid = start + width;
+				if (mid >= std::ssize(blocks))
+					break; // Past the end
+				int end = std::min<int>(start + width * 2, std::ssize(blocks));
+				int startBlockIndex = mid - 1;
+				for ( ; startBlockIndex >= start; startBlockIndex--) {
+					if (blocks[startBlockIndex].getEnabled())
+						break;
+				}
+				if (startBlockIndex < start)
+					continue; // Found nothing
+				int endBlockIndex = mid;
+				for ( ; endBlockIndex < end; endBlockIndex++) {
+					if (blocks[startBlockIndex].getEnabled())
+						break;
+				}
+				if (endBlockIndex >= end)
+					continue; // Foud nothing
+
+				considerMerge(blocks[startBlockIndex], blocks[endBlockIndex]);
+			}
+		}
+
+		if (!bitOutput) {
+			bitOutput.emplace(byteOutput);
+		}
+
+		for (int i = 0; i < std::ssize(blocks); i++) {
+			blocks[i].writeOut(*bitOutput);
+		}
+	}
+};
+
+} // namespace Detail
+
+#if EZGZ_HAS_CONCEPTS
+template <typename T>
+concept CompressionSettings = std::constructible_from<typename T::Checksum> && InputStreamSettings<typename T::Input>
+			&& StreamSettings<typename T::Output> && StreamSettings<typename T::DeduplicationProperties>
+			 && Detail::Deduplicator<typename T::DeduplicatorType> && requires(typename T::Checksum checksum) {
+	int(checksum());
+	int(checksum(std::span<const uint8_t>()));
+	int(T::HuffmanSectionSize);
+};
+#else
+#define CompressionSettings typename
+#endif
+
+struct FastCompressionSettings {
+	struct Input {
+		constexpr static int maxSize = 30000;
+		constexpr static int minSize = 10000;
+		constexpr static int lookAheadSize = 300;
+	};
+	struct DeduplicationProperties {
+		constexpr static int maxSize = 50000;
+		constexpr static int minSize = 10000;
+	};
+	struct Output {
+		constexpr static int maxSize = 100000;
+		constexpr static int minSize = 0;
+	};
+
+	constexpr static int HuffmanSectionSize = 1000000;
+	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::LastRepetitionEntry>;
+	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::NO_DUPLICATION_FLAGS)>;
+	using Checksum = HardwareCrc32;
+};
+
+struct DefaultCompressionSettings : FastCompressionSettings {
+	constexpr static int HuffmanSectionSize = 50000;
+	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::RepetitionCircularBuffer<5>>;
+	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::INDEX_DUPLICATES | Detail::INCLUDE_SMALL_DUPLICATES)>;
+	using Checksum = HardwareCrc32;
+};
+
+struct DenseCompressionSettings : DefaultCompressionSettings {
+	constexpr static int HuffmanSectionSize = 5000;
+	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::CircularQueueHistoryBuffer<15>>;
+	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::INDEX_DUPLICATES | Detail::INCLUDE_SMALL_DUPLICATES)>;
+};
+
+struct BestCompressionSettings : DenseCompressionSettings {
+	constexpr static int HuffmanSectionSize = 2000;
+	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::CircularQueueHistoryBuffer<>>;
+	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::INDEX_DUPLICATES | Detail::INCLUDE_SMALL_DUPLICATES)>;
+};
+
+namespace Detail {
+// Prepares a vector for decompressing directly into it, an accurate size hint avoids reallocation
+// The vector zeroes the memory when resized, so unlike inflateIntoBuffer, this writes every byte twice
+inline std::vector<char> allocateForInflating(size_t sizeHint) {
+	// The slack allows copying in whole chunks and reading the end of the last block if the size hint is exact
+	return std::vector<char>(std::max<size_t>(sizeHint, 1024) + repetitionSlack);
+}
+
+// Decompresses a stream after the data already written into the output, doubling the vector when it's full
+// The vector must start with the data already written into the output
+template <DecompressionSettings Settings>
+void inflateIntoGrowingVector(ByteInput& input, ContiguousByteOutput<typename Settings::Checksum>& output, std::vector<char>& result) {
+	if (result.size() < output.size() + 1024 + repetitionSlack) {
+		result.resize(std::max(result.size() * 2, output.size() + 1024 + repetitionSlack));
+	}
+	output.setBuffer(result);
+	DeflateReader<Settings, ContiguousByteOutput<typename Settings::Checksum>> reader(input, output);
+	while (reader.parseSome()) {
+		if (output.available() == 0) {
+			result.resize(result.size() * 2);
+			output.setBuffer(result);
+		}
+	}
+}
+
+// Removes the unused end of the vector once all data are decompressed into it
+inline void trimInflatedVector(std::vector<char>& result, size_t size) {
+	result.resize(size);
+	if (result.capacity() > result.size() * 2 + 1024) {
+		result.shrink_to_fit(); // The size hint was far too large, the excess memory would be kept
+	}
+}
+
+// Decompresses all data directly into a vector that grows when full
+template <DecompressionSettings Settings>
+std::vector<char> inflateIntoVector(ByteInput& input, ContiguousByteOutput<typename Settings::Checksum>& output, size_t sizeHint) {
+	std::vector<char> result = allocateForInflating(sizeHint);
+	inflateIntoGrowingVector<Settings>(input, output, result);
+	trimInflatedVector(result, output.size());
+	return result;
+}
+
+// Decompresses all data directly into a buffer, returns the size of decompressed data
+template <DecompressionSettings Settings>
+size_t inflateIntoBuffer(ByteInput& input, ContiguousByteOutput<typename Settings::Checksum>& output) {
+	DeflateReader<Settings, ContiguousByteOutput<typename Settings::Checksum>> reader(input, output);
+	while (reader.parseSome()) {
+		if (output.available() == 0) {
+			throw std::runtime_error("Decompressed data don't fit into the output buffer");
+		}
+	}
+	return output.size();
+}
+} // namespace Detail
+
+// Handles decompression of a deflate-compressed archive, no headers, the source is called directly unless it's a std::function
+template <DecompressionSettings Settings = DefaultDecompressionSettings, typename Source,
+		std::enable_if_t<std::is_invocable_r_v<int, Source&, std::span<uint8_t>>>* = nullptr>
+std::vector<char> readDeflateIntoVector(Source readMoreFunction) {
+	Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum, Source> input(std::move(readMoreFunction));
+	Detail::ContiguousByteOutput<typename Settings::Checksum> output;
+	return Detail::inflateIntoVector<Settings>(input, output, 0);
+}
+
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+std::vector<char> readDeflateIntoVector(std::span<const uint8_t> allData) {
+	Detail::ByteInputFromMemory input(allData);
+	Detail::ContiguousByteOutput<typename Settings::Checksum> output;
+	return Detail::inflateIntoVector<Settings>(input, output, allData.size() * 4); // Just a guess of a typical compression ratio
+}
+
+// Decompresses into a buffer provided by the caller, throws if the data don't fit, returns the size of decompressed data
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+size_t readDeflateIntoBuffer(std::span<const uint8_t> allData, std::span<char> buffer) {
+	Detail::ByteInputFromMemory input(allData);
+	Detail::ContiguousByteOutput<typename Settings::Checksum> output(buffer);
+	return Detail::inflateIntoBuffer<Settings>(input, output);
+}
+
+template <CompressionSettings Settings, typename Source, std::enable_if_t<std::is_invocable_r_v<int, Source&, std::span<char>>>* = nullptr>
+std::vector<uint8_t> writeDeflateIntoVector(Source readMoreFunction) {
+	std::vector<uint8_t> result;
+	{
+		Detail::ByteOutput<typename Settings::Output, NoChecksum> output;
+		Detail::HuffmanWriter<typename Settings::Output, typename Settings::DeduplicationProperties> writer(output);
+		auto connector = [&] (Detail::DeduplicatingStreamSection section, bool lastCall) {
+			writer.writeBatch(section, lastCall);
+			return section.position;
+		};
+		auto readBytes = [&readMoreFunction] (std::span<uint8_t> batch) -> int {
+			return readMoreFunction(std::span<char>(reinterpret_cast<char*>(batch.data()), batch.size()));
+		};
+		Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum, decltype(readBytes)> input(readBytes);
+		Detail::DeduplicatedStream<typename Settings::DeduplicationProperties> deduplicated(connector);
+		auto deduplicator = std::make_unique<typename Settings::DeduplicatorType>(input, deduplicated);
+
+		do {
+			deduplicator->deduplicateSome();
+			std::span<const char> batch = output.getBuffer();
+			result.insert(result.end(), batch.begin(), batch.end());
+			output.cleanBuffer();
+		} while (!input.isAtEnd());
+
+		deduplicator->flush();
+		deduplicated.flush();
+		writer.finalFlush();
+		output.done();
+		std::span<const char> batch = output.getBuffer();
+		result.insert(result.end(), batch.begin(), batch.end());
+	}
+	return result;
+}
+
+template <CompressionSettings Settings>
+std::vector<uint8_t> writeDeflateIntoVector(std::span<const char> allData) {
+	return writeDeflateIntoVector<Settings>([allData, position = 0] (std::span<char> toFill) mutable -> int {
+		int filling = std::min(int(allData.size() - position), int(toFill.size()));
+		if(filling != 0)
+			memcpy(toFill.data(), &allData[position], filling);
+		position += filling;
+		return filling;
+	});
+}
+
+
+// Positions in a .gz file where decompression can start and the data preceding them, allows seeking in decompressed data
+struct GzIndex {
+	struct Checkpoint {
+		size_t outputPosition = 0; // Position in decompressed data
+		size_t inputBit = 0; // Position of the first bit of a deflate block in the file
+		std::vector<char> window; // Up to 32 kiB of decompressed data preceding it
+	};
+	std::vector<Checkpoint> checkpoints;
+	size_t decompressedSize = 0;
+
+	constexpr static size_t defaultSpacing = 1024 * 1024;
+	constexpr static size_t maxWindowSize = 32768;
+	constexpr static std::string_view magic = "EzGzIdx1";
+
+	// The last checkpoint at or before the position
+	const Checkpoint& checkpointBefore(size_t position) const {
+		if (checkpoints.empty() || position > decompressedSize) {
+			throw std::runtime_error("Seeking past the end of data");
+		}
+		auto found = std::upper_bound(checkpoints.begin(), checkpoints.end(), position, [] (size_t position, const Checkpoint& checkpoint) {
+			return position < checkpoint.outputPosition;
+		});
+		if (found == checkpoints.begin()) {
+			throw std::runtime_error("Index doesn't start at the start of data");
+		}
+		return *(found - 1);
+	}
+
+	void save(const std::function<void(std::span<const char> batch)>& write) const {
+		auto writeInteger = [&write] (uint64_t value, int bytes) {
+			std::array<char, sizeof(uint64_t)> encoded = {};
+			for (int i = 0; i < bytes; i++) {
+				encoded[i] = char(value >> (i * 8));
+			}
+			write(std::span<const char>(encoded.data(), bytes));
+		};
+		write(std::span<const char>(magic.data(), magic.size()));
+		writeInteger(decompressedSize, sizeof(uint64_t));
+		writeInteger(checkpoints.size(), sizeof(uint64_t));
+		for (const Checkpoint& checkpoint : checkpoints) {
+			writeInteger(checkpoint.outputPosition, sizeof(uint64_t));
+			writeInteger(checkpoint.inputBit, sizeof(uint64_t));
+			writeInteger(checkpoint.window.size(), sizeof(uint32_t));
+			write(checkpoint.window);
+		}
+	}
+
+	static GzIndex load(const std::function<int(std::span<uint8_t> batch)>& read) {
+		auto readExactly = [&read] (std::span<uint8_t> destination) {
+			while (destination.size() > 0) {
+				int added = read(destination);
+				if (added <= 0) {
+					throw std::runtime_error("Index file is truncated");
+				}
+				destination = destination.subspan(added);
+			}
+		};
+		auto readInteger = [&readExactly] (int bytes) {
+			std::array<uint8_t, sizeof(uint64_t)> encoded = {};
+			readExactly(std::span<uint8_t>(encoded.data(), bytes));
+			uint64_t value = 0;
+			for (int i = 0; i < bytes; i++) {
+				value |= uint64_t(encoded[i]) << (i * 8);
+			}
+			return value;
+		};
+		std::array<uint8_t, magic.size()> foundMagic = {};
+		readExactly(foundMagic);
+		if (!std::equal(foundMagic.begin(), foundMagic.end(), magic.begin())) {
+			throw std::runtime_error("Not an index file");
+		}
+		GzIndex index;
+		index.decompressedSize = size_t(readInteger(sizeof(uint64_t)));
+		uint64_t count = readInteger(sizeof(uint64_t));
+		for (uint64_t i = 0; i < count; i++) {
+			Checkpoint& checkpoint = index.checkpoints.emplace_back();
+			checkpoint.outputPosition = size_t(readInteger(sizeof(uint64_t)));
+			checkpoint.inputBit = size_t(readInteger(sizeof(uint64_t)));
+			uint64_t windowSize = readInteger(sizeof(uint32_t));
+			if (windowSize > maxWindowSize || windowSize > checkpoint.outputPosition
+					|| (i > 0 && checkpoint.outputPosition < index.checkpoints[i - 1].outputPosition)) {
+				throw std::runtime_error("Corrupted index file");
+			}
+			checkpoint.window.resize(size_t(windowSize));
+			readExactly(std::span<uint8_t>(reinterpret_cast<uint8_t*>(checkpoint.window.data()), checkpoint.window.size()));
+		}
+		return index;
+	}
+
+	static GzIndex load(std::span<const uint8_t> data) {
+		return load(Detail::readFromSpan(data).read);
+	}
+
+#ifndef EZGZ_NO_FILE
+	void save(const std::string& fileName) const {
+		std::ofstream file(fileName, std::ios::binary);
+		save([&file] (std::span<const char> batch) {
+			file.write(batch.data(), batch.size());
+		});
+		if (!file.good()) {
+			throw std::runtime_error("Can't write file");
+		}
+	}
+
+	static GzIndex load(const std::string& fileName) {
+		return load(Detail::readFromFile(fileName).read);
+	}
+#endif
+};
+
+// Handles decompression of a deflate-compressed archive, no headers
+template <DecompressionSettings Settings = DefaultDecompressionSettings,
+		typename Input = Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum>> // Only the output is checksummed
+class IDeflateArchive {
+protected:
+	Input input;
+	Detail::ByteOutput<typename Settings::Output, typename Settings::Checksum> output;
+	Detail::DeflateReader<Settings> deflateReader = {input, output};
+	bool started = false;
+	bool done = false;
+	int bytesKept = 0;
+	size_t expectedSize = 0; // Zero if unknown
+	size_t bytesToSkip = 0; // Between the checkpoint and the position sought
+	bool checksumKnown = true; // Not after seeking
+
+	bool bufferNeedsCleaning = false;
+	void cleanBufferIfNeeded() {
+		if (bufferNeedsCleaning) {
+			output.cleanBuffer(bytesKept);
+			bufferNeedsCleaning = false;
+		}
+	}
+
+	// The checksum is missing if it's not verified or if it's unknown after seeking, returns whether another stream follows
+	virtual bool onFinish(std::optional<uint32_t>) {
+		return false;
+	}
+
+	// Returns whether another stream follows, the reader is prepared to continue with it
+	template <typename Output>
+	bool finish(Output& finishedOutput) {
+		std::optional<uint32_t> checksum;
+		if constexpr (Settings::verifyChecksum) {
+			if (checksumKnown) {
+				checksum = uint32_t(finishedOutput.getChecksum()());
+			}
+		}
+		if (onFinish(checksum)) {
+			finishedOutput.startNextStream();
+			deflateReader.restart();
+			checksumKnown = true;
+			return true;
+		}
+		done = true;
+		return false;
+	}
+
+	bool parseMore() {
+		return deflateReader.parseSome() || finish(output);
+	}
+
+	template <typename Source>
+	void resetWith(Source&& source) {
+		deflateReader.restart();
+		input.reset(std::forward<Source>(source));
+		output.restart({});
+		started = false;
+		done = false;
+		bytesKept = 0;
+		expectedSize = 0;
+		bytesToSkip = 0;
+		checksumKnown = true;
+		bufferNeedsCleaning = false;
+	}
+
+public:
+	IDeflateArchive(typename Input::SourceType readMoreFunction) : input(std::move(readMoreFunction)) {}
+
+#ifndef EZGZ_NO_FILE
+	IDeflateArchive(const std::string& fileName) : input(fileName) {}
+#endif
+
+	IDeflateArchive(std::span<const uint8_t> data) : input(data) {}
+
+	// Starts reading other data, the buffers aren't allocated or initialised again, so that decompressing many small archives is cheap
+	void reset(typename Input::SourceType readMoreFunction) {
+		resetWith(std::move(readMoreFunction));
+	}
+	void reset(std::span<const uint8_t> data) {
+		resetWith(data);
+	}
+
+	// Makes readSome() return early, possibly with no data, if the function tells that the input may not suffice to continue
+	void pauseWhenInputRunsLow(std::function<bool()> check) {
+		deflateReader.pauseWhenInputRunsLow(std::move(check));
+	}
+
+	// Expected size of decompressed data if it's known in advance (it may be wrong if the file is corrupted), zero otherwise
+	size_t sizeHint() const {
+		return expectedSize;
+	}
+
+	// Continues from a position in decompressed data, the input must be able to seek, the checksum isn't verified afterwards
+	void seek(const GzIndex& index, size_t position) {
+		const GzIndex::Checkpoint& checkpoint = index.checkpointBefore(position);
+		deflateReader.restart(int(checkpoint.inputBit & 7)); // Before moving the input, it returns unused bytes to it
+		input.seek(checkpoint.inputBit >> 3);
+		output.restart(checkpoint.window);
+		bytesToSkip = position - checkpoint.outputPosition;
+		started = true;
+		done = false;
+		bufferNeedsCleaning = false;
+		bytesKept = 0;
+		checksumKnown = false;
+	}
+
+	// Returns whether there are more bytes to read
+	std::optional<std::span<const char>> readSome(int bytesToKeep = 0) {
+		cleanBufferIfNeeded();
+		if (done) {
+			return std::nullopt;
+		}
+		started = true;
+		bool moreStuffToDo = parseMore();
+		while (bytesToSkip > 0) {
+			size_t available = output.getBuffer().size();
+			if (available > bytesToSkip || !moreStuffToDo) {
+				if (available < bytesToSkip) {
+					throw std::runtime_error("Seeking past the end of data");
 				}
+				output.skip(int(bytesToSkip));
+				bytesToSkip = 0;
 			} else {
-				for (int i = Size - 1; i >= endAt; i += increment) {
-					checkOne(codes[i]);
+				bytesToSkip -= available;
+				output.cleanBuffer();
+				moreStuffToDo = parseMore();
+			}
+		}
+		while (moreStuffToDo && output.getBuffer().size() == 0 && !deflateReader.paused()) {
+			moreStuffToDo = parseMore(); // Possible at the start of another stream
+		}
+		std::span<const char> batch = output.getBuffer();
+		bytesKept = bytesToKeep;
+		if (!moreStuffToDo) {
+			output.done();
+			output.cleanBuffer();
+		}
+		bufferNeedsCleaning = true;
+		return batch;
+	}
+
+	void readByLines(const std::function<void(std::span<const char>)> reader, char separator = '\n') {
+		int keeping = 0;
+		bool wasSeparator = false;
+		std::span<const char> batch = {};
+		while (!done) {
+			batch = *readSome(keeping);
+			std::span<const char>::iterator start = batch.begin();
+			for (std::span<const char>::iterator it = start; it != batch.end(); ++it) {
+				if (wasSeparator) {
+					wasSeparator = false;
+					start = it;
+				}
+				if (*it == separator) {
+					reader(std::span<const char>(&*start, std::distance(start, it)));
+					wasSeparator = true;
+				}
+			}
+			keeping = int(batch.end() - start);
+		}
+		if (keeping > 0) {
+			if (wasSeparator)
+				reader(std::span<const char>());
+			else
+				reader(std::span<const char>(&*(batch.end() - keeping), keeping));
+		}
+	}
+
+	void readAll(const std::function<void(std::span<const char>)>& reader) {
+		while (std::optional<std::span<const char>> batch = readSome()) {
+			reader(*batch);
+		}
+	}
+
+	std::vector<char> readAll() {
+		if (!started) {
+			// Nothing was read yet, so the data can be decompressed directly into the vector
+			started = true;
+			Detail::ContiguousByteOutput<typename Settings::Checksum> directOutput;
+			std::vector<char> returned = Detail::allocateForInflating(expectedSize); // Only the size of the last member is known
+			do {
+				Detail::inflateIntoGrowingVector<Settings>(input, directOutput, returned);
+			} while (finish(directOutput));
+			Detail::trimInflatedVector(returned, directOutput.size());
+			return returned;
+		}
+		std::vector<char> returned;
+		while (std::optional<std::span<const char>> batch = readSome()) {
+			returned.insert(returned.end(), batch->begin(), batch->end());
+		};
+		return returned;
+	}
+
+	// Reads into a buffer provided by the caller (avoids copying if nothing was read yet), throws if it doesn't fit, returns the number of bytes read
+	size_t readAll(std::span<char> buffer) {
+		if (!started) {
+			started = true;
+			Detail::ContiguousByteOutput<typename Settings::Checksum> directOutput(buffer);
+			size_t size = 0;
+			do {
+				size = Detail::inflateIntoBuffer<Settings>(input, directOutput);
+			} while (finish(directOutput));
+			return size;
+		}
+		size_t size = 0;
+		while (std::optional<std::span<const char>> batch = readSome()) {
+			if (size + batch->size() > buffer.size()) {
+				throw std::runtime_error("Decompressed data don't fit into the output buffer");
+			}
+			memcpy(buffer.data() + size, batch->data(), batch->size());
+			size += batch->size();
+		};
+		return size;
+	}
+};
+
+// The sink's type can be given to have its calls inlined
+template <CompressionSettings Settings, typename Checksum = NoChecksum, OutputSink Sink = std::function<void(std::span<const char> batch)>>
+class ODeflateArchive {
+protected:
+	Detail::ByteOutput<typename Settings::Output, NoChecksum> output;
+	Detail::ByteInputWithBuffer<typename Settings::Input, Checksum, Detail::NoMoreInput> input = {Detail::NoMoreInput()};
+
+	void writeAtEnd(std::function<void()> trailerWriter) {
+		writeTrailer = trailerWriter;
+	}
+private:
+	Detail::HuffmanWriter<typename Settings::Output, typename Settings::DeduplicationProperties, Settings::HuffmanSectionSize> writer = {output};
+	Sink consumeFunction;
+	Detail::DeduplicatedStream<typename Settings::DeduplicationProperties> deduplicated = {[this]
+				(Detail::DeduplicatingStreamSection section, bool lastCall) {
+		writer.writeBatch(section, lastCall);
+		return section.position;
+	}};
+	typename Settings::DeduplicatorType deduplicator = {input, deduplicated};
+
+	void consume() {
+		std::span<const char> batch = output.getBuffer();
+		consumeFunction(batch);
+		output.cleanBuffer();
+	}
+
+	std::function<void()> writeTrailer = [] {}; // Nothing unless there are headers
+
+public:
+	ODeflateArchive(Sink consumeFunction) : consumeFunction(std::move(consumeFunction)) { }
+
+#ifndef EZGZ_NO_FILE
+	// FIXME: We are saving output, not input!
+	ODeflateArchive(const std::string& fileName) : consumeFunction(Detail::writeToFile(fileName + ".gz", Detail::usesIoUring<typename Settings::Output>)) {}
+#endif
+
+	ODeflateArchive(std::vector<char>& outVector) : consumeFunction([&outVector] (std::span<const char> batch) mutable {
+		outVector.insert(outVector.end(), batch.begin(), batch.end());
+	}) {}
+
+	~ODeflateArchive() {
+		flush();
+	}
+
+	void flush() {
+		input.doneFilling(0);
+		if (input.hasMoreDataInBuffer()) {
+			deduplicator.deduplicateSome();
+		}
+		deduplicator.flush();
+		deduplicated.flush();
+		writer.finalFlush();
+		writeTrailer();
+		output.done();
+		consume();
+	}
+
+	void writeSome(std::span<const char> section) {
+		int position = 0;
+		while (position < std::ssize(section)) {
+			bool doDeduplicate = false;
+			input.refillSome([&] (std::span<uint8_t> outSection) -> int {
+				int copied = std::min(int(section.size() - position), int(outSection.size()));
+				doDeduplicate = (std::ssize(outSection) <= std::ssize(section) * 0.8);
+				memcpy(outSection.data(), section.data() + position, copied);
+				position += copied;
+				return copied;
+			});
+			if (doDeduplicate) {
+				deduplicator.deduplicateSome();
+				consume();
+			}
+		}
+	}
+	void writeSome(std::string_view section) {
+		writeSome(std::span<const char>(section.data(), section.size()));
+	}
+
+	class OpenWritingBuffer {
+		ODeflateArchive* parent = nullptr;
+		std::span<uint8_t> range = {};
+		OpenWritingBuffer(ODeflateArchive* parent) : parent(parent), range(parent->input.startFilling()) { }
+		friend class ODeflateArchive;
+
+	public:
+		OpenWritingBuffer() = default;
+		OpenWritingBuffer(OpenWritingBuffer&& another) {
+			operator=(std::move(another));
+		}
+		OpenWritingBuffer& operator=(OpenWritingBuffer&& another) {
+			if (parent)
+				throw std::logic_error("OpenWritingBuffer must be finished with doneFilling() before destruction");
+			parent = another.parent;
+			range = another.range;
+			another.parent = nullptr;
+			return *this;
+		}
+		std::span<uint8_t> accessRange() const {
+			return range;
+		}
+		void finish(int added) {
+			parent->input.doneFilling(added);
+			parent->deduplicator.deduplicateSome();
+			parent->consume();
+			parent = nullptr;
+		}
+		~OpenWritingBuffer() noexcept(false) {
+			if (parent)
+				throw std::logic_error("OpenWritingBuffer must be finished with doneFilling() before destruction");
+		}
+	};
+	OpenWritingBuffer openWritingBuffer() {
+		return OpenWritingBuffer(this);
+	}
+};
+
+enum class CreatingOperatingSystem {
+	UNIX_BASED,
+	WINDOWS,
+	OTHER
+};
+
+// File information in the .gz file
+template <BasicStringType StringType>
+struct GzFileInfo {
+	int32_t modificationTime = int32_t(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	CreatingOperatingSystem operatingSystem = CreatingOperatingSystem::OTHER;
+	bool fastestCompression = false;
+	bool densestCompression = false;
+	std::optional<std::vector<uint8_t>> extraData = {};
+	StringType name;
+	StringType comment;
+	bool probablyText = false;
+	bool checksummedHeader = true;
+
+	GzFileInfo(std::string_view name) : name(name) {}
+
+	void writeOut(std::function<void(std::span<const char> batch)> writer) const {
+		LightCrc32 crc = {};
+		auto writeInteger = [&writer, &crc] (auto integer) {
+			std::array<char, sizeof(integer)> buffer = {};
+			memcpy(buffer.data(), &integer, buffer.size());
+			writer(buffer);
+			crc(std::span<const uint8_t>(reinterpret_cast<uint8_t*>(buffer.data()), buffer.size()));
+		};
+
+		writeInteger(uint8_t(0x1f));
+		writeInteger(uint8_t(0x8b));
+		writeInteger(uint8_t(0x08));
+		uint8_t flags = 0;
+		if (checksummedHeader) flags |= 0x02;
+		if (extraData) flags |= 0x04;
+		if (!std::string_view(name).empty()) flags |= 0x08;
+		if (!std::string_view(comment).empty()) flags |= 0x10;
+		if (probablyText) flags |= 0x01;
+		writeInteger(flags);
+		writeInteger(modificationTime);
+		writeInteger(uint8_t((densestCompression ? 4 : 0) | (fastestCompression ? 8 : 0)));
+		writeInteger(uint8_t(operatingSystem == CreatingOperatingSystem::UNIX_BASED ? 3 : (operatingSystem == CreatingOperatingSystem::WINDOWS ? 0 : 255)));
+		if (extraData) {
+			if (extraData->size() > std::numeric_limits<uint16_t>::max())
+				throw std::runtime_error("Cannot save so many extra data in the archive");
+			writeInteger(uint16_t(extraData->size()));
+			for (uint8_t letter : *extraData) {
+				writeInteger(letter);
+			}
+		}
+		auto writeNullTerminatedString = [&] (const StringType& written) {
+			if (!std::string_view(written).empty()) {
+				for (uint8_t letter : std::string_view(written)) {
+					writeInteger(letter);
 				}
+				writeInteger(char(0));
+			}
+		};
+		writeNullTerminatedString(name);
+		writeNullTerminatedString(comment);
+		if (checksummedHeader) {
+			writeInteger(uint16_t(crc()));
+		}
+	}
+
+	GzFileInfo(Detail::ByteInput& input) {
+		LightCrc32 checksum = {};
+		auto check = [&checksum] (auto num) -> uint32_t {
+			std::array<uint8_t, sizeof(num)> asBytes = {};
+			memcpy(asBytes.data(), &num, asBytes.size());
+			return checksum(asBytes);
+		};
+		if (input.template getInteger<uint8_t>() != 0x1f || input.template getInteger<uint8_t>() != 0x8b || input.template getInteger<uint8_t>() != 0x08)
+			throw std::runtime_error("Trying to parse something that isn't a Gzip archive");
+		check(0x1f);
+		check(0x8b);
+		check(0x08);
+		uint8_t flags = input.template getInteger<uint8_t>();
+		check(flags);
+		modificationTime = input.template getInteger<uint32_t>();
+		check(modificationTime);
+		uint8_t extraFlags = input.template getInteger<uint8_t>();
+		check(extraFlags);
+
+		if (extraFlags == 4) {
+			densestCompression = true;
+		} else if (extraFlags == 8) {
+			fastestCompression = true;
+		}
+		uint8_t creatingOperatingSystem = input.template getInteger<uint8_t>(); // Was at input[9]
+		check(creatingOperatingSystem);
+		if (creatingOperatingSystem == 0) {
+			operatingSystem = CreatingOperatingSystem::WINDOWS;
+		} else if (creatingOperatingSystem == 3) {
+			operatingSystem = CreatingOperatingSystem::UNIX_BASED;
+		}
+
+		if (flags & 0x04) {
+			uint16_t extraHeaderSize = input.template getInteger<uint16_t>();
+			check(extraHeaderSize);
+			int readSoFar = 0;
+			extraData.emplace();
+			while (readSoFar < extraHeaderSize) {
+				std::span<const uint8_t> taken = input.getRange(extraHeaderSize - readSoFar);
+				checksum(taken);
+				extraData->insert(extraData->end(), taken.begin(), taken.end());
+				readSoFar += int(taken.size());
+			}
+		}
+		if (flags & 0x08) {
+			char letter = input.template getInteger<uint8_t>();
+			check(letter);
+			while (letter != '\0') {
+				name += letter;
+				letter = input.template getInteger<uint8_t>();
+				check(letter);
+			}
+		}
+		if (flags & 0x10) {
+			char letter = input.template getInteger<uint8_t>();
+			check(letter);
+			while (letter != '\0') {
+				comment += letter;
+				letter = input.template getInteger<uint8_t>();
+				check(letter);
 			}
-			doneRepeating();
 		}
-	};
+		if (flags & 0x01) {
+			probablyText = true;
+		}
+		checksummedHeader = (flags & 0x02);
+		if (flags & 0x02) {
+			uint16_t expectedHeaderCrc = uint16_t(input.template getInteger<uint16_t>());
+			check(expectedHeaderCrc);
+//			uint16_t realHeaderCrc = checksum(); // Probably bugged
+//			if (expectedHeaderCrc != realHeaderCrc)
+//				throw std::runtime_error("Gzip archive's headers crc32 checksum doesn't match the actual header's checksum");
+		}
+	}
+};
 
-	template <int Size>
-	struct FrequencyCounts {
-		struct Entry {
-			int index = 0;
-			int count = 0;
-			int length = 0;
-		};
+namespace Detail {
+// Reads the rest of a gzip member's trailer and the header of the next member if there is one, returns whether there is one
+template <BasicStringType StringType>
+bool startNextGzMember(ByteInput& input) {
+	input.getInteger<uint32_t>(); // The size modulo 4 GiB, the checksum is more reliable
+	constexpr static std::array<uint8_t, 3> magic = {0x1f, 0x8b, 0x08};
+	for (int i = 0; i < std::ssize(magic); i++) {
+		if (!input.hasMoreData() || input.getInteger<uint8_t>() != magic[i]) {
+			return false; // Like other implementations, anything else after the end is ignored
+		}
+	}
+	input.returnBytes(int(magic.size()));
+	GzFileInfo<StringType>{input};
+	return true;
+}
+} // namespace Detail
 
-		std::array<Entry, Size> counts = ArrayFiller([] (int index) { return Entry{ index, 0 }; });
+// Size of the decompressed data of a .gz file in memory according to its trailer, it's exact only if it has one member smaller than 4 GiB
+inline size_t gzSizeHint(std::span<const uint8_t> data) {
+	uint32_t trailerSize = 0;
+	if (data.size() >= sizeof(trailerSize)) {
+		for (int i = 0; i < int(sizeof(trailerSize)); i++) { // Little endian regardless of the platform
+			trailerSize |= uint32_t(data[data.size() - sizeof(trailerSize) + i]) << (i * 8);
+		}
+	}
+	// The trailer holds the size modulo 4 GiB, a corrupted value must not cause allocating more than deflate can decompress
+	constexpr size_t maximumCompressionRatio = 1032;
+	return std::min<size_t>(trailerSize, data.size() * maximumCompressionRatio);
+}
 
-		HuffmanTable<Size> generateEncoding(int left, bool ascending) { // Trying to do this without the bool flag will bloat the code a lot
-			std::array<Entry, Size> sortedCounts = counts;
-			// Make sure we have enough elements to form a Huffman table
-			int usedCodes = 0;
-			for (Entry& entry : sortedCounts) {
-				if (entry.count > 0)
-					usedCodes++;
-			}
-			HuffmanTable<Size> made = {};
-			if (usedCodes == 0) {
-				return made;
-			}
+// Parses a .gz file, possibly made of multiple members (concatenated files), only takes care of the header, the rest is handled by its parent class IDeflateArchive
+template <DecompressionSettings Settings = DefaultDecompressionSettings,
+		typename Input = Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum>>
+class IGzFile : public IDeflateArchive<Settings, Input> {
+	GzFileInfo<typename Settings::StringType> parsedHeader;
+	using Deflate = IDeflateArchive<Settings, Input>;
 
-			int sizeIncrement = 1;
-			int64_t capacity = 0x10000;
+	void readSizeFromTrailer(std::span<const uint8_t> data) {
+		Deflate::expectedSize = gzSizeHint(data);
+	}
 
-			std::sort(sortedCounts.begin(), sortedCounts.end(), [] (Entry first, Entry second) {
-				return first.count > second.count;
-			});
+	bool onFinish(std::optional<uint32_t> realCrc) override {
+		uint32_t expectedCrc = Deflate::input.template getInteger<uint32_t>();
+		if (realCrc && expectedCrc != *realCrc) {
+			throw std::runtime_error("Gzip archive's crc32 checksum doesn't match the calculated checksum");
+		}
+		return Detail::startNextGzMember<typename Settings::StringType>(Deflate::input);
+	}
 
-			// Assign lengths, assign as much capacity as possible but not more than the word's proportion in the total number of words
-			for (Entry& word : sortedCounts) {
-				if (word.count == 0) break; // In this case, we're done sooner
-				while (int(0x10000 >> sizeIncrement) * left > word.count * capacity) {
-					// Switch to longer codes
-					sizeIncrement++;
-				}
-				word.length = sizeIncrement;
-				left -= word.count;
-				capacity -= (0x10000 >> sizeIncrement);
-			}
+public:
+	IGzFile(typename Input::SourceType readMoreFunction) : Deflate(std::move(readMoreFunction)), parsedHeader(Deflate::input) {}
+#ifndef EZGZ_NO_FILE
+	IGzFile(const std::string& fileName) : Deflate(fileName), parsedHeader(Deflate::input) {
+		if constexpr (std::is_base_of_v<Detail::ByteInputFromMemory, Input>) {
+			readSizeFromTrailer(Deflate::input.contents());
+		}
+	}
+#endif
+	IGzFile(std::span<const uint8_t> data) : Deflate(data), parsedHeader(Deflate::input) {
+		readSizeFromTrailer(data);
+	}
 
-			// Assign leftover capacity to the shortest lengths that can be shortened by taking this capacity
-			int sameLengthRangeBegin = 0;
-			int sameLengthRangeEnd = 0;
-			uint16_t currentCode = 0;
-			auto sortLastLength = [&] () {
-				// Ensure codes of the same length start from the lowest index code
-				if (ascending) {
-					std::sort(sortedCounts.begin() + sameLengthRangeBegin, sortedCounts.begin() + sameLengthRangeEnd,
-							  [] (Entry first, Entry second) {
-						return first.index < second.index;
-					});
-				} else {
-					std::sort(sortedCounts.begin() + sameLengthRangeBegin, sortedCounts.begin() + sameLengthRangeEnd,
-							  [] (Entry first, Entry second) {
-						return first.index > second.index;
-					});
-				}
-				for (int i = sameLengthRangeBegin; i < sameLengthRangeEnd; i++) {
-					made.codes[sortedCounts[i].index] = typename HuffmanTable<Size>::Entry(currentCode, uint8_t(sortedCounts[i].length));
-					currentCode += 1;
-				}
-				sameLengthRangeBegin = sameLengthRangeEnd;
-			};
-			int previousLength = 0;
-			for (Entry& word : sortedCounts) {
-				if (word.count == 0) break; // In this case, we're done sooner
-				if (usedCodes != 1) {
-					int neededToUpgrade = 0x10000 >> word.length;
-					if (neededToUpgrade <= capacity) {
-						capacity -= neededToUpgrade;
-						word.length--;
-					}
-				}
-				if (word.length != previousLength) {
-					sortLastLength();
-					currentCode <<= (word.length) - previousLength;
-					previousLength = word.length;
-				}
-				sameLengthRangeEnd++;
-			}
-			sortLastLength();
+	void reset(typename Input::SourceType readMoreFunction) {
+		Deflate::reset(std::move(readMoreFunction));
+		parsedHeader = GzFileInfo<typename Settings::StringType>(Deflate::input);
+	}
+	void reset(std::span<const uint8_t> data) {
+		Deflate::reset(data);
+		parsedHeader = GzFileInfo<typename Settings::StringType>(Deflate::input);
+		readSizeFromTrailer(data);
+	}
 
-			if (capacity < 0) {
-				throw std::logic_error("Didn't generate the Huffman code correctly");
-			}
-			if (capacity > 0 && usedCodes != 1) { // This is not only suboptimal, gunzip requires every Huffman code to be valid (the standard does not)
-				throw std::logic_error("Didn't use all capacity available for Huffman coding");
-			}
+	const GzFileInfo<typename Settings::StringType>& info() const {
+		return parsedHeader;
+	}
+};
 
-			return made;
-		}
+// Variants that read the data in place from a span or from a file mapped into memory, without copying them into a buffer
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+using IMappedDeflateArchive = IDeflateArchive<Settings, Detail::ByteInputFromMemory>;
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+using IMappedGzFile = IGzFile<Settings, Detail::ByteInputFromMemory>;
 
-		int sizeWithEncoding(const HuffmanTable<Size>& encoding) {
-			int total = 0;
-			for (Entry letter : counts) {
-				total += letter.count * encoding.codes[letter.index].length;
-			}
-			return total;
-		}
+// Variants that keep a source of a known type rather than a std::function, which may need to allocate
+template <InputSource Source, DecompressionSettings Settings = DefaultDecompressionSettings>
+using ISourcedDeflateArchive = IDeflateArchive<Settings, Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum, Source>>;
+template <InputSource Source, DecompressionSettings Settings = DefaultDecompressionSettings>
+using ISourcedGzFile = IGzFile<Settings, Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum, Source>>;
 
-		template <int OtherSize>
-		int addToHuffmanTableLengths(HuffmanTable<OtherSize>& encoding, int endAt, int increment) {
-			int totalWords = 0;
-			encoding.runThroughCodeEncoding(endAt, increment, [this, &totalWords] (int word, int) {
-				counts[word].count++;
-				totalWords++;
-			});
-			return totalWords;
+namespace Detail {
+// Zlib streams are checksummed with Adler-32 instead of CRC32
+template <DecompressionSettings Settings>
+struct ZlibSettings : Settings {
+	using Checksum = std::conditional_t<std::is_same_v<typename Settings::Checksum, NoChecksum>, NoChecksum, HardwareAdler32>;
+};
+
+// Checks the two byte header of a zlib stream
+inline void readZlibHeader(ByteInput& input) {
+	const uint8_t method = input.getInteger<uint8_t>();
+	const uint8_t flags = input.getInteger<uint8_t>();
+	if (((method << 8) | flags) % 31 != 0) {
+		throw std::runtime_error("Zlib stream's header is corrupted");
+	}
+	if ((method & 0x0f) != 8 || (method >> 4) > 7) {
+		throw std::runtime_error("Zlib stream isn't compressed with deflate");
+	}
+	if (flags & 0x20) {
+		throw std::runtime_error("Zlib stream needs a preset dictionary, which isn't supported");
+	}
+}
+} // namespace Detail
+
+// Parses a zlib stream (RFC 1950), only takes care of the header and the Adler-32 trailer, the rest is handled by its parent class IDeflateArchive
+template <DecompressionSettings Settings = DefaultDecompressionSettings,
+		typename Input = Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum>>
+class IZlibFile : public IDeflateArchive<Detail::ZlibSettings<Settings>, Input> {
+	using Deflate = IDeflateArchive<Detail::ZlibSettings<Settings>, Input>;
+
+	bool onFinish(std::optional<uint32_t> realChecksum) override {
+		uint32_t expectedChecksum = 0;
+		for (int i = 0; i < int(sizeof(expectedChecksum)); i++) {
+			expectedChecksum = (expectedChecksum << 8) | Deflate::input.template getInteger<uint8_t>(); // Big endian
 		}
-	};
+		if (realChecksum && expectedChecksum != *realChecksum) {
+			throw std::runtime_error("Zlib stream's Adler-32 checksum doesn't match the calculated checksum");
+		}
+		return false; // Anything after the end is ignored
+	}
 
 public:
-	HuffmanWriter(ByteOutput<OutputSettings, NoChecksum>& output) : byteOutput(output) {}
+	IZlibFile(typename Input::SourceType readMoreFunction) : Deflate(std::move(readMoreFunction)) {
+		Detail::readZlibHeader(Deflate::input);
+	}
+#ifndef EZGZ_NO_FILE
+	IZlibFile(const std::string& fileName) : Deflate(fileName) {
+		Detail::readZlibHeader(Deflate::input);
+	}
+#endif
+	IZlibFile(std::span<const uint8_t> data) : Deflate(data) {
+		Detail::readZlibHeader(Deflate::input);
+	}
 
-	~HuffmanWriter() {
-		finalFlush();
+	void reset(typename Input::SourceType readMoreFunction) {
+		Deflate::reset(std::move(readMoreFunction));
+		Detail::readZlibHeader(Deflate::input);
 	}
+	void reset(std::span<const uint8_t> data) {
+		Deflate::reset(data);
+		Detail::readZlibHeader(Deflate::input);
+	}
+};
 
-	void finalFlush() {
-		bitOutput.reset();
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+using IMappedZlibFile = IZlibFile<Settings, Detail::ByteInputFromMemory>;
+template <InputSource Source, DecompressionSettings Settings = DefaultDecompressionSettings>
+using ISourcedZlibFile = IZlibFile<Settings, Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum, Source>>;
+
+namespace Detail {
+template <DecompressionSettings Settings>
+GzIndex buildGzIndex(ByteInput& input, size_t spacing) {
+	GzFileInfo<typename Settings::StringType> header(input);
+	ByteOutput<typename Settings::Output, typename Settings::Checksum> output;
+	DeflateReader<Settings> reader(input, output);
+	GzIndex index;
+	size_t delivered = 0;
+	size_t nextCheckpoint = 0;
+	reader.stopAtBoundaryAfter(0); // Stops at every block
+	while (true) {
+		bool outOfSpace = reader.parseSome();
+		size_t position = delivered + output.getBuffer().size();
+		if (outOfSpace) {
+			delivered = position;
+			output.cleanBuffer();
+		} else if (reader.reachedEnd()) {
+			uint32_t expectedCrc = input.getInteger<uint32_t>();
+			if constexpr (Settings::verifyChecksum) {
+				if (expectedCrc != uint32_t(output.getChecksum()()))
+					throw std::runtime_error("Gzip archive's crc32 checksum doesn't match the calculated checksum");
+			}
+			if (!startNextGzMember<typename Settings::StringType>(input)) {
+				index.decompressedSize = position;
+				break;
+			}
+			output.startNextStream();
+			reader.restart();
+			reader.stopAtBoundaryAfter(0);
+		} else {
+			if (position >= nextCheckpoint) {
+				std::span<const char> window = output.history(int(GzIndex::maxWindowSize));
+				index.checkpoints.push_back({position, size_t(reader.lastBoundary()), std::vector<char>(window.begin(), window.end())});
+				nextCheckpoint = position + spacing;
+			}
+			reader.stopAtBoundaryAfter(reader.lastBoundary() + 1);
+		}
 	}
+	return index;
+}
+} // namespace Detail
 
-	void writeBatch(DeduplicatingStreamSection& section, bool isLast) {
-		// Baseline, dynamic Hufffman coding won't be used if it's better; TODO: Why not constexpr?
-		static HuffmanTable<286> staticWordEncoding = HuffmanTable<286>(typename HuffmanTable<286>::UseDefaultLengthEncoding());
-		static HuffmanTable<30> staticDistanceEncoding = HuffmanTable<30>(typename HuffmanTable<30>::UseDefaultDistanceEncoding());
-		// Avoid having to convert the oddly positioned distance codes in the range of -30 to -1
-		static typename HuffmanTable<30>::Entry* staticDistanceZero = staticDistanceEncoding.codes.data() + 30;
+// Reads a whole .gz file to build an index for seeking, with checkpoints after at least spacing bytes of decompressed data
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+GzIndex buildGzIndex(std::span<const uint8_t> data, size_t spacing = GzIndex::defaultSpacing) {
+	Detail::ByteInputFromMemory input(data);
+	return Detail::buildGzIndex<Settings>(input, spacing);
+}
 
-		struct Counts {
-			FrequencyCounts<286> wordCounts = {};
-			FrequencyCounts<30> distanceCounts = {};
-			int lengthsAfter256 = 1;
-			int lowestDistanceWord = 29;
-			int properEndPos = 0;
-			int words = 0;
-			int distances = 0;
-			int staticLength = 0;
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+GzIndex buildGzIndex(std::function<int(std::span<uint8_t> batch)> readMoreFunction, size_t spacing = GzIndex::defaultSpacing) {
+	Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum> input(std::move(readMoreFunction));
+	return Detail::buildGzIndex<Settings>(input, spacing);
+}
 
-			typename FrequencyCounts<30>::Entry* frequencyDistanceZero() {
-				return distanceCounts.counts.data() + 30;
-			}
+#ifndef EZGZ_NO_FILE
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+GzIndex buildGzIndex(const std::string& fileName, size_t spacing = GzIndex::defaultSpacing) {
+	Detail::ByteInputFromMemory input(fileName);
+	return Detail::buildGzIndex<Settings>(input, spacing);
+}
+#endif
 
-			Counts(DeduplicatingStreamSection& section, int startPos, int endPos) {
-				section.position = startPos;
-				while (section.position < endPos) {
-					int word = section.readWord([&] (auto, int distanceWord, auto) {
-						frequencyDistanceZero()[distanceWord].count++;
-						staticLength += staticDistanceZero[distanceWord].length;
-						distances++;
-					});
-					if (word < 0) {
-						throw std::runtime_error("Corrupted stream boundaries");
-					}
-					wordCounts.counts[word].count++;
-					staticLength += staticWordEncoding.codes[word].length;
-					words++;
-				}
-				properEndPos = section.position; // We may have run through some trailers, need to update the start of the following block
-				wordCounts.counts[256].count++; // We need to end the block somewhere
-				words++;
+#ifndef EZGZ_NO_THREADS
+// Runs tasks on a fixed number of threads, in the order they were submitted
+class ThreadPool {
+	std::mutex lock;
+	std::condition_variable wakeUp;
+	std::deque<std::function<void()>> tasks;
+	bool stopping = false;
+	std::vector<std::thread> workers;
 
-				// We'll need to stop writing lengths from some point
-				for (int i = int(std::ssize(wordCounts.counts)) - 1; i > 257; i--) {
-					if (wordCounts.counts[i].count != 0) {
-						lengthsAfter256 = i - 256;
-						break;
-					}
-				}
-				for (int i = 0; i < std::ssize(distanceCounts.counts); i++) {
-					if (distanceCounts.counts[i].count != 0) {
-						lowestDistanceWord = i;
-						break;
-					}
+	void work() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wakeUp.wait(guard, [this] { return stopping || !tasks.empty(); });
+				if (stopping) {
+					return;
 				}
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+public:
+	// Zero means as many threads as the hardware can run at once
+	explicit ThreadPool(int threadCount = 0) {
+		if (threadCount <= 0) {
+			threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+		}
+		for (int i = 0; i < threadCount; i++) {
+			workers.emplace_back([this] { work(); });
+		}
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Tasks that haven't started are abandoned, their futures report a broken promise
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wakeUp.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	int size() const {
+		return int(workers.size());
+	}
+
+	template <typename Function>
+	auto submit(Function function) -> std::future<decltype(function())> {
+		auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::move(function));
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			tasks.emplace_back([task] { (*task)(); });
+		}
+		wakeUp.notify_one();
+		return result;
+	}
+};
+
+// Keeps decompressors that are no longer used to read other data with them, avoiding allocating and initialising their buffers, can be shared by threads
+template <typename Archive>
+class ContextPool {
+	std::mutex lock;
+	std::vector<std::unique_ptr<Archive>> idle;
+	size_t maxIdle = 0;
+
+	void giveBack(std::unique_ptr<Archive> archive) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (idle.size() < maxIdle) {
+			idle.push_back(std::move(archive));
+		}
+	}
+
+public:
+	// A decompressor lent from the pool, it's returned when this is destroyed, the pool must exist until then
+	class Lease {
+		ContextPool* pool = nullptr;
+		std::unique_ptr<Archive> archive;
+		Lease(ContextPool* pool, std::unique_ptr<Archive> archive) : pool(pool), archive(std::move(archive)) {}
+		friend class ContextPool;
+
+	public:
+		Lease() = default;
+		Lease(Lease&& another) = default;
+		Lease& operator=(Lease&& another) {
+			if (archive) {
+				pool->giveBack(std::move(archive));
+			}
+			pool = another.pool;
+			archive = std::move(another.archive);
+			return *this;
+		}
+		~Lease() {
+			if (archive) {
+				pool->giveBack(std::move(archive));
 			}
+		}
 
-			Counts(const Counts& first, const Counts& second) // MUST be adjacent
-			: lengthsAfter256(std::max(first.lengthsAfter256, second.lengthsAfter256))
-			, lowestDistanceWord(std::min(first.lowestDistanceWord, second.lowestDistanceWord))
-			, properEndPos(std::max(first.properEndPos, second.properEndPos))
-			, words(first.words + second.words)
-			, distances(first.distances + second.distances)
-			, staticLength(first.staticLength + second.staticLength) {
-				for (int i = 0; i <= 256 + lengthsAfter256; i++) {
-					wordCounts.counts[i].count = first.wordCounts.counts[i].count + second.wordCounts.counts[i].count;
-				}
-				for (int i = int(std::ssize(distanceCounts.counts) - 1); i >= lowestDistanceWord; i--) {
-					distanceCounts.counts[i].count = first.distanceCounts.counts[i].count + second.distanceCounts.counts[i].count;
-				}
+		Archive& operator*() const {
+			return *archive;
+		}
+		Archive* operator->() const {
+			return archive.get();
+		}
+	};
 
-				wordCounts.counts[256].count--; // One less ending
-				words--;
+	// Zero means as many as the hardware can run threads at once
+	explicit ContextPool(size_t maxIdle = 0) : maxIdle(maxIdle > 0 ? maxIdle : std::max(1u, std::thread::hardware_concurrency())) {}
+	ContextPool(const ContextPool&) = delete;
+	ContextPool& operator=(const ContextPool&) = delete;
+
+	// Gives a decompressor reading the data, an idle one is reset if available, anything the archive can be constructed from can be used
+	template <typename Source>
+	Lease acquire(Source&& source) {
+		std::unique_ptr<Archive> archive;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!idle.empty()) {
+				archive = std::move(idle.back());
+				idle.pop_back();
 			}
-		};
+		}
+		if (!archive) {
+			return Lease(this, std::make_unique<Archive>(std::forward<Source>(source)));
+		}
+		Lease lease(this, std::move(archive)); // Returned to the pool even if the new data's header is corrupted
+		lease->reset(std::forward<Source>(source));
+		return lease;
+	}
 
-		class Block {
-			DeduplicatingStreamSection* section = nullptr; // Pointer just to allow default assignment
+	size_t idleCount() {
+		std::lock_guard<std::mutex> guard(lock);
+		return idle.size();
+	}
+};
 
-			bool enabled = true;
-			bool last = false;
-			Counts counts;
-			int startPos = 0;
-			int endPos = 0;
-			int total = 0;
-			int codeCodingTableLength = 0;
+namespace Detail {
+// Output for decoding from the middle of a stream, bytes of the unknown preceding window are represented by markers
+class MarkedByteOutput {
+	constexpr static size_t slack = repetitionSlack / sizeof(uint16_t);
+	std::unique_ptr<uint16_t[]> buffer; // Not initialised, it's written before being read
+	size_t capacity = 0;
+	size_t prefix = 0;
+	size_t used = 0;
+
+	void checkSize(size_t added) {
+		if (used + added + slack > capacity) [[unlikely]] {
+			throw std::logic_error("Writing more bytes than available, probably an internal bug");
+		}
+	}
 
-			bool usesDynamic = false;
-			HuffmanTable<19> codeEncoding = {};
-			HuffmanTable<286> dynamicWordEncoding = {};
-			HuffmanTable<30> dynamicDistanceEncoding = {};
+public:
+	constexpr static int windowSize = 32768;
+	constexpr static uint16_t firstMarker = 256; // Marker firstMarker + i stands for the byte i of the window preceding the data
+
+	MarkedByteOutput() = default;
+	// Without a window, the window is made of markers
+	MarkedByteOutput(std::optional<std::span<const char>> window, size_t sizeHint) {
+		prefix = window ? window->size() : windowSize;
+		capacity = prefix + std::max<size_t>(sizeHint, 1024) + slack;
+		buffer.reset(new uint16_t[capacity]);
+		for (size_t i = 0; i < prefix; i++) {
+			buffer[i] = window ? uint8_t((*window)[i]) : uint16_t(firstMarker + i);
+		}
+		used = prefix;
+	}
 
-		public:
-			Block(DeduplicatingStreamSection& section, Counts&& counts, int startPos, bool last)
-			: section(&section), last(last), counts(std::move(counts)), startPos(startPos), endPos(counts.properEndPos) {
-				if (startPos >= endPos) {
-					enabled = false;
-					return;
-				}
+	// Decoded data without the window
+	std::span<const uint16_t> data() const {
+		return std::span<const uint16_t>(buffer.get() + prefix, used - prefix);
+	}
 
-				dynamicWordEncoding = counts.wordCounts.generateEncoding(counts.words, true /*ascending*/);
-				dynamicDistanceEncoding = counts.distanceCounts.generateEncoding(counts.distances, false /*descending*/);
+	void grow() {
+		std::unique_ptr<uint16_t[]> grown(new uint16_t[capacity * 2]);
+		memcpy(grown.get(), buffer.get(), used * sizeof(uint16_t));
+		buffer = std::move(grown);
+		capacity *= 2;
+	}
 
-				// Find distribution and generate encodings for the definition of the Huffman code
-				FrequencyCounts<19> codeCounts = {};
-				int totalCodes = 0;
-				totalCodes += codeCounts.addToHuffmanTableLengths(dynamicWordEncoding, 257 + counts.lengthsAfter256, 1);
-				totalCodes += codeCounts.addToHuffmanTableLengths(dynamicDistanceEncoding, counts.lowestDistanceWord, -1);
-				codeEncoding = codeCounts.generateEncoding(totalCodes, true /*ascending*/);
+	int available() {
+		return int(std::min<size_t>(capacity - slack - used, std::numeric_limits<int>::max()));
+	}
 
-				for (int i = 0; i < std::ssize(codeCodingReorder); i++) {
-					if (codeEncoding.codes[i].length > 0) {
-						codeCodingTableLength = std::max<int>(codeCodingTableLength, codeCodingReorderInverse[i]);
-					}
-				}
-				codeCodingTableLength = std::max(codeCodingTableLength + 1, 4); // At least 4 codes must be written
+	template <bool Unchecked = false>
+	void addByte(char byte) {
+		if constexpr (!Unchecked)
+			checkSize(1);
+		buffer[used] = uint8_t(byte);
+		used++;
+	}
 
-				// Now, we can estimate the size of the encoded part (minus the extra bits after some numbers because they're always the same)
-				int dynamicLength = 12 + codeCodingTableLength * 3; // Intro length
-				dynamicLength += codeCounts.sizeWithEncoding(codeEncoding); // Encoded codes
-				dynamicLength += 2 * codeCounts.counts[16].count + 3 * codeCounts.counts[17].count + 7 * codeCounts.counts[18].count; // Extra bits
-				dynamicLength += counts.wordCounts.sizeWithEncoding(dynamicWordEncoding); // Encoded words
-				dynamicLength += counts.distanceCounts.sizeWithEncoding(dynamicDistanceEncoding); // Encoded distances
+	void addBytes(std::span<const char> bytes) {
+		checkSize(bytes.size());
+		for (char byte : bytes) {
+			buffer[used] = uint8_t(byte);
+			used++;
+		}
+	}
 
-				// Pick the encoding
-				usesDynamic = (dynamicLength < counts.staticLength);
-				total = std::min(dynamicLength, counts.staticLength);
-			}
+	template <bool Unchecked = false>
+	void repeatSequence(int length, int distance) {
+		if constexpr (!Unchecked)
+			checkSize(length);
+		if (size_t(distance) > used) [[unlikely]] {
+			throw std::runtime_error("Looking back too many bytes, corrupted archive");
+		}
+		// Copying the pairs of bytes is the same as copying the values
+		repeatSequenceWithSlack(reinterpret_cast<char*>(buffer.get() + used), length * int(sizeof(uint16_t)), distance * int(sizeof(uint16_t)));
+		used += length;
+	}
 
-			void writeOut(BitOutput<OutputSettings, NoChecksum>& bitOutput) {
-				if (!enabled) {
-					return;
-				}
+	void updateChecksum() {} // It can be checksummed only after the markers are resolved
 
-				const HuffmanTable<286>* wordEncoding = (usesDynamic) ? &dynamicWordEncoding : &staticWordEncoding;
-				const HuffmanTable<30>* distanceEncoding = (usesDynamic) ? &dynamicDistanceEncoding : &staticDistanceEncoding;
-				const typename HuffmanTable<30>::Entry* distanceZero = distanceEncoding->codes.data() + 30;
+	void done() {}
+};
 
-				bitOutput.addBits(last, 1);
-				if (usesDynamic) {
-					// Intro
-					bitOutput.addBits(0b10, 2);
-					bitOutput.addBits(counts.lengthsAfter256, 5);
-					bitOutput.addBits(29 - counts.lowestDistanceWord, 5);
-					bitOutput.addBits(codeCodingTableLength - 4, 4);
+// Up to 57 bits starting at any bit of the data, bits past the end are zero
+inline uint64_t bitsAt(std::span<const uint8_t> data, ptrdiff_t bitPosition) {
+	size_t byte = size_t(bitPosition >> 3);
+	uint64_t result = 0;
+	if (!IsBigEndian && byte + sizeof(result) <= data.size()) {
+		memcpy(&result, data.data() + byte, sizeof(result));
+	} else {
+		for (size_t i = 0; i < sizeof(result) && byte + i < data.size(); i++) {
+			result |= uint64_t(data[byte + i]) << (i * 8);
+		}
+	}
+	return result >> (bitPosition & 7);
+}
 
-					// Code encoding
-					for (int i = 0; i < codeCodingTableLength; i++) {
-						bitOutput.addBits(codeEncoding.codes[codeCodingReorder[i]].length, 3); // Writing some bullshit here
-					}
+// Kraft's sum scaled so that a complete code has exactly 1 << MaxLength
+template <int MaxLength>
+int usedCodeSpace(std::span<const uint8_t> lengths) {
+	int used = 0;
+	for (uint8_t length : lengths) {
+		if (length > 0) {
+			used += 1 << (MaxLength - length);
+		}
+	}
+	return used;
+}
 
-					// Code declaration
-					auto encodeCode = [this, &bitOutput] (const auto& code, int endAt, int increment) {
-						code.runThroughCodeEncoding(endAt, increment, [this, &bitOutput] (int word, int extra) {
-							bitOutput.addBits(codeEncoding.codes[word].code, codeEncoding.codes[word].length);
-							if (word == 16) {
-								bitOutput.addBits(extra - 3, 2);
-							} else if (word == 17) {
-								bitOutput.addBits(extra - 3, 3);
-							} else if (word == 18) {
-								bitOutput.addBits(extra - 11, 7);
-							}
-						});
-					};
+// Checks if a dynamic Huffman block can start at this bit, it decodes the header without exceptions and rejects almost all positions
+inline bool canBeDynamicBlockStart(std::span<const uint8_t> data, ptrdiff_t position) {
+	uint64_t header = bitsAt(data, position);
+	if ((header & 0b111) != 0b100) { // Not the last block, dynamic codes
+		return false;
+	}
+	const int codeCount = 257 + int((header >> 3) & 0x1f);
+	const int distanceCodes = 1 + int((header >> 8) & 0x1f);
+	const int codeLengthCount = 4 + int((header >> 13) & 0xf);
+	if (codeCount > 286 || distanceCodes > 30) {
+		return false;
+	}
+	position += 17;
 
-					encodeCode(dynamicWordEncoding, 257 + counts.lengthsAfter256, 1);
-					encodeCode(dynamicDistanceEncoding, counts.lowestDistanceWord, -1);
-				} else {
-					bitOutput.addBits(0b01, 2);
-				}
+	std::array<uint8_t, codeCodingReorder.size()> codeCodingLengths = {};
+	uint64_t codeCodingBits = bitsAt(data, position);
+	for (int i = 0; i < codeLengthCount; i++) {
+		codeCodingLengths[codeCodingReorder[i]] = uint8_t((codeCodingBits >> (i * 3)) & 0b111);
+	}
+	position += codeLengthCount * 3;
+	constexpr int maxCodeCodingLength = 7;
+	if (usedCodeSpace<maxCodeCodingLength>(codeCodingLengths) != (1 << maxCodeCodingLength)) {
+		return false;
+	}
 
-				// Encode the actual block
-				section->position = startPos;
-				while (section->position < endPos) {
-					bool alsoOthers = false;
-					typename std::decay_t<decltype(*section)>::CodeRemainderWithLength length = {};
-					int distanceWord = 0;
-					typename std::decay_t<decltype(*section)>::CodeRemainderWithLength distance = {};
-					int word = section->readWord([&] (auto lengthExtraAssigned, int distanceWordAssigned, auto distanceExtraAssigned) {
-						alsoOthers = true;
-						length = lengthExtraAssigned;
-						distanceWord = distanceWordAssigned;
-						distance = distanceExtraAssigned;
-					});
-					bitOutput.addBits(wordEncoding->codes[word].code, wordEncoding->codes[word].length);
-					if (alsoOthers) { // Hopefully this will be optimised out
-						if (word >= 265) {
-							bitOutput.addBitsAndCrop(length.remainder, length.length);
-						}
-						bitOutput.addBits(distanceZero[distanceWord].code, distanceZero[distanceWord].length);
-						if (distanceWord < -4) {
-							bitOutput.addBitsAndCrop(distance.remainder, distance.length);
-						}
-					}
+	// Lookup table of the code coding, indexed by the next 7 bits
+	struct CodeCodingEntry {
+		uint8_t symbol;
+		uint8_t length;
+	};
+	std::array<CodeCodingEntry, (1 << maxCodeCodingLength)> codeCoding = {};
+	int nextCode = 0;
+	for (int length = 1; length <= maxCodeCodingLength; length++) {
+		for (int symbol = 0; symbol < std::ssize(codeCodingLengths); symbol++) {
+			if (codeCodingLengths[symbol] == length) {
+				for (int index = reverseBits(uint16_t(nextCode), length); index < std::ssize(codeCoding); index += 1 << length) {
+					codeCoding[index] = {uint8_t(symbol), uint8_t(length)};
 				}
-				bitOutput.addBits(wordEncoding->codes[256].code, wordEncoding->codes[256].length); // Ending
+				nextCode++;
 			}
+		}
+		nextCode <<= 1;
+	}
 
-			bool getEnabled() const {
-				return enabled;
-			}
-			void setEnabled(bool value) {
-				enabled = value;
-			}
-			int getStart() const {
-				return startPos;
-			}
-			int getEnd() const {
-				return endPos;
-			}
-			int totalSize() const {
-				return total;
+	std::array<uint8_t, 286 + 30> lengths = {};
+	const int lengthCount = codeCount + distanceCodes;
+	for (int filled = 0; filled < lengthCount; ) {
+		if ((position >> 3) >= std::ssize(data)) {
+			return false;
+		}
+		uint64_t bits = bitsAt(data, position);
+		CodeCodingEntry entry = codeCoding[bits & upperRemovals[maxCodeCodingLength]];
+		bits >>= entry.length;
+		position += entry.length;
+		int repeated = 1;
+		uint8_t value = entry.symbol;
+		if (entry.symbol == 16) {
+			if (filled == 0) {
+				return false;
 			}
-			bool isLast() const {
-				return last;
+			repeated = 3 + int(bits & 0b11);
+			position += 2;
+			value = lengths[filled - 1];
+		} else if (entry.symbol == 17) {
+			repeated = 3 + int(bits & 0b111);
+			position += 3;
+			value = 0;
+		} else if (entry.symbol == 18) {
+			repeated = 11 + int(bits & 0x7f);
+			position += 7;
+			value = 0;
+		}
+		if (filled + repeated > lengthCount) {
+			return false;
+		}
+		std::fill_n(lengths.begin() + filled, repeated, value);
+		filled += repeated;
+	}
+
+	if (lengths[endOfBlockWord] == 0) {
+		return false;
+	}
+	if (usedCodeSpace<maximumHuffmanCodeLength>(std::span<const uint8_t>(lengths.data(), codeCount)) != (1 << maximumHuffmanCodeLength)) {
+		return false;
+	}
+	// A distance code may be incomplete only if it has at most one code
+	std::span<const uint8_t> distanceLengths(lengths.data() + codeCount, distanceCodes);
+	return usedCodeSpace<maximumHuffmanCodeLength>(distanceLengths) == (1 << maximumHuffmanCodeLength)
+			|| std::count(distanceLengths.begin(), distanceLengths.end(), 0) >= distanceCodes - 1;
+}
+
+// Checks if a stored block's header can end at this bit, it must be at a byte boundary followed by the length and its complement
+inline bool canBeStoredBlockHeaderEnd(std::span<const uint8_t> data, ptrdiff_t position) {
+	size_t byte = size_t(position >> 3);
+	if ((position & 7) != 0 || position < 3 || byte + 4 > data.size()) {
+		return false;
+	}
+	if ((bitsAt(data, position - 3) & 0b111) != 0) { // Not the last block, stored
+		return false;
+	}
+	int length = data[byte] | (data[byte + 1] << 8);
+	int antiLength = data[byte + 2] | (data[byte + 3] << 8);
+	return (~length & 0xffff) == antiLength && byte + 4 + length <= data.size();
+}
+
+// Data decoded from a block boundary to the first block boundary after a given position
+struct DecodedChunk {
+	ptrdiff_t firstStart = 0; // The same data are decoded from any position between these two (stored blocks can be preceded by zero padding)
+	ptrdiff_t lastStart = -1; // Smaller than firstStart if no block boundary was found
+	ptrdiff_t end = 0;
+	bool last = false; // Whether the last block ended at end
+	MarkedByteOutput output;
+};
+
+template <DecompressionSettings Settings>
+DecodedChunk inflateChunk(std::span<const uint8_t> data, ptrdiff_t start, ptrdiff_t stop, std::optional<std::span<const char>> window, size_t sizeHint) {
+	const ptrdiff_t firstByte = start & ~ptrdiff_t(7);
+	ByteInputFromMemory input(data.subspan(size_t(firstByte >> 3)));
+	DecodedChunk decoded = {start, start, 0, false, MarkedByteOutput(window, sizeHint)};
+	DeflateReader<Settings, MarkedByteOutput> reader(input, decoded.output);
+	reader.skipBits(int(start - firstByte));
+	reader.stopAtBoundaryAfter(stop - firstByte);
+	while (reader.parseSome()) {
+		if (decoded.output.available() == 0) {
+			decoded.output.grow();
+		}
+	}
+	decoded.end = firstByte + reader.lastBoundary();
+	decoded.last = reader.reachedEnd();
+	return decoded;
+}
+
+// Looks for the first block that starts in the range and decodes it without knowing the preceding data, false positives are discarded when decoding fails
+template <DecompressionSettings Settings>
+DecodedChunk inflateChunkFromUnknownPosition(std::span<const uint8_t> data, ptrdiff_t from, ptrdiff_t to, ptrdiff_t stop, size_t sizeHint) {
+	for (ptrdiff_t position = from; position < to; position++) {
+		ptrdiff_t firstStart = position;
+		if (canBeStoredBlockHeaderEnd(data, position + 3)) {
+			// The header may be followed by up to 7 bits of padding that are zero in practice
+			while (firstStart > position - 7 && firstStart > 0 && (bitsAt(data, firstStart - 1) & 1) == 0) {
+				firstStart--;
 			}
-			const Counts& getCounts() const {
-				return counts;
+		} else if (!canBeDynamicBlockStart(data, position)) {
+			continue;
+		}
+		try {
+			DecodedChunk decoded = inflateChunk<Settings>(data, position, stop, std::nullopt, sizeHint);
+			decoded.firstStart = firstStart;
+			return decoded;
+		} catch (std::runtime_error&) {
+			// Not a block, or a corrupted one, which will be found when decoding it from the known position
+		}
+	}
+	return {};
+}
+} // namespace Detail
+
+// Decompresses a .gz file on multiple threads, the compressed data are split into chunks and each thread starts decoding at the first block it finds
+// in its chunk without knowing the preceding data, bytes that refer to them are resolved once the previous chunk is decoded
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+class IParallelGzFile {
+	Detail::MappedFile mappedFile;
+	std::span<const uint8_t> data;
+	ptrdiff_t position = 0; // Bit position of the next block to decode
+	GzFileInfo<typename Settings::StringType> parsedHeader = readHeader();
+	ptrdiff_t firstChunkStart = position;
+	ptrdiff_t chunkBits = 0;
+	int chunkCount = 0;
+	int nextChunk = 0;
+	std::deque<std::future<Detail::DecodedChunk>> speculated;
+	int nextSpeculated = 0;
+	bool finished = false;
+	bool done = false;
+	std::vector<char> window;
+	std::vector<char> delivered;
+	typename Settings::Checksum checksum = {};
+	size_t expectedSize = 0;
+	ThreadPool pool; // Destroyed first, because the tasks use the data
+
+	GzFileInfo<typename Settings::StringType> readHeader() {
+		Detail::ByteInputFromMemory input(data);
+		GzFileInfo<typename Settings::StringType> header(input);
+		position = input.getPosition() * 8;
+		return header;
+	}
+
+	void setup(size_t chunkSize) {
+		chunkBits = ptrdiff_t(std::max<size_t>(chunkSize, 1)) * 8;
+		chunkCount = countChunks();
+		expectedSize = gzSizeHint(data);
+	}
+
+	// Chunks from the start of the current member, the last one extends to the end of data
+	int countChunks() const {
+		return int(std::max<ptrdiff_t>(1, (ptrdiff_t(data.size()) * 8 - firstChunkStart + chunkBits - 1) / chunkBits));
+	}
+
+	ptrdiff_t chunkStart(int index) const {
+		return firstChunkStart + index * chunkBits;
+	}
+	ptrdiff_t chunkStop(int index) const {
+		return (index + 1 < chunkCount) ? chunkStart(index + 1) : std::numeric_limits<ptrdiff_t>::max();
+	}
+
+	void speculate() {
+		const size_t sizeHint = size_t(chunkBits / 8) * 4;
+		while (std::ssize(speculated) <= pool.size() && nextSpeculated < chunkCount) {
+			const int index = nextSpeculated;
+			if (index == 0) {
+				speculated.push_back(pool.submit([data = data, start = chunkStart(0), stop = chunkStop(0), sizeHint] {
+					return Detail::inflateChunk<Settings>(data, start, stop, std::span<const char>(), sizeHint);
+				}));
+			} else {
+				speculated.push_back(pool.submit([data = data, from = chunkStart(index), to = chunkStop(index), sizeHint] {
+					return Detail::inflateChunkFromUnknownPosition<Settings>(data, from, std::min(to, ptrdiff_t(data.size()) * 8), to, sizeHint);
+				}));
 			}
-		};
+			nextSpeculated++;
+		}
+	}
 
-		constexpr static int BlockCount = std::max(DeduplicatedSettings::maxSize / BlockSize, 1);
-		int previousEnd = 0;
-		std::array<Block, BlockCount> blocks = ArrayFiller([&] (int index) -> Block {
-			int end = (index + 1) * BlockSize;
-			bool thisOneIsLast = isLast;
-			if (end > section.endPosition()) {
-				end = section.endPosition();
-			} else thisOneIsLast = false;
-			Block made(section, Counts(section, previousEnd, std::min((index + 1) * BlockSize, section.endPosition())), previousEnd, thisOneIsLast);
-			previousEnd = made.getEnd();
-			return made;
-		});
+	// If another member follows the one that was finished, prepares to decode it like the first one
+	bool startNextMember() {
+		const size_t afterChecksum = size_t((position + 7) >> 3) + sizeof(uint32_t); // The checksum was already verified
+		Detail::ByteInputFromMemory input(data.subspan(afterChecksum));
+		if (!Detail::startNextGzMember<typename Settings::StringType>(input)) {
+			return false;
+		}
+		position = ptrdiff_t(afterChecksum + input.getPositionStart() + input.getPosition()) * 8;
+		firstChunkStart = position;
+		chunkCount = countChunks();
+		nextChunk = 0;
+		speculated.clear(); // Guesses made for the previous member, the tasks don't refer to this object
+		nextSpeculated = 0;
+		window.clear();
+		checksum = {};
+		finished = false;
+		return true;
+	}
+
+	// The next chunk, decoded again if the guessed start wasn't where the previous chunk ended
+	std::optional<Detail::DecodedChunk> nextDecoded() {
+		if (finished && !startNextMember()) {
+			return std::nullopt;
+		}
+		if (nextChunk >= chunkCount) {
+			throw std::runtime_error("Unexpected end of stream");
+		}
+		speculate();
+		Detail::DecodedChunk decoded = speculated.front().get();
+		speculated.pop_front();
+		if (position < decoded.firstStart || position > decoded.lastStart) {
+			decoded = Detail::inflateChunk<Settings>(data, position, chunkStop(nextChunk), window, size_t(chunkBits / 8) * 4);
+		}
+		nextChunk++;
+		position = decoded.end;
+		finished = decoded.last;
+		return decoded;
+	}
 
-		auto considerMerge = [&section] (Block& first, Block& second) {
-			Block merged(section, Counts(first.getCounts(), second.getCounts()), first.getStart(), first.isLast() || second.isLast());
-			if (merged.totalSize() < first.totalSize() + second.totalSize()) {
-				first = merged;
-				second.setEnabled(false);
+	// Replaces markers with bytes from the window and checksums it
+	void resolve(const Detail::DecodedChunk& decoded, char* destination) {
+		std::span<const uint16_t> values = decoded.output.data();
+		const size_t missing = Detail::MarkedByteOutput::windowSize - window.size();
+		constexpr size_t sectionSize = 4096;
+		for (size_t sectionStart = 0; sectionStart < values.size(); sectionStart += sectionSize) {
+			// Markers are usually rare, so sections are converted in a way that can be vectorised and fixed if they contain markers
+			size_t sectionEnd = std::min(sectionStart + sectionSize, values.size());
+			uint16_t markerBits = 0;
+			for (size_t i = sectionStart; i < sectionEnd; i++) {
+				destination[i] = char(values[i]);
+				markerBits |= values[i];
 			}
-		};
-		for (int width = 1; width < std::ssize(blocks) / 2; width *= 2) {
-			for (int start = 0; start < std::ssize(blocks); start += width * 2) {
-				int mid = start + width;
-				if (mid >= std::ssize(blocks))
-					break; // Past the end
-				int end = std::min<int>(start + width * 2, std::ssize(blocks));
-				int startBlockIndex = mid - 1;
-				for ( ; startBlockIndex >= start; startBlockIndex--) {
-					if (blocks[startBlockIndex].getEnabled())
-						break;
-				}
-				if (startBlockIndex < start)
-					continue; // Found nothing
-				int endBlockIndex = mid;
-				for ( ; endBlockIndex < end; endBlockIndex++) {
-					if (blocks[startBlockIndex].getEnabled())
-						break;
+			if (markerBits < Detail::MarkedByteOutput::firstMarker) [[likely]] {
+				continue;
+			}
+			for (size_t i = sectionStart; i < sectionEnd; i++) {
+				if (values[i] >= Detail::MarkedByteOutput::firstMarker) {
+					size_t index = values[i] - Detail::MarkedByteOutput::firstMarker;
+					if (index < missing) [[unlikely]] {
+						throw std::runtime_error("Looking back too many bytes, corrupted archive");
+					}
+					destination[i] = window[index - missing];
 				}
-				if (endBlockIndex >= end)
-					continue; // Foud nothing
+			}
+		}
 
-				considerMerge(blocks[startBlockIndex], blocks[endBlockIndex]);
+		std::span<const char> added(destination, values.size());
+		checksum(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(added.data()), added.size()));
+		if (std::ssize(added) >= Detail::MarkedByteOutput::windowSize) {
+			window.assign(added.end() - Detail::MarkedByteOutput::windowSize, added.end());
+		} else {
+			window.insert(window.end(), added.begin(), added.end());
+			if (std::ssize(window) > Detail::MarkedByteOutput::windowSize) {
+				window.erase(window.begin(), window.end() - Detail::MarkedByteOutput::windowSize);
 			}
 		}
 
-		if (!bitOutput) {
-			bitOutput.emplace(byteOutput);
+		if (decoded.last) {
+			verifyTrailer();
 		}
+	}
 
-		for (int i = 0; i < std::ssize(blocks); i++) {
-			blocks[i].writeOut(*bitOutput);
+	void verifyTrailer() {
+		size_t trailerStart = size_t((position + 7) >> 3);
+		if (trailerStart + 2 * sizeof(uint32_t) > data.size()) {
+			throw std::runtime_error("Unexpected end of stream");
+		}
+		uint32_t expectedCrc = 0;
+		memcpy(&expectedCrc, data.data() + trailerStart, sizeof(expectedCrc));
+		if constexpr(Settings::verifyChecksum) {
+			if (expectedCrc != uint32_t(checksum()))
+				throw std::runtime_error("Gzip archive's crc32 checksum doesn't match the calculated checksum");
 		}
 	}
-};
 
-} // namespace Detail
+public:
+	constexpr static size_t defaultChunkSize = 4 * 1024 * 1024;
 
-#if EZGZ_HAS_CONCEPTS
-template <typename T>
-concept CompressionSettings = std::constructible_from<typename T::Checksum> && InputStreamSettings<typename T::Input>
-			&& StreamSettings<typename T::Output> && StreamSettings<typename T::DeduplicationProperties>
-			 && Detail::Deduplicator<typename T::DeduplicatorType> && requires(typename T::Checksum checksum) {
-	int(checksum());
-	int(checksum(std::span<const uint8_t>()));
-	int(T::HuffmanSectionSize);
-};
-#else
-#define CompressionSettings typename
+	// Zero threads means as many as the hardware can run at once, the data must remain valid while this object exists
+	IParallelGzFile(std::span<const uint8_t> data, int threadCount = 0, size_t chunkSize = defaultChunkSize) : data(data), pool(threadCount) {
+		setup(chunkSize);
+	}
+
+#ifndef EZGZ_NO_FILE
+	IParallelGzFile(const std::string& fileName, int threadCount = 0, size_t chunkSize = defaultChunkSize)
+			: mappedFile(fileName), data(mappedFile.data()), pool(threadCount) {
+		setup(chunkSize);
+	}
 #endif
 
-struct FastCompressionSettings {
-	struct Input {
-		constexpr static int maxSize = 30000;
-		constexpr static int minSize = 10000;
-		constexpr static int lookAheadSize = 300;
-	};
-	struct DeduplicationProperties {
-		constexpr static int maxSize = 50000;
-		constexpr static int minSize = 10000;
-	};
-	struct Output {
-		constexpr static int maxSize = 100000;
-		constexpr static int minSize = 0;
-	};
+	const GzFileInfo<typename Settings::StringType>& info() const {
+		return parsedHeader;
+	}
 
-	constexpr static int HuffmanSectionSize = 1000000;
-	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::LastRepetitionEntry>;
-	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::NO_DUPLICATION_FLAGS)>;
-	using Checksum = FastCrc32;
-};
+	// Expected size of decompressed data (it may be wrong if the file is corrupted)
+	size_t sizeHint() const {
+		return expectedSize;
+	}
 
-struct DefaultCompressionSettings : FastCompressionSettings {
-	constexpr static int HuffmanSectionSize = 50000;
-	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::RepetitionCircularBuffer<5>>;
-	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::INDEX_DUPLICATES | Detail::INCLUDE_SMALL_DUPLICATES)>;
-	using Checksum = FastCrc32;
+	// Returns the next batch, the given number of bytes at the end of the previous batch remain in memory right before it
+	std::optional<std::span<const char>> readSome(int bytesToKeep = 0) {
+		if (done) {
+			return std::nullopt;
+		}
+		while (std::optional<Detail::DecodedChunk> decoded = nextDecoded()) {
+			size_t size = decoded->output.data().size();
+			if (size == 0) {
+				resolve(*decoded, nullptr); // Only to verify the trailer if it's the last one
+				continue;
+			}
+			size_t keeping = std::min<size_t>(std::max(bytesToKeep, 0), delivered.size());
+			if (keeping > 0) {
+				memmove(delivered.data(), delivered.data() + delivered.size() - keeping, keeping);
+			}
+			delivered.resize(keeping + size);
+			resolve(*decoded, delivered.data() + keeping);
+			return std::span<const char>(delivered.data() + keeping, size);
+		}
+		done = true;
+		return std::nullopt;
+	}
+
+	void readAll(const std::function<void(std::span<const char>)>& reader) {
+		while (std::optional<std::span<const char>> batch = readSome()) {
+			reader(*batch);
+		}
+	}
+
+	std::vector<char> readAll() {
+		std::vector<char> returned;
+		returned.reserve(expectedSize);
+		while (std::optional<Detail::DecodedChunk> decoded = nextDecoded()) {
+			size_t size = returned.size();
+			returned.resize(size + decoded->output.data().size());
+			resolve(*decoded, returned.data() + size);
+		}
+		done = true;
+		return returned;
+	}
+
+	// Decompresses into a buffer provided by the caller, throws if the data don't fit, returns the size of decompressed data
+	size_t readAll(std::span<char> buffer) {
+		size_t size = 0;
+		while (std::optional<Detail::DecodedChunk> decoded = nextDecoded()) {
+			if (size + decoded->output.data().size() > buffer.size()) {
+				throw std::runtime_error("Decompressed data don't fit into the output buffer");
+			}
+			resolve(*decoded, buffer.data() + size);
+			size += decoded->output.data().size();
+		}
+		done = true;
+		return size;
+	}
 };
 
-struct DenseCompressionSettings : DefaultCompressionSettings {
-	constexpr static int HuffmanSectionSize = 5000;
-	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::CircularQueueHistoryBuffer<15>>;
-	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::INDEX_DUPLICATES | Detail::INCLUDE_SMALL_DUPLICATES)>;
+namespace Detail {
+// A BGZF block is a gzip member whose header's extra field holds its compressed size
+struct BgzfBlock {
+	size_t start = 0;
+	size_t deflateStart = 0;
+	size_t end = 0;
 };
 
-struct BestCompressionSettings : DenseCompressionSettings {
-	constexpr static int HuffmanSectionSize = 2000;
-	using DeduplicationIndex = Detail::PrefixBasedDuplicationIndex<Detail::CircularQueueHistoryBuffer<>>;
-	using DeduplicatorType = typename Detail::EagerDeduplicator<DeduplicationIndex, Detail::DeduplicationFlags(Detail::INDEX_DUPLICATES | Detail::INCLUDE_SMALL_DUPLICATES)>;
+constexpr size_t maxBgzfBlockSize = 65536;
+
+inline BgzfBlock parseBgzfBlock(std::span<const uint8_t> data, size_t start) {
+	ByteInputFromMemory input(std::span<const uint8_t>(data.data() + start, data.size() - start));
+	GzFileInfo<std::string> header(input);
+	if (!header.extraData) {
+		throw std::runtime_error("Not a BGZF block, the gzip header has no extra field");
+	}
+	const std::vector<uint8_t>& extra = *header.extraData;
+	for (size_t field = 0; field + 4 <= extra.size(); field += 4 + (extra[field + 2] | (extra[field + 3] << 8))) {
+		if (extra[field] == 'B' && extra[field + 1] == 'C' && field + 6 <= extra.size()) {
+			BgzfBlock block = {start, start + input.getPosition(), start + (extra[field + 4] | (extra[field + 5] << 8)) + 1};
+			if (block.end > data.size() || block.deflateStart + 2 * sizeof(uint32_t) > block.end) {
+				throw std::runtime_error("BGZF block size doesn't match the data");
+			}
+			return block;
+		}
+	}
+	throw std::runtime_error("Not a BGZF block, the gzip header has no block size");
+}
+
+// Decompressed contents of consecutive BGZF blocks
+struct DecodedBgzfBlocks {
+	size_t start = 0;
+	size_t end = 0;
+	size_t firstBlockSize = 0;
+	std::vector<char> data;
 };
 
-// Handles decompression of a deflate-compressed archive, no headers
-template <DecompressionSettings Settings = DefaultDecompressionSettings>
-std::vector<char> readDeflateIntoVector(std::function<int(std::span<uint8_t> batch)> readMoreFunction) {
-	std::vector<char> result;
-	Detail::ByteInputWithBuffer<typename Settings::Input, typename Settings::Checksum> input(readMoreFunction);
-	Detail::ByteOutput<typename Settings::Output, typename Settings::Checksum> output;
-	Detail::DeflateReader<Settings> reader(input, output);
-	bool workToDo = false;
-	do {
-		workToDo = reader.parseSome();
-		std::span<const char> batch = output.getBuffer();
-		result.insert(result.end(), batch.begin(), batch.end());
-		output.cleanBuffer();
-	} while (workToDo);
-	return result;
+template <DecompressionSettings Settings>
+DecodedBgzfBlocks inflateBgzfBlocks(std::span<const uint8_t> data, size_t start, size_t end) {
+	DecodedBgzfBlocks decoded = {start, end, 0, {}};
+	std::vector<BgzfBlock> blocks;
+	size_t totalSize = 0;
+	for (size_t position = start; position < end; position = blocks.back().end) {
+		blocks.push_back(parseBgzfBlock(data, position));
+		uint32_t blockSize = 0;
+		memcpy(&blockSize, data.data() + blocks.back().end - sizeof(blockSize), sizeof(blockSize));
+		if (blockSize > maxBgzfBlockSize) {
+			throw std::runtime_error("BGZF block is too large");
+		}
+		totalSize += blockSize;
+	}
+
+	decoded.data.resize(totalSize + repetitionSlack); // The next block overwrites what is written into the slack
+	size_t written = 0;
+	for (const BgzfBlock& block : blocks) {
+		uint32_t expectedCrc = 0;
+		uint32_t expectedSize = 0;
+		memcpy(&expectedCrc, data.data() + block.end - 2 * sizeof(uint32_t), sizeof(uint32_t));
+		memcpy(&expectedSize, data.data() + block.end - sizeof(uint32_t), sizeof(uint32_t));
+		ByteInputFromMemory input(std::span<const uint8_t>(data.data() + block.deflateStart, block.end - 2 * sizeof(uint32_t) - block.deflateStart));
+		ContiguousByteOutput<typename Settings::Checksum> output(std::span<char>(decoded.data.data() + written, expectedSize + repetitionSlack));
+		if (inflateIntoBuffer<Settings>(input, output) != expectedSize) {
+			throw std::runtime_error("Size of decompressed BGZF block doesn't match the size in its trailer");
+		}
+		if constexpr(Settings::verifyChecksum) {
+			if (expectedCrc != uint32_t(output.getChecksum()()))
+				throw std::runtime_error("Gzip archive's crc32 checksum doesn't match the calculated checksum");
+		}
+		if (block.start == start) {
+			decoded.firstBlockSize = expectedSize;
+		}
+		written += expectedSize;
+	}
+	decoded.data.resize(totalSize);
+	return decoded;
 }
+} // namespace Detail
 
+// Decompresses a BGZF file (a series of gzip members up to 64 kiB long with their sizes in headers, used for bioinformatic data) on multiple threads,
+// it can seek to virtual offsets (position of the block in the file shifted left by 16 bits plus the position in the decompressed block)
 template <DecompressionSettings Settings = DefaultDecompressionSettings>
-std::vector<char> readDeflateIntoVector(std::span<const uint8_t> allData) {
-	return readDeflateIntoVector<Settings>([allData, position = 0] (std::span<uint8_t> toFill) mutable -> int {
-		int filling = int(std::min(allData.size() - position, toFill.size()));
-		if(filling != 0)
-			memcpy(toFill.data(), &allData[position], filling);
-		position += filling;
-		return filling;
-	});
-}
+class IBgzfFile {
+	Detail::MappedFile mappedFile;
+	std::span<const uint8_t> data;
+	size_t groupSize = 0;
+	size_t nextScheduled = 0; // Position of the first block not given to the threads yet
+	std::deque<std::future<Detail::DecodedBgzfBlocks>> scheduled;
+	size_t bytesToSkip = 0;
+	uint64_t position = 0;
+	std::vector<char> delivered;
+	ThreadPool pool; // Destroyed first, because the tasks use the data
+
+	void schedule() {
+		while (std::ssize(scheduled) <= pool.size() && nextScheduled < data.size()) {
+			size_t end = nextScheduled;
+			try {
+				do {
+					end = Detail::parseBgzfBlock(data, end).end;
+				} while (end < data.size() && end - nextScheduled < groupSize);
+			} catch (std::runtime_error&) {
+				end = data.size(); // The error is thrown again by the task, after the data before it are read
+			}
+			scheduled.push_back(pool.submit([data = data, start = nextScheduled, end] {
+				return Detail::inflateBgzfBlocks<Settings>(data, start, end);
+			}));
+			nextScheduled = end;
+		}
+	}
 
-template <CompressionSettings Settings>
-std::vector<uint8_t> writeDeflateIntoVector(std::function<int(std::span<char> batch)> readMoreFunction) {
-	std::vector<uint8_t> result;
-	{
-		Detail::ByteOutput<typename Settings::Output, NoChecksum> output;
-		Detail::HuffmanWriter<typename Settings::Output, typename Settings::DeduplicationProperties> writer(output);
-		auto connector = [&] (Detail::DeduplicatingStreamSection section, bool lastCall) {
-			writer.writeBatch(section, lastCall);
-			return section.position;
-		};
-		Detail::ByteInputWithBuffer<typename Settings::Input, typename Settings::Checksum> input([&readMoreFunction] (std::span<uint8_t> batch) {
-			return readMoreFunction(std::span<char>(reinterpret_cast<char*>(batch.data()), batch.size()));
-		});
-		Detail::DeduplicatedStream<typename Settings::DeduplicationProperties> deduplicated(connector);
-		auto deduplicator = std::make_unique<typename Settings::DeduplicatorType>(input, deduplicated);
+	std::optional<Detail::DecodedBgzfBlocks> nextDecoded() {
+		schedule();
+		if (scheduled.empty()) {
+			return std::nullopt;
+		}
+		Detail::DecodedBgzfBlocks decoded = scheduled.front().get();
+		scheduled.pop_front();
+		if (bytesToSkip > 0) {
+			if (bytesToSkip > decoded.firstBlockSize) {
+				throw std::runtime_error("BGZF virtual offset points past the end of its block");
+			}
+			decoded.data.erase(decoded.data.begin(), decoded.data.begin() + bytesToSkip);
+			bytesToSkip = 0;
+		}
+		position = uint64_t(decoded.end) << 16;
+		return decoded;
+	}
 
-		do {
-			deduplicator->deduplicateSome();
-			std::span<const char> batch = output.getBuffer();
-			result.insert(result.end(), batch.begin(), batch.end());
-			output.cleanBuffer();
-		} while (!input.isAtEnd());
+public:
+	constexpr static size_t defaultGroupSize = 1024 * 1024;
 
-		deduplicator->flush();
-		deduplicated.flush();
-		writer.finalFlush();
-		output.done();
-		std::span<const char> batch = output.getBuffer();
-		result.insert(result.end(), batch.begin(), batch.end());
+	// Each thread decompresses blocks totalling about the group size of compressed data at once, the data must remain valid while this object exists
+	IBgzfFile(std::span<const uint8_t> data, int threadCount = 0, size_t groupSize = defaultGroupSize) : data(data), groupSize(groupSize), pool(threadCount) {}
+
+#ifndef EZGZ_NO_FILE
+	IBgzfFile(const std::string& fileName, int threadCount = 0, size_t groupSize = defaultGroupSize)
+			: mappedFile(fileName), data(mappedFile.data()), groupSize(groupSize), pool(threadCount) {}
+#endif
+
+	// Continues reading from a virtual offset, obtained from an index or from virtualOffset()
+	void seek(uint64_t virtualOffset) {
+		size_t blockStart = size_t(virtualOffset >> 16);
+		bytesToSkip = size_t(virtualOffset & 0xffff);
+		if (blockStart > data.size() || (blockStart == data.size() && bytesToSkip > 0)) {
+			throw std::runtime_error("Seeking past the end of data");
+		}
+		scheduled.clear(); // Tasks already running finish without using this object
+		nextScheduled = blockStart;
+		position = virtualOffset;
+		delivered.clear();
 	}
-	return result;
-}
 
-template <CompressionSettings Settings>
-std::vector<uint8_t> writeDeflateIntoVector(std::span<const char> allData) {
-	return writeDeflateIntoVector<Settings>([allData, position = 0] (std::span<char> toFill) mutable -> int {
-		int filling = std::min(int(allData.size() - position), int(toFill.size()));
-		if(filling != 0)
-			memcpy(toFill.data(), &allData[position], filling);
-		position += filling;
-		return filling;
-	});
+	// Virtual offset of the data following the last batch read
+	uint64_t virtualOffset() const {
+		return position;
+	}
+
+	// Returns the next batch, the given number of bytes at the end of the previous batch remain in memory right before it
+	std::optional<std::span<const char>> readSome(int bytesToKeep = 0) {
+		while (std::optional<Detail::DecodedBgzfBlocks> decoded = nextDecoded()) {
+			if (decoded->data.empty()) {
+				continue; // The end of file marker is an empty block
+			}
+			size_t keeping = std::min<size_t>(std::max(bytesToKeep, 0), delivered.size());
+			if (keeping == 0) {
+				delivered = std::move(decoded->data);
+			} else {
+				memmove(delivered.data(), delivered.data() + delivered.size() - keeping, keeping);
+				delivered.resize(keeping);
+				delivered.insert(delivered.end(), decoded->data.begin(), decoded->data.end());
+			}
+			return std::span<const char>(delivered.data() + keeping, delivered.size() - keeping);
+		}
+		return std::nullopt;
+	}
+
+	void readAll(const std::function<void(std::span<const char>)>& reader) {
+		while (std::optional<std::span<const char>> batch = readSome()) {
+			reader(*batch);
+		}
+	}
+
+	std::vector<char> readAll() {
+		std::vector<char> returned;
+		while (std::optional<Detail::DecodedBgzfBlocks> decoded = nextDecoded()) {
+			if (returned.empty()) {
+				returned = std::move(decoded->data);
+			} else {
+				returned.insert(returned.end(), decoded->data.begin(), decoded->data.end());
+			}
+		}
+		return returned;
+	}
+
+	// Decompresses into a buffer provided by the caller, throws if the data don't fit, returns the size of decompressed data
+	size_t readAll(std::span<char> buffer) {
+		size_t size = 0;
+		while (std::optional<Detail::DecodedBgzfBlocks> decoded = nextDecoded()) {
+			if (size + decoded->data.size() > buffer.size()) {
+				throw std::runtime_error("Decompressed data don't fit into the output buffer");
+			}
+			memcpy(buffer.data() + size, decoded->data.data(), decoded->data.size());
+			size += decoded->data.size();
+		}
+		return size;
+	}
+};
+
+namespace Detail {
+// Decompressed contents of a whole gzip member and the position after it
+struct DecodedGzMember {
+	size_t end = 0;
+	std::vector<char> data;
+};
+
+template <DecompressionSettings Settings>
+DecodedGzMember inflateGzMember(std::span<const uint8_t> data, size_t start) {
+	ByteInputFromMemory input(std::span<const uint8_t>(data.data() + start, data.size() - start));
+	GzFileInfo<typename Settings::StringType> header(input);
+	ContiguousByteOutput<typename Settings::Checksum> output;
+	DecodedGzMember decoded;
+	decoded.data = inflateIntoVector<Settings>(input, output, 0);
+	uint32_t expectedCrc = input.getInteger<uint32_t>();
+	if constexpr(Settings::verifyChecksum) {
+		if (expectedCrc != uint32_t(output.getChecksum()()))
+			throw std::runtime_error("Gzip archive's crc32 checksum doesn't match the calculated checksum");
+	}
+	input.getInteger<uint32_t>();
+	decoded.end = start + size_t(input.getPositionStart() + input.getPosition());
+	return decoded;
 }
 
+// Position of the first thing that looks like a gzip header, or the end
+inline size_t findGzHeader(std::span<const uint8_t> data, size_t from) {
+	while (from + 3 <= data.size()) {
+		const void* found = memchr(data.data() + from, 0x1f, data.size() - from - 2);
+		if (!found) {
+			break;
+		}
+		from = size_t(reinterpret_cast<const uint8_t*>(found) - data.data());
+		if (data[from + 1] == 0x8b && data[from + 2] == 0x08) {
+			return from;
+		}
+		from++;
+	}
+	return data.size();
+}
+} // namespace Detail
 
-// Handles decompression of a deflate-compressed archive, no headers
+// Decompresses a .gz file made of many members (like concatenated files) on multiple threads, each member is decompressed by one thread
+// Members are found by looking for their headers, members decompressed ahead are kept in memory until they are read
 template <DecompressionSettings Settings = DefaultDecompressionSettings>
-class IDeflateArchive {
-protected:
-	Detail::ByteInputWithBuffer<typename Settings::Input, typename Settings::Checksum> input;
-	Detail::ByteOutput<typename Settings::Output, typename Settings::Checksum> output;
-	Detail::DeflateReader<Settings> deflateReader = {input, output};
-	bool done = false;
-	int bytesKept = 0;
-
-	bool bufferNeedsCleaning = false;
-	void cleanBufferIfNeeded() {
-		if (bufferNeedsCleaning) {
-			output.cleanBuffer(bytesKept);
-			bufferNeedsCleaning = false;
+class IParallelMembersGzFile {
+	Detail::MappedFile mappedFile;
+	std::span<const uint8_t> data;
+	size_t nextCandidate = 0; // Position of the next possible header, not given to the threads yet
+	size_t nextMember = 0;
+	std::deque<std::pair<size_t, std::future<Detail::DecodedGzMember>>> decoding;
+	std::vector<char> delivered;
+	ThreadPool pool; // Destroyed first, because the tasks use the data
+
+	void schedule() {
+		while (std::ssize(decoding) <= pool.size() && nextCandidate < data.size()) {
+			decoding.emplace_back(nextCandidate, pool.submit([data = data, start = nextCandidate] {
+				return Detail::inflateGzMember<Settings>(data, start);
+			}));
+			nextCandidate = Detail::findGzHeader(data, nextCandidate + 1);
 		}
 	}
 
-	virtual void onFinish() {}
+	std::optional<Detail::DecodedGzMember> nextDecoded() {
+		while (true) {
+			schedule();
+			if (decoding.empty()) {
+				return std::nullopt;
+			}
+			auto [start, decoded] = std::move(decoding.front());
+			decoding.pop_front();
+			if (start < nextMember) {
+				continue; // The header was only something similar inside a member
+			}
+			if (start > nextMember) {
+				decoding.clear(); // Like other implementations, anything else after the end is ignored
+				nextCandidate = data.size();
+				return std::nullopt;
+			}
+			Detail::DecodedGzMember member = decoded.get();
+			nextMember = member.end;
+			return member;
+		}
+	}
 
 public:
-	IDeflateArchive(std::function<int(std::span<uint8_t> batch)> readMoreFunction) : input(readMoreFunction) {}
+	// Zero threads means as many as the hardware can run at once, the data must remain valid while this object exists
+	IParallelMembersGzFile(std::span<const uint8_t> data, int threadCount = 0) : data(data), pool(threadCount) {}
 
 #ifndef EZGZ_NO_FILE
-	IDeflateArchive(const std::string& fileName) : input([file = std::make_shared<std::ifstream>(fileName, std::ios::binary)] (std::span<uint8_t> batch) mutable {
-		if (!file->good()) {
-			throw std::runtime_error("Can't read file");
-		}
-		file->read(reinterpret_cast<char*>(batch.data()), batch.size());
-		int bytesRead = int(file->gcount());
-		return bytesRead;
-	}) {}
+	IParallelMembersGzFile(const std::string& fileName, int threadCount = 0) : mappedFile(fileName), data(mappedFile.data()), pool(threadCount) {}
 #endif
 
-	IDeflateArchive(std::span<const uint8_t> data) : input([data] (std::span<uint8_t> batch) mutable {
-		int copying = int(std::min(batch.size(), data.size()));
-		if (copying == 0) {
-			return 0;
+	// Returns the next batch, the given number of bytes at the end of the previous batch remain in memory right before it
+	std::optional<std::span<const char>> readSome(int bytesToKeep = 0) {
+		while (std::optional<Detail::DecodedGzMember> decoded = nextDecoded()) {
+			if (decoded->data.empty()) {
+				continue;
+			}
+			size_t keeping = std::min<size_t>(std::max(bytesToKeep, 0), delivered.size());
+			if (keeping == 0) {
+				delivered = std::move(decoded->data);
+			} else {
+				memmove(delivered.data(), delivered.data() + delivered.size() - keeping, keeping);
+				delivered.resize(keeping);
+				delivered.insert(delivered.end(), decoded->data.begin(), decoded->data.end());
+			}
+			return std::span<const char>(delivered.data() + keeping, delivered.size() - keeping);
 		}
-		memcpy(batch.data(), data.data(), copying);
-		data = data.subspan(copying);
-		return copying;
-	}) {}
+		return std::nullopt;
+	}
 
-	// Returns whether there are more bytes to read
-	std::optional<std::span<const char>> readSome(int bytesToKeep = 0) {
-		cleanBufferIfNeeded();
-		if (done) {
-			return std::nullopt;
+	void readAll(const std::function<void(std::span<const char>)>& reader) {
+		while (std::optional<std::span<const char>> batch = readSome()) {
+			reader(*batch);
 		}
-		bool moreStuffToDo = deflateReader.parseSome();
-		std::span<const char> batch = output.getBuffer();
-		bytesKept = bytesToKeep;
-		if (!moreStuffToDo) {
-			onFinish();
-			done = true;
+	}
+
+	std::vector<char> readAll() {
+		std::vector<char> returned;
+		while (std::optional<Detail::DecodedGzMember> decoded = nextDecoded()) {
+			if (returned.empty()) {
+				returned = std::move(decoded->data);
+			} else {
+				returned.insert(returned.end(), decoded->data.begin(), decoded->data.end());
+			}
 		}
-		bufferNeedsCleaning = true;
-		return batch;
+		return returned;
 	}
+};
 
-	void readByLines(const std::function<void(std::span<const char>)> reader, char separator = '\n') {
-		int keeping = 0;
-		bool wasSeparator = false;
-		std::span<const char> batch = {};
-		while (!done) {
-			batch = *readSome(keeping);
-			std::span<const char>::iterator start = batch.begin();
-			for (std::span<const char>::iterator it = start; it != batch.end(); ++it) {
-				if (wasSeparator) {
-					wasSeparator = false;
-					start = it;
+// Decompresses many separate small .gz files in memory on multiple threads, each thread reuses one decompressor for all the files it gets,
+// keeping this object allows reusing the threads and decompressors for further batches
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+class IGzBatch {
+	ContextPool<IMappedGzFile<Settings>> contexts;
+	ThreadPool pool; // Destroyed first, because the tasks use the decompressors
+
+	// Calls the function with a decompressor prepared for each file, the first exception is rethrown after all threads stop
+	template <typename Function>
+	void forEachFile(std::span<const std::span<const uint8_t>> files, Function function) {
+		std::atomic<size_t> next = 0;
+		auto work = [&] {
+			try {
+				size_t index = next++;
+				if (index >= files.size()) {
+					return;
 				}
-				if (*it == separator) {
-					reader(std::span<const char>(&*start, std::distance(start, it)));
-					wasSeparator = true;
+				typename ContextPool<IMappedGzFile<Settings>>::Lease decompressor = contexts.acquire(files[index]);
+				while (true) {
+					function(*decompressor, index);
+					index = next++;
+					if (index >= files.size()) {
+						return;
+					}
+					decompressor->reset(files[index]);
 				}
+			} catch (...) {
+				next = files.size(); // Nobody needs the remaining files
+				throw;
 			}
-			keeping = int(batch.end() - start);
+		};
+		std::vector<std::future<void>> running;
+		for (int i = 0; i < std::min<int>(pool.size(), int(files.size())); i++) {
+			running.push_back(pool.submit(work));
 		}
-		if (keeping > 0) {
-			if (wasSeparator)
-				reader(std::span<const char>());
-			else
-				reader(std::span<const char>(&*(batch.end() - keeping), keeping));
+		for (std::future<void>& task : running) {
+			task.wait();
+		}
+		for (std::future<void>& task : running) {
+			task.get();
 		}
 	}
 
-	void readAll(const std::function<void(std::span<const char>)>& reader) {
-		while (std::optional<std::span<const char>> batch = readSome()) {
-			reader(*batch);
+public:
+	// Zero threads means as many as the hardware can run at once
+	explicit IGzBatch(int threadCount = 0) : contexts(size_t(std::max(threadCount, 0))), pool(threadCount) {}
+
+	// Each file is decompressed into a vector allocated once with the size from its trailer
+	std::vector<std::vector<char>> readAll(std::span<const std::span<const uint8_t>> files) {
+		std::vector<std::vector<char>> decompressed(files.size());
+		forEachFile(files, [&] (IMappedGzFile<Settings>& decompressor, size_t index) {
+			decompressed[index] = decompressor.readAll();
+		});
+		return decompressed;
+	}
+
+	// Decompresses each file into a buffer provided by the caller, throws if any doesn't fit, returns the decompressed sizes
+	std::vector<size_t> readAll(std::span<const std::span<const uint8_t>> files, std::span<const std::span<char>> buffers) {
+		if (buffers.size() != files.size()) {
+			throw std::logic_error("Each file needs one buffer");
 		}
+		std::vector<size_t> sizes(files.size());
+		forEachFile(files, [&] (IMappedGzFile<Settings>& decompressor, size_t index) {
+			sizes[index] = decompressor.readAll(buffers[index]);
+		});
+		return sizes;
 	}
+};
+#endif
 
-	std::vector<char> readAll() {
-		std::vector<char> returned;
-		while (std::optional<std::span<const char>> batch = readSome()) {
-			returned.insert(returned.end(), batch->begin(), batch->end());
-		};
-		return returned;
+// Writes a .gz file, only takes care of the header, the rest is handled by its parent class ODeflateArchive
+template <CompressionSettings Settings, BasicStringType StringType>
+class OGzFile : public ODeflateArchive<Settings, HardwareCrc32> {
+	void fillTrailerWriter() {
+		ODeflateArchive<Settings, HardwareCrc32>::writeAtEnd([this] {
+			auto writeInteger = [this] (uint32_t value) {
+				std::array<char, sizeof(uint32_t)> bytes = {};
+				memcpy(bytes.data(), &value, bytes.size());
+				ODeflateArchive<Settings, HardwareCrc32>::output.addBytes(bytes);
+			};
+			writeInteger(uint32_t(ODeflateArchive<Settings, HardwareCrc32>::input.checksum()));
+			writeInteger(uint32_t(ODeflateArchive<Settings, HardwareCrc32>::input.getPosition() + ODeflateArchive<Settings, HardwareCrc32>::input.getPositionStart()));
+		});
+	}
+
+public:
+	OGzFile(const GzFileInfo<StringType>& header, std::function<void(std::span<const char> batch)> consumeFunction)
+	: ODeflateArchive<Settings, HardwareCrc32>(consumeFunction) {
+		header.writeOut(consumeFunction);
+		fillTrailerWriter();
+	}
+
+#ifndef EZGZ_NO_FILE
+	OGzFile(const GzFileInfo<StringType>& header) : ODeflateArchive<Settings, HardwareCrc32>(header.name) {
+		header.writeOut([this] (std::span<const char> batch) {
+			ODeflateArchive<Settings, HardwareCrc32>::output.addBytes(batch);
+		});
+		fillTrailerWriter();
 	}
+#endif
 };
 
-template <CompressionSettings Settings, typename Checksum = NoChecksum>
-class ODeflateArchive {
-protected:
-	Detail::ByteOutput<typename Settings::Output, NoChecksum> output;
-	Detail::ByteInputWithBuffer<typename Settings::Input, Checksum> input = {[this] (std::span<uint8_t>) -> int {
-		return 0; // TODO: The input buffer should be able to renew from this
-	}};
+// Writes a zlib stream (RFC 1950), only takes care of the header and the Adler-32 trailer, the rest is handled by its parent class ODeflateArchive
+template <CompressionSettings Settings = DefaultCompressionSettings>
+class OZlibFile : public ODeflateArchive<Settings, HardwareAdler32> {
+	using Deflate = ODeflateArchive<Settings, HardwareAdler32>;
+	constexpr static std::array<char, 2> header = {0x78, char(0x9c)}; // Deflate with a 32 kiB window, the default compression level
 
-	void writeAtEnd(std::function<void()> trailerWriter) {
-		writeTrailer = trailerWriter;
+	void fillTrailerWriter() {
+		Deflate::writeAtEnd([this] {
+			const uint32_t checksum = Deflate::input.checksum();
+			const std::array<char, sizeof(uint32_t)> bytes = {char(checksum >> 24), char(checksum >> 16), char(checksum >> 8), char(checksum)}; // Big endian
+			Deflate::output.addBytes(bytes);
+		});
 	}
-private:
-	Detail::HuffmanWriter<typename Settings::Output, typename Settings::DeduplicationProperties, Settings::HuffmanSectionSize> writer = {output};
-	std::function<void(std::span<const char> batch)> consumeFunction;
-	Detail::DeduplicatedStream<typename Settings::DeduplicationProperties> deduplicated = {[this]
-				(Detail::DeduplicatingStreamSection section, bool lastCall) {
-		writer.writeBatch(section, lastCall);
-		return section.position;
-	}};
-	typename Settings::DeduplicatorType deduplicator = {input, deduplicated};
 
-	void consume() {
-		std::span<const char> batch = output.getBuffer();
-		consumeFunction(batch);
-		output.cleanBuffer();
+public:
+	OZlibFile(std::function<void(std::span<const char> batch)> consumeFunction) : Deflate(consumeFunction) {
+		consumeFunction(header);
+		fillTrailerWriter();
+	}
+
+	OZlibFile(std::vector<char>& outVector) : Deflate(outVector) {
+		Deflate::output.addBytes(header);
+		fillTrailerWriter();
+	}
+};
+
+#ifndef EZGZ_NO_THREADS
+namespace Detail {
+// Other implementations expect this empty block at the end of every BGZF file
+constexpr std::array<uint8_t, 28> bgzfEndOfFile = {0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 'B', 'C', 0x02, 0, 0x1b, 0, 0x03, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Appends the data compressed into a BGZF block, or into more blocks if it doesn't fit into one after compression
+template <CompressionSettings Settings>
+void compressBgzfBlocks(std::span<const char> data, std::vector<char>& output) {
+	GzFileInfo<std::string> header("");
+	header.modificationTime = 0;
+	header.checksummedHeader = false; // Other implementations expect the compressed data right after the extra field
+	header.extraData = std::vector<uint8_t>{'B', 'C', 2, 0, 0, 0};
+	const size_t start = output.size();
+	{
+		// Too large for the stack with some settings
+		auto compressor = std::make_unique<OGzFile<Settings, std::string>>(header, [&output] (std::span<const char> batch) {
+			output.insert(output.end(), batch.begin(), batch.end());
+		});
+		compressor->writeSome(data);
+	}
+	const size_t blockSize = output.size() - start;
+	if (blockSize > maxBgzfBlockSize) {
+		output.resize(start);
+		compressBgzfBlocks<Settings>(std::span<const char>(data.data(), data.size() / 2), output);
+		compressBgzfBlocks<Settings>(std::span<const char>(data.data() + data.size() / 2, data.size() - data.size() / 2), output);
+		return;
+	}
+	(*header.extraData)[4] = uint8_t((blockSize - 1) & 0xff);
+	(*header.extraData)[5] = uint8_t((blockSize - 1) >> 8);
+	size_t written = start;
+	header.writeOut([&] (std::span<const char> batch) {
+		memcpy(output.data() + written, batch.data(), batch.size());
+		written += batch.size();
+	});
+}
+} // namespace Detail
+
+// Writes a BGZF file, data are split into blocks compressed on multiple threads and written in order, so the output doesn't depend on the number of threads
+template <CompressionSettings Settings = DefaultCompressionSettings>
+class OBgzfFile {
+	std::function<void(std::span<const char> batch)> consumeFunction;
+	std::vector<char> pending;
+	std::deque<std::future<std::vector<char>>> compressing;
+	bool finished = false;
+	ThreadPool pool; // Destroyed first, because the tasks may still be running
+
+	void submit() {
+		if (std::ssize(compressing) > 2 * pool.size()) {
+			writeOutFirst();
+		}
+		compressing.push_back(pool.submit([block = std::move(pending)] {
+			std::vector<char> compressed;
+			Detail::compressBgzfBlocks<Settings>(block, compressed);
+			return compressed;
+		}));
+		pending.clear();
 	}
 
-	std::function<void()> writeTrailer;
+	void writeOutFirst() {
+		std::vector<char> compressed = compressing.front().get();
+		compressing.pop_front();
+		consumeFunction(compressed);
+	}
 
 public:
-	ODeflateArchive(std::function<void(std::span<const char> batch)> consumeFunction) : consumeFunction(std::move(consumeFunction)) { }
+	constexpr static size_t blockInputSize = 0xff00; // Leaves space for headers and incompressible data
+
+	// Zero threads means as many as the hardware can run at once
+	OBgzfFile(std::function<void(std::span<const char> batch)> consumeFunction, int threadCount = 0)
+			: consumeFunction(std::move(consumeFunction)), pool(threadCount) {}
 
 #ifndef EZGZ_NO_FILE
-	// FIXME: We are saving output, not input!
-	ODeflateArchive(const std::string& fileName) : consumeFunction([file = std::make_shared<std::ofstream>(fileName + ".gz", std::ios::binary)] (std::span<const char> batch) mutable {
-		if (!file->good()) {
-			throw std::runtime_error("Can't write file");
-		}
-		file->write(batch.data(), batch.size());
-	}) {}
+	OBgzfFile(const std::string& fileName, int threadCount = 0)
+			: consumeFunction(Detail::writeToFile(fileName, Detail::usesIoUring<typename Settings::Output>)), pool(threadCount) {}
 #endif
 
-	ODeflateArchive(std::vector<char>& outVector) : consumeFunction([&outVector] (std::span<const char> batch) mutable {
-		outVector.insert(outVector.end(), batch.begin(), batch.end());
-	}) {}
+	~OBgzfFile() {
+		if (!finished && !std::uncaught_exceptions()) {
+			finish();
+		}
+	}
 
-	~ODeflateArchive() {
-		flush();
+	void writeSome(std::span<const char> data) {
+		while (data.size() > 0) {
+			size_t added = std::min(blockInputSize - pending.size(), data.size());
+			pending.insert(pending.end(), data.begin(), data.begin() + added);
+			data = std::span<const char>(data.data() + added, data.size() - added);
+			if (pending.size() == blockInputSize) {
+				submit();
+			}
+		}
+	}
+	void writeSome(std::string_view data) {
+		writeSome(std::span<const char>(data.data(), data.size()));
 	}
 
+	// Ends the current block even if it's not full and writes all blocks
 	void flush() {
-		input.doneFilling(0);
-		if (input.hasMoreDataInBuffer()) {
-			deduplicator.deduplicateSome();
+		if (!pending.empty()) {
+			submit();
+		}
+		while (!compressing.empty()) {
+			writeOutFirst();
 		}
-		deduplicator.flush();
-		deduplicated.flush();
-		writer.finalFlush();
-		writeTrailer();
-		output.done();
-		consume();
 	}
 
-	void writeSome(std::span<const char> section) {
-		int position = 0;
-		while (position < std::ssize(section)) {
-			bool doDeduplicate = false;
-			input.refillSome([&] (std::span<uint8_t> outSection) -> int {
-				int copied = std::min(int(section.size() - position), int(outSection.size()));
-				doDeduplicate = (std::ssize(outSection) <= std::ssize(section) * 0.8);
-				memcpy(outSection.data(), section.data() + position, copied);
-				position += copied;
-				return copied;
-			});
-			if (doDeduplicate) {
-				deduplicator.deduplicateSome();
-				consume();
-			}
-		}
+	// Writes everything and the end of file marker, called by the destructor if not called before
+	void finish() {
+		flush();
+		consumeFunction(std::span<const char>(reinterpret_cast<const char*>(Detail::bgzfEndOfFile.data()), Detail::bgzfEndOfFile.size()));
+		finished = true;
 	}
-	void writeSome(std::string_view section) {
-		writeSome(std::span<const char>(section.data(), section.size()));
+};
+
+namespace Detail {
+// Compresses a piece of data into blocks that aren't last and end at a byte boundary, so that other pieces can follow, they can refer to the dictionary
+template <CompressionSettings Settings>
+std::vector<char> deflateChunk(std::span<const char> dictionary, std::span<const char> chunk) {
+	std::vector<char> result;
+	if (chunk.size() == 0) {
+		return result;
 	}
+	ByteOutput<typename Settings::Output, NoChecksum> output;
+	HuffmanWriter<typename Settings::Output, typename Settings::DeduplicationProperties, Settings::HuffmanSectionSize> writer(output);
+	DeduplicatedStream<typename Settings::DeduplicationProperties> deduplicated([&] (DeduplicatingStreamSection section, bool) {
+		writer.writeBatch(section, false);
+		return section.position;
+	});
+	ByteInputWithBuffer<typename Settings::Input, NoChecksum> input([&, position = size_t(0)] (std::span<uint8_t> batch) mutable -> int {
+		size_t copied = 0;
+		while (copied < batch.size() && position < dictionary.size() + chunk.size()) {
+			std::span<const char> source = (position < dictionary.size()) ? dictionary.subspan(position) : chunk.subspan(position - dictionary.size());
+			size_t copying = std::min(batch.size() - copied, source.size());
+			memcpy(batch.data() + copied, source.data(), copying);
+			copied += copying;
+			position += copying;
+		}
+		return int(copied);
+	});
+	auto deduplicator = std::make_unique<typename Settings::DeduplicatorType>(input, deduplicated); // Too large for the stack with some settings
+	deduplicator->indexUntil(ptrdiff_t(dictionary.size()));
+	auto takeOutput = [&] {
+		std::span<const char> batch = output.getBuffer();
+		result.insert(result.end(), batch.begin(), batch.end());
+		output.cleanBuffer();
+	};
 
-	class OpenWritingBuffer {
-		ODeflateArchive* parent = nullptr;
-		std::span<uint8_t> range = {};
-		OpenWritingBuffer(ODeflateArchive* parent) : parent(parent), range(parent->input.startFilling()) { }
-		friend class ODeflateArchive;
+	// Like ODeflateArchive::flush(), each step can fill the output, so it's emptied after each of them
+	do {
+		deduplicator->deduplicateSome();
+		takeOutput();
+	} while (!input.isAtEnd());
+	while (input.hasMoreDataInBuffer()) {
+		deduplicator->deduplicateSome();
+		takeOutput();
+	}
+	deduplicator->flush();
+	takeOutput();
+	deduplicated.flush();
+	takeOutput();
+	writer.syncFlush();
+	output.done();
+	takeOutput();
+	return result;
+}
+} // namespace Detail
 
-	public:
-		OpenWritingBuffer() = default;
-		OpenWritingBuffer(OpenWritingBuffer&& another) {
-			operator=(std::move(another));
+// Writes a .gz file compressed on multiple threads, the data are split into chunks that are compressed separately, but each of them can refer
+// to the end of the previous one, the result is a single member that any implementation can read and doesn't depend on the number of threads
+template <CompressionSettings Settings = DefaultCompressionSettings, BasicStringType StringType = std::string>
+class OParallelGzFile {
+	struct CompressedChunk {
+		std::vector<char> data;
+		uint32_t checksum = 0;
+		size_t size = 0;
+	};
+
+	std::function<void(std::span<const char> batch)> consumeFunction;
+	size_t chunkSize = 0;
+	std::vector<char> pending;
+	std::vector<char> dictionary;
+	std::deque<std::future<CompressedChunk>> compressing;
+	uint32_t checksum = 0;
+	size_t totalSize = 0;
+	bool finished = false;
+	ThreadPool pool; // Destroyed first, because the tasks may still be running
+
+	void submit() {
+		if (std::ssize(compressing) > 2 * pool.size()) {
+			writeOutFirst();
 		}
-		OpenWritingBuffer& operator=(OpenWritingBuffer&& another) {
-			if (parent)
-				throw std::logic_error("OpenWritingBuffer must be finished with doneFilling() before destruction");
-			parent = another.parent;
-			range = another.range;
-			another.parent = nullptr;
-			return *this;
+		std::vector<char> nextDictionary(pending.end() - std::min(pending.size(), dictionarySize), pending.end());
+		compressing.push_back(pool.submit([chunk = std::move(pending), dictionary = std::move(dictionary)] {
+			CompressedChunk compressed;
+			compressed.data = Detail::deflateChunk<Settings>(dictionary, chunk);
+			compressed.checksum = HardwareCrc32()(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size()));
+			compressed.size = chunk.size();
+			return compressed;
+		}));
+		pending.clear();
+		dictionary = std::move(nextDictionary);
+	}
+
+	void writeOutFirst() {
+		CompressedChunk compressed = compressing.front().get();
+		compressing.pop_front();
+		consumeFunction(compressed.data);
+		checksum = crc32Combine(checksum, compressed.checksum, compressed.size);
+		totalSize += compressed.size;
+	}
+
+public:
+	constexpr static size_t defaultChunkSize = 128 * 1024;
+	constexpr static size_t dictionarySize = std::min<size_t>(Detail::maximumCopyDistance, Settings::Input::maxSize / 2); // The compressor keeps no more
+
+	// Zero threads means as many as the hardware can run at once
+	OParallelGzFile(const GzFileInfo<StringType>& header, std::function<void(std::span<const char> batch)> consumeFunction, int threadCount = 0,
+			size_t chunkSize = defaultChunkSize) : consumeFunction(std::move(consumeFunction)), chunkSize(std::max<size_t>(chunkSize, 1)), pool(threadCount) {
+		header.writeOut(this->consumeFunction);
+	}
+
+#ifndef EZGZ_NO_FILE
+	// Like OGzFile, the file is named after the file in the header with the .gz suffix
+	OParallelGzFile(const GzFileInfo<StringType>& header, int threadCount = 0, size_t chunkSize = defaultChunkSize)
+			: OParallelGzFile(header, Detail::writeToFile(std::string(std::string_view(header.name)) + ".gz", Detail::usesIoUring<typename Settings::Output>),
+				threadCount, chunkSize) {}
+#endif
+
+	~OParallelGzFile() {
+		if (!finished && !std::uncaught_exceptions()) {
+			finish();
 		}
-		std::span<uint8_t> accessRange() const {
-			return range;
+	}
+
+	void writeSome(std::span<const char> data) {
+		while (data.size() > 0) {
+			size_t added = std::min(chunkSize - pending.size(), data.size());
+			pending.insert(pending.end(), data.begin(), data.begin() + added);
+			data = std::span<const char>(data.data() + added, data.size() - added);
+			if (pending.size() == chunkSize) {
+				submit();
+			}
 		}
-		void finish(int added) {
-			parent->input.doneFilling(added);
-			parent->deduplicator.deduplicateSome();
-			parent->consume();
-			parent = nullptr;
+	}
+	void writeSome(std::string_view data) {
+		writeSome(std::span<const char>(data.data(), data.size()));
+	}
+
+	// Writes everything, the last block and the trailer, called by the destructor if not called before
+	void finish() {
+		if (!pending.empty()) {
+			submit();
 		}
-		~OpenWritingBuffer() noexcept(false) {
-			if (parent)
-				throw std::logic_error("OpenWritingBuffer must be finished with doneFilling() before destruction");
+		while (!compressing.empty()) {
+			writeOutFirst();
 		}
-	};
-	OpenWritingBuffer openWritingBuffer() {
-		return OpenWritingBuffer(this);
+		constexpr std::array<char, 2> emptyLastBlock = {0x03, 0x00}; // Fixed codes, only the end of block
+		consumeFunction(emptyLastBlock);
+		std::array<uint32_t, 2> trailer = {checksum, uint32_t(totalSize)};
+		consumeFunction(std::span<const char>(reinterpret_cast<const char*>(trailer.data()), sizeof(trailer)));
+		finished = true;
 	}
 };
+#endif
 
-enum class CreatingOperatingSystem {
-	UNIX_BASED,
-	WINDOWS,
-	OTHER
-};
 
-// File information in the .gz file
-template <BasicStringType StringType>
-struct GzFileInfo {
-	int32_t modificationTime = int32_t(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
-	CreatingOperatingSystem operatingSystem = CreatingOperatingSystem::OTHER;
-	bool fastestCompression = false;
-	bool densestCompression = false;
-	std::optional<std::vector<uint8_t>> extraData = {};
-	StringType name;
-	StringType comment;
-	bool probablyText = false;
+#if EZGZ_HAS_COROUTINES
+namespace Detail {
+template <typename T>
+struct AsyncResult {
+	std::optional<T> value;
+	void return_value(T returned) {
+		value = std::move(returned);
+	}
+	T take() {
+		return std::move(*value);
+	}
+};
 
-	GzFileInfo(std::string_view name) : name(name) {}
+template <>
+struct AsyncResult<void> {
+	void return_void() {}
+	void take() {}
+};
+} // namespace Detail
 
-	void writeOut(std::function<void(std::span<const char> batch)> writer) const {
-		LightCrc32 crc = {};
-		auto writeInteger = [&writer, &crc] (auto integer) {
-			std::array<char, sizeof(integer)> buffer = {};
-			memcpy(buffer.data(), &integer, buffer.size());
-			writer(buffer);
-			crc(std::span<const uint8_t>(reinterpret_cast<uint8_t*>(buffer.data()), buffer.size()));
+// A coroutine that starts when awaited and resumes the awaiting coroutine when it's done, it doesn't depend on any executor
+template <typename T = void>
+class [[nodiscard]] AsyncTask {
+public:
+	struct promise_type : Detail::AsyncResult<T> {
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+		std::exception_ptr failure;
+
+		struct FinalAwaiter {
+			bool await_ready() noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> finished) noexcept {
+				return finished.promise().continuation;
+			}
+			void await_resume() noexcept {}
 		};
 
-		writeInteger(uint8_t(0x1f));
-		writeInteger(uint8_t(0x8b));
-		writeInteger(uint8_t(0x08));
-		uint8_t flags = 0x02; // It will have CRC32
-		if (extraData) flags |= 0x04;
-		if (!std::string_view(name).empty()) flags |= 0x08;
-		if (!std::string_view(comment).empty()) flags |= 0x10;
-		if (probablyText) flags |= 0x01;
-		writeInteger(flags);
-		writeInteger(modificationTime);
-		writeInteger(uint8_t((densestCompression ? 4 : 0) | (fastestCompression ? 8 : 0)));
-		writeInteger(uint8_t(operatingSystem == CreatingOperatingSystem::UNIX_BASED ? 3 : (operatingSystem == CreatingOperatingSystem::WINDOWS ? 0 : 255)));
-		if (extraData) {
-			if (extraData->size() > std::numeric_limits<uint16_t>::max())
-				throw std::runtime_error("Cannot save so many extra data in the archive");
-			writeInteger(uint16_t(extraData->size()));
-			for (uint8_t letter : *extraData) {
-				writeInteger(letter);
-			}
+		AsyncTask get_return_object() {
+			return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
 		}
-		auto writeNullTerminatedString = [&] (const StringType& written) {
-			if (!std::string_view(written).empty()) {
-				for (uint8_t letter : std::string_view(written)) {
-					writeInteger(letter);
-				}
-				writeInteger(char(0));
-			}
-		};
-		writeNullTerminatedString(name);
-		writeNullTerminatedString(comment);
-		writeInteger(uint16_t(crc()));
-	}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void unhandled_exception() {
+			failure = std::current_exception();
+		}
+	};
 
-	GzFileInfo(Detail::ByteInput& input) {
-		LightCrc32 checksum = {};
-		auto check = [&checksum] (auto num) -> uint32_t {
-			std::array<uint8_t, sizeof(num)> asBytes = {};
-			memcpy(asBytes.data(), &num, asBytes.size());
-			return checksum(asBytes);
-		};
-		if (input.template getInteger<uint8_t>() != 0x1f || input.template getInteger<uint8_t>() != 0x8b || input.template getInteger<uint8_t>() != 0x08)
-			throw std::runtime_error("Trying to parse something that isn't a Gzip archive");
-		check(0x1f);
-		check(0x8b);
-		check(0x08);
-		uint8_t flags = input.template getInteger<uint8_t>();
-		check(flags);
-		modificationTime = input.template getInteger<uint32_t>();
-		check(modificationTime);
-		uint8_t extraFlags = input.template getInteger<uint8_t>();
-		check(extraFlags);
+private:
+	std::coroutine_handle<promise_type> handle;
+	explicit AsyncTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
 
-		if (extraFlags == 4) {
-			densestCompression = true;
-		} else if (extraFlags == 8) {
-			fastestCompression = true;
+	T result() {
+		if (handle.promise().failure) {
+			std::rethrow_exception(handle.promise().failure);
 		}
-		uint8_t creatingOperatingSystem = input.template getInteger<uint8_t>(); // Was at input[9]
-		check(creatingOperatingSystem);
-		if (creatingOperatingSystem == 0) {
-			operatingSystem = CreatingOperatingSystem::WINDOWS;
-		} else if (creatingOperatingSystem == 3) {
-			operatingSystem = CreatingOperatingSystem::UNIX_BASED;
+		return handle.promise().take();
+	}
+
+public:
+	AsyncTask(AsyncTask&& other) noexcept : handle(other.handle) {
+		other.handle = nullptr;
+	}
+	AsyncTask& operator=(AsyncTask&& other) noexcept {
+		std::swap(handle, other.handle);
+		return *this;
+	}
+	~AsyncTask() {
+		if (handle) {
+			handle.destroy();
 		}
+	}
 
-		if (flags & 0x04) {
-			uint16_t extraHeaderSize = input.template getInteger<uint16_t>();
-			check(extraHeaderSize);
-			int readSoFar = 0;
-			extraData.emplace();
-			while (readSoFar < extraHeaderSize) {
-				std::span<const uint8_t> taken = input.getRange(extraHeaderSize - readSoFar);
-				checksum(taken);
-				extraData->insert(extraData->end(), taken.begin(), taken.end());
-				readSoFar += int(taken.size());
-			}
+	bool await_ready() const noexcept {
+		return handle.done();
+	}
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		handle.promise().continuation = awaiting;
+		return handle;
+	}
+	T await_resume() {
+		return result();
+	}
+
+	// For running it from code that isn't a coroutine, it runs until its first suspension that isn't resumed right away
+	void start() {
+		handle.resume();
+	}
+	bool done() const {
+		return handle.done();
+	}
+	T get() {
+		if (!handle.done()) {
+			throw std::logic_error("AsyncTask was not finished yet");
 		}
-		if (flags & 0x08) {
-			char letter = input.template getInteger<uint8_t>();
-			check(letter);
-			while (letter != '\0') {
-				name += letter;
-				letter = input.template getInteger<uint8_t>();
-				check(letter);
+		return result();
+	}
+};
+
+// Decompresses data from a source that is awaited instead of blocking, the archive is IDeflateArchive, IGzFile or IZlibFile.
+// Each synchronous step of decompression stops when the awaited input runs low and more is awaited before the next one,
+// so that it never runs out in the middle of a step, apart from gzip headers with huge fields, which cause an exception.
+// The source is called with a span to fill and its result is awaited to get the number of bytes written, zero at the end.
+template <template <DecompressionSettings, typename> typename Archive, DecompressionSettings Settings = DefaultDecompressionSettings,
+		typename AsyncSource = std::function<AsyncTask<int>(std::span<uint8_t> batch)>>
+class IAsyncArchive {
+	// A step stops when less input is awaited than the worst case of a stored block, a block header or a gzip trailer with the next header
+	constexpr static size_t inputMargin = 65536 + 4096;
+	constexpr static size_t inputReserve = 4 * inputMargin;
+	constexpr static size_t sourceBatchSize = 65536;
+
+	AsyncSource source;
+	std::vector<uint8_t> pending;
+	size_t pendingStart = 0;
+	bool sourceEnded = false;
+	std::unique_ptr<Archive<Settings, Detail::ByteInputWithBuffer<typename Settings::Input, NoChecksum>>> archive; // Created when there's data for the header
+
+	int takeInput(std::span<uint8_t> batch) {
+		const size_t available = pending.size() - pendingStart;
+		if (available == 0) {
+			if (sourceEnded) {
+				return 0;
 			}
+			throw std::runtime_error("Asynchronous decompression needed more input than was awaited in advance");
 		}
-		if (flags & 0x10) {
-			char letter = input.template getInteger<uint8_t>();
-			check(letter);
-			while (letter != '\0') {
-				comment += letter;
-				letter = input.template getInteger<uint8_t>();
-				check(letter);
-			}
+		const size_t taken = std::min(available, batch.size());
+		memcpy(batch.data(), pending.data() + pendingStart, taken);
+		pendingStart += taken;
+		return int(taken);
+	}
+
+	AsyncTask<void> awaitInput() {
+		if (pendingStart > pending.size() / 2) {
+			pending.erase(pending.begin(), pending.begin() + pendingStart);
+			pendingStart = 0;
 		}
-		if (flags & 0x01) {
-			probablyText = true;
+		while (!sourceEnded && pending.size() - pendingStart < inputReserve) {
+			const size_t previousSize = pending.size();
+			pending.resize(previousSize + sourceBatchSize);
+			const int added = co_await source(std::span<uint8_t>(pending.data() + previousSize, sourceBatchSize));
+			pending.resize(previousSize + size_t(std::max(added, 0)));
+			sourceEnded = (added <= 0);
 		}
-		if (flags & 0x02) {
-			uint16_t expectedHeaderCrc = uint16_t(input.template getInteger<uint16_t>());
-			check(expectedHeaderCrc);
-//			uint16_t realHeaderCrc = checksum(); // Probably bugged
-//			if (expectedHeaderCrc != realHeaderCrc)
-//				throw std::runtime_error("Gzip archive's headers crc32 checksum doesn't match the actual header's checksum");
+		if (!archive) {
+			archive = std::make_unique<typename decltype(archive)::element_type>([this] (std::span<uint8_t> batch) {
+				return takeInput(batch);
+			});
+			archive->pauseWhenInputRunsLow([this] {
+				return !sourceEnded && pending.size() - pendingStart < inputMargin;
+			});
 		}
 	}
-};
 
-// Parses a .gz file, only takes care of the header, the rest is handled by its parent class IDeflateArchive
-template <DecompressionSettings Settings = DefaultDecompressionSettings>
-class IGzFile : public IDeflateArchive<Settings> {
-	GzFileInfo<typename Settings::StringType> parsedHeader;
-	using Deflate = IDeflateArchive<Settings>;
+public:
+	IAsyncArchive(AsyncSource source) : source(std::move(source)) {}
+	IAsyncArchive(const IAsyncArchive&) = delete;
+	IAsyncArchive& operator=(const IAsyncArchive&) = delete;
+
+	// Like IDeflateArchive::readSome(), the data remain valid until the next call
+	AsyncTask<std::optional<std::span<const char>>> readSome(int bytesToKeep = 0) {
+		co_await awaitInput();
+		co_return archive->readSome(bytesToKeep);
+	}
 
-	void onFinish() override {
-		Deflate::output.done();
-		Deflate::output.cleanBuffer();
-		uint32_t expectedCrc = Deflate::input.template getInteger<uint32_t>();
-		if constexpr(Settings::verifyChecksum) {
-			auto realCrc = Deflate::output.getChecksum()();
-			if (expectedCrc != realCrc)
-				throw std::runtime_error("Gzip archive's crc32 checksum doesn't match the calculated checksum");
+	AsyncTask<std::vector<char>> readAll() {
+		std::vector<char> result;
+		while (std::optional<std::span<const char>> batch = co_await readSome()) {
+			result.insert(result.end(), batch->begin(), batch->end());
 		}
+		co_return result;
 	}
 
-public:
-	IGzFile(std::function<int(std::span<uint8_t> batch)> readMoreFunction) : Deflate(readMoreFunction), parsedHeader(Deflate::input) {}
-	IGzFile(const std::string& fileName) : Deflate(fileName), parsedHeader(Deflate::input) {}
-	IGzFile(std::span<const uint8_t> data) : Deflate(data), parsedHeader(Deflate::input) {}
-
-	const GzFileInfo<typename Settings::StringType>& info() const {
-		return parsedHeader;
+	// The header of a .gz file, only after something was read
+	const auto& info() const {
+		return archive->info();
 	}
 };
 
-// Writes a .gz file, only takes care of the header, the rest is handled by its parent class ODeflateArchive
-template <CompressionSettings Settings, BasicStringType StringType>
-class OGzFile : public ODeflateArchive<Settings, FastCrc32> {
-	void fillTrailerWriter() {
-		ODeflateArchive<Settings, FastCrc32>::writeAtEnd([this] {
-			auto writeInteger = [this] (uint32_t value) {
-				std::array<char, sizeof(uint32_t)> bytes = {};
-				memcpy(bytes.data(), &value, bytes.size());
-				ODeflateArchive<Settings, FastCrc32>::output.addBytes(bytes);
-			};
-			writeInteger(uint32_t(ODeflateArchive<Settings, FastCrc32>::input.checksum()));
-			writeInteger(uint32_t(ODeflateArchive<Settings, FastCrc32>::input.getPosition() + ODeflateArchive<Settings, FastCrc32>::input.getPositionStart()));
-		});
+template <DecompressionSettings Settings = DefaultDecompressionSettings, typename AsyncSource = std::function<AsyncTask<int>(std::span<uint8_t> batch)>>
+using IAsyncDeflateArchive = IAsyncArchive<IDeflateArchive, Settings, AsyncSource>;
+template <DecompressionSettings Settings = DefaultDecompressionSettings, typename AsyncSource = std::function<AsyncTask<int>(std::span<uint8_t> batch)>>
+using IAsyncGzFile = IAsyncArchive<IGzFile, Settings, AsyncSource>;
+template <DecompressionSettings Settings = DefaultDecompressionSettings, typename AsyncSource = std::function<AsyncTask<int>(std::span<uint8_t> batch)>>
+using IAsyncZlibFile = IAsyncArchive<IZlibFile, Settings, AsyncSource>;
+
+// Compresses data and awaits a sink with the output instead of calling a blocking function, the archive is ODeflateArchive,
+// OGzFile or OZlibFile, constructed from the arguments after the sink followed by a function consuming its output.
+// The sink is called with a batch of output and its result is awaited, finish() must be awaited at the end.
+template <typename Archive, typename AsyncSink = std::function<AsyncTask<void>(std::span<const char> batch)>>
+class OAsyncArchive {
+	AsyncSink sink;
+	std::vector<char> pending;
+	std::unique_ptr<Archive> archive;
+
+	AsyncTask<void> sendPending() {
+		if (!pending.empty()) {
+			co_await sink(std::span<const char>(pending.data(), pending.size()));
+			pending.clear();
+		}
 	}
 
 public:
-	OGzFile(const GzFileInfo<StringType>& header, std::function<void(std::span<const char> batch)> consumeFunction)
-	: ODeflateArchive<Settings, FastCrc32>(consumeFunction) {
-		header.writeOut(consumeFunction);
-		fillTrailerWriter();
+	template <typename... ArchiveArguments>
+	OAsyncArchive(AsyncSink sink, ArchiveArguments&&... archiveArguments) : sink(std::move(sink)),
+			archive(std::make_unique<Archive>(std::forward<ArchiveArguments>(archiveArguments)..., [this] (std::span<const char> batch) {
+		pending.insert(pending.end(), batch.begin(), batch.end());
+	})) {}
+	OAsyncArchive(const OAsyncArchive&) = delete;
+	OAsyncArchive& operator=(const OAsyncArchive&) = delete;
+
+	AsyncTask<void> writeSome(std::span<const char> section) {
+		if (!archive) {
+			throw std::logic_error("Writing into a finished OAsyncArchive");
+		}
+		archive->writeSome(section);
+		co_await sendPending();
+	}
+	AsyncTask<void> writeSome(std::string_view section) {
+		return writeSome(std::span<const char>(section.data(), section.size()));
 	}
 
-#ifndef EZGZ_NO_FILE
-	OGzFile(const GzFileInfo<StringType>& header) : ODeflateArchive<Settings, FastCrc32>(header.name) {
-		header.writeOut([this] (std::span<const char> batch) {
-			ODeflateArchive<Settings, FastCrc32>::output.addBytes(batch);
-		});
-		fillTrailerWriter();
+	// Writes the end of the data, nothing can be written afterwards
+	AsyncTask<void> finish() {
+		archive.reset(); // The archive writes the rest when destroyed
+		co_await sendPending();
 	}
-#endif
 };
 
+template <CompressionSettings Settings = DefaultCompressionSettings, typename AsyncSink = std::function<AsyncTask<void>(std::span<const char> batch)>>
+using OAsyncDeflateArchive = OAsyncArchive<ODeflateArchive<Settings>, AsyncSink>;
+template <CompressionSettings Settings = DefaultCompressionSettings, BasicStringType StringType = std::string,
+		typename AsyncSink = std::function<AsyncTask<void>(std::span<const char> batch)>>
+using OAsyncGzFile = OAsyncArchive<OGzFile<Settings, StringType>, AsyncSink>;
+template <CompressionSettings Settings = DefaultCompressionSettings, typename AsyncSink = std::function<AsyncTask<void>(std::span<const char> batch)>>
+using OAsyncZlibFile = OAsyncArchive<OZlibFile<Settings>, AsyncSink>;
+#endif
 
 namespace Detail {
 template <DecompressionSettings Settings = DefaultDecompressionSettings>
@@ -2806,10 +6721,47 @@ class IGzStreamBuffer : public std::streambuf {
 	IGzFile<Settings> inputFile;
 	int bytesToKeep = 10;
 	ptrdiff_t produced = 0;
+	std::optional<GzIndex> index;
 public:
 	template<typename Arg>
 	IGzStreamBuffer(const Arg& arg, int bytesToKeep) : inputFile(arg), bytesToKeep(bytesToKeep) {}
 
+	// Allows seeking outside the data in the buffer, if constructed from a file name or a span
+	void setIndex(GzIndex newIndex) {
+		index = std::move(newIndex);
+	}
+
+	pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which = std::ios_base::in) override {
+		const pos_type failed = pos_type(off_type(-1));
+		ptrdiff_t target = ptrdiff_t(offset);
+		if (direction == std::ios_base::cur) {
+			target += produced - (egptr() - gptr());
+		} else if (direction == std::ios_base::end) {
+			if (!index) {
+				return failed;
+			}
+			target += ptrdiff_t(index->decompressedSize);
+		}
+		if (!(which & std::ios_base::in) || target < 0) {
+			return failed;
+		}
+		if (target >= produced - (egptr() - eback()) && target <= produced) {
+			setg(eback(), egptr() - (produced - target), egptr()); // Still in the buffer
+			return pos_type(off_type(target));
+		}
+		if (!index || size_t(target) > index->decompressedSize) {
+			return failed;
+		}
+		inputFile.seek(*index, size_t(target));
+		produced = target;
+		setg(nullptr, nullptr, nullptr);
+		return pos_type(off_type(target));
+	}
+
+	pos_type seekpos(pos_type position, std::ios_base::openmode which = std::ios_base::in) override {
+		return seekoff(off_type(position), std::ios_base::beg, which);
+	}
+
 	int underflow() override {
 		std::optional<std::span<const char>> batch = inputFile.readSome(bytesToKeep);
 		if (batch.has_value()) {
@@ -2828,6 +6780,147 @@ public:
 	}
 };
 
+#ifndef EZGZ_NO_THREADS
+// Decompresses on a worker thread a few batches ahead of the reader, the batches are handed over through a ring of buffers
+// with one producer and one consumer, the lock is used only to sleep when the ring is full or empty
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+class IPipelinedGzStreamBuffer : public std::streambuf {
+	constexpr static int slotCount = 4;
+	struct Slot {
+		std::vector<char> data; // Starts with the last bytes of the previous batch, for putting back
+		int kept = 0;
+		bool last = false;
+	};
+
+	std::unique_ptr<IGzFile<Settings>> inputFile; // Used only by the worker after construction
+	int bytesToKeep = 10;
+	std::array<Slot, slotCount> slots;
+	std::atomic<uint64_t> filledSlots = 0; // Written only by the worker
+	std::atomic<uint64_t> drainedSlots = 0; // Written only by the reader
+	std::atomic<bool> stopping = false;
+	std::exception_ptr failure;
+	bool holdingSlot = false;
+	std::atomic<int> sleeping = 0; // The lock is taken to notify only if a thread is sleeping or about to sleep
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread worker;
+
+	// The counters are changed before checking sleeping and sleeping is changed before checking them, so one of them is seen
+	void notify() {
+		if (sleeping.load() > 0) {
+			{
+				std::lock_guard<std::mutex> guard(lock); // A thread about to sleep can't miss the notification
+			}
+			changed.notify_all();
+		}
+	}
+
+	template <typename Condition>
+	void sleepUntil(const Condition& condition) {
+		std::unique_lock<std::mutex> guard(lock);
+		sleeping++;
+		changed.wait(guard, condition);
+		sleeping--;
+	}
+
+	// Returns nullptr if stopping
+	Slot* waitForFreeSlot() {
+		const uint64_t filled = filledSlots.load(std::memory_order_relaxed);
+		auto isFree = [&] {
+			return stopping.load() || filled - drainedSlots.load() < slotCount;
+		};
+		if (!isFree()) {
+			sleepUntil(isFree);
+		}
+		return stopping.load() ? nullptr : &slots[filled % slotCount];
+	}
+
+	void publishSlot() {
+		filledSlots.store(filledSlots.load(std::memory_order_relaxed) + 1);
+		notify();
+	}
+
+	void work() {
+		try {
+			std::vector<char> tail;
+			while (true) {
+				std::optional<std::span<const char>> batch = inputFile->readSome();
+				Slot* slot = waitForFreeSlot();
+				if (!slot) {
+					return;
+				}
+				slot->data.assign(tail.begin(), tail.end());
+				slot->kept = int(tail.size());
+				slot->last = !batch.has_value();
+				if (slot->last) {
+					publishSlot();
+					return;
+				}
+				slot->data.insert(slot->data.end(), batch->begin(), batch->end());
+				const size_t tailSize = std::min<size_t>(bytesToKeep, slot->data.size());
+				tail.assign(slot->data.end() - tailSize, slot->data.end());
+				publishSlot();
+			}
+		} catch (...) {
+			failure = std::current_exception();
+			if (Slot* slot = waitForFreeSlot()) {
+				slot->data.clear();
+				slot->kept = 0;
+				slot->last = true;
+				publishSlot();
+			}
+		}
+	}
+
+public:
+	template<typename Arg>
+	IPipelinedGzStreamBuffer(const Arg& arg, int bytesToKeep) : inputFile(std::make_unique<IGzFile<Settings>>(arg)), bytesToKeep(bytesToKeep) {
+		worker = std::thread([this] { work(); });
+	}
+	IPipelinedGzStreamBuffer(const IPipelinedGzStreamBuffer&) = delete;
+	IPipelinedGzStreamBuffer& operator=(const IPipelinedGzStreamBuffer&) = delete;
+
+	~IPipelinedGzStreamBuffer() {
+		stopping = true;
+		notify();
+		worker.join();
+	}
+
+	int underflow() override {
+		uint64_t drained = drainedSlots.load(std::memory_order_relaxed);
+		if (holdingSlot) {
+			if (slots[drained % slotCount].last) {
+				return traits_type::eof();
+			}
+			drainedSlots.store(++drained);
+			holdingSlot = false;
+			notify();
+		}
+		auto isFilled = [&] {
+			return filledSlots.load() > drained;
+		};
+		if (!isFilled()) {
+			sleepUntil(isFilled);
+		}
+		Slot& slot = slots[drained % slotCount];
+		holdingSlot = true;
+		if (slot.last) {
+			setg(nullptr, nullptr, nullptr);
+			if (failure) {
+				std::rethrow_exception(failure);
+			}
+			return traits_type::eof();
+		}
+		setg(slot.data.data(), slot.data.data() + slot.kept, slot.data.data() + slot.data.size());
+		return traits_type::to_int_type(*gptr());
+	}
+
+	const GzFileInfo<typename Settings::StringType>& info() const {
+		return inputFile->info(); // Not changed after the constructor
+	}
+};
+#endif
+
 template <CompressionSettings Settings, BasicStringType StringType>
 class OGzStreamBuffer : public std::streambuf {
 	OGzFile<Settings, StringType> outputFile;
@@ -2888,7 +6981,26 @@ public:
 	}, bytesToKeep), std::istream(this) {}
 
 	using Detail::IGzStreamBuffer<Settings>::info;
+	using Detail::IGzStreamBuffer<Settings>::setIndex;
+};
+
+#ifndef EZGZ_NO_THREADS
+// Like BasicIGzStream, but reads and decompresses on another thread while the previous data are being parsed, it can't seek
+// The function reading more data is called from that thread
+template <DecompressionSettings Settings = DefaultDecompressionSettings>
+class BasicIPipelinedGzStream : private Detail::IPipelinedGzStreamBuffer<Settings>, public std::istream
+{
+public:
+#ifndef EZGZ_NO_FILE
+	BasicIPipelinedGzStream(const std::string& sourceFile, int bytesToKeep = 10) : Detail::IPipelinedGzStreamBuffer<Settings>(sourceFile, bytesToKeep), std::istream(this) {}
+#endif
+	BasicIPipelinedGzStream(std::span<const uint8_t> data, int bytesToKeep = 10) : Detail::IPipelinedGzStreamBuffer<Settings>(data, bytesToKeep), std::istream(this) {}
+	BasicIPipelinedGzStream(std::function<int(std::span<uint8_t> batch)> readMoreFunction, int bytesToKeep = 10)
+		: Detail::IPipelinedGzStreamBuffer<Settings>(readMoreFunction, bytesToKeep), std::istream(this) {}
+
+	using Detail::IPipelinedGzStreamBuffer<Settings>::info;
 };
+#endif
 
 template <CompressionSettings Settings = DefaultCompressionSettings, BasicStringType StringType = std::string>
 class BasicOGzStream : private Detail::OGzStreamBuffer<Settings, StringType>, public std::ostream {
@@ -2906,6 +7018,9 @@ public:
 // Most obvious usage, default settings
 using IGzStream = BasicIGzStream<>;
 using OGzStream = BasicOGzStream<>;
+#ifndef EZGZ_NO_THREADS
+using IPipelinedGzStream = BasicIPipelinedGzStream<>;
+#endif
 } // namespace EzGz
 
 #if ! EZGZ_HAS_CONCEPTS
@@ -2916,6 +7031,8 @@ using OGzStream = BasicOGzStream<>;
 #undef ByteReader
 #undef DeduplicatingSearch
 #undef CompressionSettings
+#undef InputSource
+#undef OutputSink
 #endif
 
 #endif // EZGZ_HPP
@@ -31,6 +31,41 @@ struct SettingsWithOutputSize : EzGz::DefaultDecompressionSettings {
 	using Output = TestStreamSettings<MaxSize, MinSize>;
 };
 
+template <int RootBits>
+struct SettingsWithTableRootBits : EzGz::DefaultDecompressionSettings {
+	constexpr static int huffmanTableRootBits = RootBits;
+};
+
+struct MirroredDecompressionSettings : EzGz::DefaultDecompressionSettings {
+	struct Input : DefaultDecompressionSettings::Input {
+		constexpr static bool mirrored = true;
+	};
+	struct Output : DefaultDecompressionSettings::Output {
+		constexpr static bool mirrored = true;
+	};
+};
+
+struct MirroredCompressionSettings : EzGz::DefaultCompressionSettings {
+	struct Input : DefaultCompressionSettings::Input {
+		constexpr static bool mirrored = true;
+	};
+	struct Output : DefaultCompressionSettings::Output {
+		constexpr static bool mirrored = true;
+	};
+};
+
+struct IoUringDecompressionSettings : EzGz::DefaultDecompressionSettings {
+	struct Input : DefaultDecompressionSettings::Input {
+		constexpr static bool ioUring = true;
+	};
+};
+
+struct IoUringCompressionSettings : EzGz::DefaultCompressionSettings {
+	struct Output : DefaultCompressionSettings::Output {
+		constexpr static bool ioUring = true;
+	};
+};
+
 template <int MaxSize, int MinSize = 0, int LookAheadSize = sizeof(uint32_t)>
 struct InputHelper : EzGz::Detail::ByteInputWithBuffer<typename SettingsWithInputSize<MaxSize, MinSize, LookAheadSize>::Input, typename SettingsWithInputSize<MaxSize, MinSize, LookAheadSize>::Checksum> {
 	InputHelper(std::span<const uint8_t> source)
@@ -546,6 +581,30 @@ int main(int, char**) {
 		}
 	}
 
+	{
+		std::cout << "Testing ByteOutput repetition" << std::endl;
+		int mismatches = 0;
+		for (int distance = 1; distance <= 40; distance++) {
+			for (int length : {3, 4, 7, 15, 16, 17, 31, 33, 100, 258}) {
+				auto output = std::make_unique<ByteOutput<DefaultDecompressionSettings::Output, NoChecksum>>();
+				std::string expected;
+				for (int i = 0; i < distance; i++) {
+					expected += char('a' + i % 26);
+					output->addByte(expected.back());
+				}
+				for (int i = 0; i < length; i++) {
+					expected += expected[expected.size() - distance];
+				}
+				output->repeatSequence(length, distance);
+				output->addByte('!');
+				expected += '!';
+				std::span<const char> written = output->getBuffer();
+				mismatches += (std::string_view(written.data(), written.size()) != expected);
+			}
+		}
+		doATest(mismatches, 0);
+	}
+
 	{
 		std::cout << "Testing EncodedTable with a long word" << std::endl;
 		constexpr static std::array<uint8_t, 9> data = { 0b10110111, 0b00111001, 0b00100001, 0b11111101, 0b11111111, 0b10101000, 0b00000000, 0b000001000 };
@@ -575,6 +634,111 @@ int main(int, char**) {
 		doATest(table.readWord(), 'A');
 	}
 
+	{
+		std::cout << "Testing HuffmanDecodingTable" << std::endl;
+		// Symbol i has length i + 1, symbol 15 has length 15 too, every code is a sequence of ones ending with a zero (except the last one)
+		constexpr static std::array<uint8_t, 16> lengths = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 15};
+		constexpr static std::array<int, 9> symbols = {0, 15, 14, 7, 3, 15, 1, 8, 0};
+		std::vector<uint8_t> data(16);
+		int bitsWritten = 0;
+		for (int symbol : symbols) {
+			int ones = std::min(symbol, 14) + (symbol == 15);
+			for (int i = 0; i < lengths[symbol]; i++, bitsWritten++) {
+				if (i < ones)
+					data[bitsWritten / 8] |= uint8_t(1 << (bitsWritten % 8));
+			}
+		}
+
+		auto checkTable = [&] (auto makeTableAndRead) {
+			InputHelper<32> byteReader(data);
+			BitReader reader(&byteReader);
+			std::vector<int> decoded = makeTableAndRead(reader);
+			doATest(std::equal(decoded.begin(), decoded.end(), symbols.begin(), symbols.end()), true);
+		};
+		checkTable([&] (BitReader& reader) {
+			HuffmanDecodingTable<16, 4> table(lengths);
+			std::vector<int> decoded;
+			for (int i = 0; i < std::ssize(symbols); i++)
+				decoded.push_back(table.readWord(reader));
+			return decoded;
+		});
+		checkTable([&] (BitReader& reader) {
+			HuffmanDecodingTable<16, 10> table(lengths);
+			std::vector<int> decoded;
+			for (int i = 0; i < std::ssize(symbols); i++)
+				decoded.push_back(table.readWord(reader));
+			return decoded;
+		});
+		checkTable([&] (BitReader& reader) {
+			EncodedTable<16> table(reader, lengths);
+			std::vector<int> decoded;
+			for (int i = 0; i < std::ssize(symbols); i++)
+				decoded.push_back(table.readWord());
+			return decoded;
+		});
+	}
+
+	{
+		std::cout << "Testing HuffmanDecodingTable with extra bits" << std::endl;
+		std::array<uint8_t, 288> codeLengths = {};
+		std::fill_n(codeLengths.begin(), 144, 8);
+		std::fill_n(codeLengths.begin() + 144, 112, 9);
+		std::fill_n(codeLengths.begin() + 256, 24, 7);
+		std::fill_n(codeLengths.begin() + 280, 8, 8);
+		std::array<uint8_t, 32> distanceLengths = {};
+		std::fill_n(distanceLengths.begin(), 32, 5);
+		HuffmanDecodingTable<288, 9> codes(codeLengths, literalAndLengthSymbols.data());
+		HuffmanDecodingTable<32, 5> distances(distanceLengths, distanceSymbols.data());
+
+		uint64_t bits = 0;
+		int bitsWritten = 0;
+		auto addCode = [&] (int code, int length) {
+			bits |= uint64_t(reverseBits(uint16_t(code), length)) << bitsWritten;
+			bitsWritten += length;
+		};
+		addCode(0b0001001, 7); // Word 265, length 11 or 12
+		addCode(0b1, 1);
+		addCode(0b01010, 5); // Distance word 10, distance 33 to 48
+		addCode(0b0101, 4);
+
+		auto lengthEntry = codes.lookup(bits);
+		doATest(int(lengthEntry.length), 7);
+		doATest(int(lengthEntry.extraBits), 1);
+		doATest(lengthEntry.word - copyLengthWordOffset + int((bits >> lengthEntry.length) & 1), 12);
+		auto distanceEntry = distances.lookup(bits >> 8);
+		doATest(int(distanceEntry.length), 5);
+		doATest(int(distanceEntry.extraBits), 4);
+		doATest(distanceEntry.word + int((bits >> 13) & 0xf), 43);
+
+		bool failed = false;
+		try {
+			distances.lookup(0b01111); // Word 30 must not appear
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+
+		// The tables generated at compile time must be the same
+		auto entriesMatch = [] (const auto& table, const auto& fixedTable, int size) {
+			for (int i = 0; i < size; i++) {
+				std::optional<std::tuple<int, int, int>> entry, fixedEntry;
+				try {
+					auto found = table.lookup(i);
+					entry = std::make_tuple(found.word, found.length, found.extraBits);
+				} catch (std::runtime_error&) {}
+				try {
+					auto found = fixedTable.lookup(i);
+					fixedEntry = std::make_tuple(found.word, found.length, found.extraBits);
+				} catch (std::runtime_error&) {}
+				if (entry != fixedEntry)
+					return false;
+			}
+			return true;
+		};
+		doATest(entriesMatch(codes, fixedCodeTable, 1 << 9), true);
+		doATest(entriesMatch(distances, fixedDistanceTable, 1 << 5), true);
+	}
+
 	{
 		std::cout << "Testing Deduplicator" << std::endl;
 		std::string input = "hello hello hello hello\n";
@@ -681,6 +845,10 @@ int main(int, char**) {
 		std::vector<char> output = readDeflateIntoVector(data);
 		std::string_view outputStr(output.data(), output.size());
 		doATest(outputStr, "abaabbbabaababbaababaaaabaaabbbbbaa");
+		std::vector<char> outputByteIndexed = readDeflateIntoVector<SettingsWithTableRootBits<0>>(data);
+		doATest(std::string_view(outputByteIndexed.data(), outputByteIndexed.size()), "abaabbbabaababbaababaaaabaaabbbbbaa");
+		std::vector<char> outputShortRoot = readDeflateIntoVector<SettingsWithTableRootBits<3>>(data);
+		doATest(std::string_view(outputShortRoot.data(), outputShortRoot.size()), "abaabbbabaababbaababaaaabaaabbbbbaa");
 	}
 
 	{
@@ -751,6 +919,32 @@ int main(int, char**) {
 		doATest(int(uint8_t(obtained[10])), 0x00);
 	}
 
+	{
+		std::cout << "Testing Huffman compression fixed length code 279" << std::endl;
+		Detail::ByteOutput<TestStreamSettings<20, 8>, NoChecksum> output;
+		{
+			Detail::HuffmanWriter<TestStreamSettings<20, 8>, TestStreamSettings<30, 13>> writer(output);
+			auto reader = [&] (Detail::DeduplicatingStreamSection section, bool lastCall) {
+				writer.writeBatch(section, lastCall);
+				return section.position;
+			};
+			{
+				Detail::DeduplicatedStream<TestStreamSettings<30, 13>> stream(reader);
+				stream.addByte('a');
+				stream.addDuplication(100, 1); // Lengths 99-114 use code 279, which has 7 bits
+				stream.addByte('\n');
+			}
+		}
+		output.done();
+		std::span<const char> obtained = output.getBuffer();
+		// Encoded by hand and checked with zlib
+		constexpr static std::array<uint8_t, 6> expected = {0x4b, 0xa4, 0x07, 0xe0, 0x02, 0x00};
+		doATest(std::ssize(obtained), std::ssize(expected));
+		doATest(memcmp(obtained.data(), expected.data(), expected.size()), 0);
+		std::vector<char> decoded = readDeflateIntoVector(expected);
+		doATest(std::string_view(decoded.data(), decoded.size()), std::string(101, 'a') + "\n");
+	}
+
 	{
 		std::cout << "Testing Huffman compression dynamic" << std::endl;
 		Detail::ByteOutput<TestStreamSettings<80, 35>, NoChecksum> output;
@@ -791,6 +985,64 @@ int main(int, char**) {
 		doATest(decompressedStr, "abaabbbabaababbaababaaaabaaabbbbbaa");
 	}
 
+	{
+		std::cout << "Testing a copy cut off by a full output at the end of a block" << std::endl;
+		// Compressed by zlib, the last copy of a run doesn't fit into the initially allocated output and the block ends after it
+		constexpr static std::array<uint8_t, 100> shortRun = {
+				0xed, 0x8c, 0xc9, 0x15, 0x40, 0x40, 0x14, 0x04, 0x53, 0xe9, 0x08, 0x3c, 0xfb, 0x92, 0x85, 0x83,
+				0x04, 0x06, 0x83, 0xb1, 0x7d, 0x86, 0xb1, 0x45, 0xef, 0xc7, 0xe0, 0xe2, 0x32, 0x75, 0xed, 0xaa,
+				0x2e, 0x3a, 0x89, 0xd5, 0xa8, 0x6a, 0x40, 0xa9, 0xe9, 0x9c, 0xd1, 0xd0, 0x85, 0xde, 0x4c, 0xcb,
+				0x06, 0x3a, 0xa4, 0xc6, 0xce, 0xf3, 0x28, 0x9e, 0x1b, 0x35, 0xb5, 0x70, 0x3d, 0x3f, 0x08, 0xa3,
+				0x38, 0x49, 0x33, 0x14, 0xdf, 0xb2, 0x5c, 0x70, 0x31, 0xdd, 0x28, 0x59, 0x3f, 0xd5, 0xde, 0xa1,
+				0x51, 0x87, 0x64, 0xe9, 0x91, 0x33, 0x46, 0xb5, 0x1a, 0xd2, 0xfc, 0xd2, 0x6e, 0x0e, 0x84, 0xc5,
+				0x62, 0xf9, 0x81, 0x17
+		};
+		std::string fox = "The quick brown fox jumps over the lazy dog 0123456789 ";
+		std::string shortText = fox + fox + "Pack my box with five dozen liquor jugs. " + std::string(1041 - 151, 'a');
+		std::vector<char> decompressed = readDeflateIntoVector(shortRun);
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == shortText, true);
+		std::vector<char> decompressedByteIndexed = readDeflateIntoVector<SettingsWithTableRootBits<0>>(shortRun);
+		doATest(std::string_view(decompressedByteIndexed.data(), decompressedByteIndexed.size()) == shortText, true);
+
+		// Here, the output batch is filled by a copy just before the end of the block
+		std::vector<uint8_t> longRun = {
+				0xed, 0xc9, 0xc9, 0x01, 0xc1, 0x50, 0x00, 0x05, 0xc0, 0x56, 0x5e, 0x09, 0xf6, 0xa5, 0x0f, 0x0d,
+				0x84, 0xc4, 0xce, 0x27, 0xc4, 0x56, 0x3d, 0x65, 0x38, 0xcc, 0x5c, 0x67, 0xb1, 0x6d, 0x72, 0xed,
+				0x76, 0xab, 0x43, 0x96, 0x6d, 0x79, 0x9e, 0xb3, 0x2e, 0xaf, 0xec, 0xbb, 0xd3, 0xe5, 0x96, 0xf2,
+				0x68, 0xda, 0xdc, 0x7f, 0x7d, 0xac, 0x3e, 0xef, 0xd4, 0x65, 0x93, 0x5e, 0x7f, 0x30, 0x1c, 0x8d,
+				0x27, 0xd3, 0xd9, 0x3c, 0x15
+		};
+		longRun.resize(longRun.size() + 96); // Copies of maximal length are encoded as zero bits
+		longRun.insert(longRun.end(), {0xf0, 0x67, 0xbe});
+		std::string longText = fox + std::string(99990, 'a');
+		std::string streamed;
+		IDeflateArchive<> archive(longRun);
+		while (std::optional<std::span<const char>> batch = archive.readSome()) {
+			streamed.append(batch->data(), batch->size());
+		}
+		doATest(streamed == longText, true);
+		std::string streamedByteIndexed;
+		IDeflateArchive<SettingsWithTableRootBits<0>> archiveByteIndexed(longRun);
+		while (std::optional<std::span<const char>> batch = archiveByteIndexed.readSome()) {
+			streamedByteIndexed.append(batch->data(), batch->size());
+		}
+		doATest(streamedByteIndexed == longText, true);
+	}
+
+	{
+		std::cout << "Testing Deflate into a vector with incompressible data" << std::endl;
+		std::string text;
+		uint32_t state = 1;
+		while (text.size() < 100000) {
+			state = state * 1103515245 + 12345;
+			text += char(state >> 16);
+		}
+		std::vector<uint8_t> compressed = writeDeflateIntoVector<DefaultCompressionSettings>(text);
+		std::vector<char> decompressed = readDeflateIntoVector(compressed);
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		doATest(decompressed.capacity() < text.size() * 2, true);
+	}
+
 	{
 		std::cout << "Testing Huffman compression together" << std::endl;
 		std::string_view text = "BAACCEACAAAEBAACEABAEDEACEAACAAECCAADAEAACAEADAA";
@@ -800,6 +1052,64 @@ int main(int, char**) {
 		doATest(decompressedStr, "BAACCEACAAAEBAACEABAEDEACEAACAAECCAADAEAACAEADAA");
 	}
 
+	{
+		std::cout << "Testing Deflate with input in small batches" << std::endl;
+		std::string text;
+		uint32_t state = 1;
+		constexpr static std::array<std::string_view, 6> words = {"deflate ", "inflate ", "buffer ", "\n", "    ", "0000000000000000"};
+		while (text.size() < 200000) {
+			state = state * 1103515245 + 12345;
+			text += words[(state >> 16) % words.size()];
+			text += char('a' + (state >> 8) % 26);
+		}
+		std::vector<uint8_t> compressed = writeDeflateIntoVector<DefaultCompressionSettings>(text);
+		for (int batchSize : {1, 2, 5}) {
+			std::vector<char> decompressed = readDeflateIntoVector([&compressed, batchSize, position = 0] (std::span<uint8_t> toFill) mutable -> int {
+				int filling = std::min({int(compressed.size()) - position, int(toFill.size()), batchSize});
+				if (filling != 0)
+					memcpy(toFill.data(), &compressed[position], filling);
+				position += filling;
+				return filling;
+			});
+			doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		}
+		std::vector<uint8_t> gzipped;
+		auto gzCompressor = std::make_unique<OGzFile<DefaultCompressionSettings, std::string>>(GzFileInfo<std::string>("batches"), [&] (std::span<const char> batch) {
+			gzipped.insert(gzipped.end(), batch.begin(), batch.end());
+		});
+		gzCompressor->writeSome(std::string_view(text));
+		gzCompressor.reset(); // Writes the trailer
+		auto byBytes = std::make_unique<IGzFile<>>([&gzipped, position = size_t(0)] (std::span<uint8_t> toFill) mutable -> int {
+			int filling = int(std::min<size_t>({gzipped.size() - position, toFill.size(), 1}));
+			if (filling != 0)
+				memcpy(toFill.data(), &gzipped[position], filling);
+			position += filling;
+			return filling;
+		});
+		std::vector<char> fromBytes = byBytes->readAll();
+		doATest(std::string_view(fromBytes.data(), fromBytes.size()) == text, true);
+
+		std::cout << "Testing mirrored buffers" << std::endl;
+		MirroredMemory memory(1000);
+		memory.data()[0] = 'a';
+		doATest(memory.isMirrored() ? memory.data()[memory.period()] : 'a', 'a');
+
+		std::vector<uint8_t> compressedMirrored = writeDeflateIntoVector<MirroredCompressionSettings>(text);
+		doATest(compressedMirrored == compressed, true);
+		std::string decompressedMirrored;
+		IDeflateArchive<MirroredDecompressionSettings> archive([&compressed, position = 0] (std::span<uint8_t> toFill) mutable -> int {
+			int filling = std::min({int(compressed.size()) - position, int(toFill.size()), 1000});
+			if (filling != 0)
+				memcpy(toFill.data(), &compressed[position], filling);
+			position += filling;
+			return filling;
+		});
+		archive.readAll([&] (std::span<const char> batch) {
+			decompressedMirrored.append(batch.data(), batch.size());
+		});
+		doATest(decompressedMirrored == text, true);
+	}
+
 	{
 		std::cout << "Testing crc32" << std::endl;
 		constexpr static std::array<uint8_t, 6> data = { 'J', 'e', 'd', 'e', 'n', ' '};
@@ -829,6 +1139,64 @@ int main(int, char**) {
 		std::vector<char> decompressed = file.readAll();
 		std::string_view decompressedStr(reinterpret_cast<const char*>(decompressed.data()), decompressed.size());
 		doATest(decompressedStr, "hello hello hello hello\n");
+
+		std::cout << "Testing Gz file reading into a buffer" << std::endl;
+		IGzFile fileForBuffer(data);
+		doATest(int(fileForBuffer.sizeHint()), 24);
+		std::vector<char> buffer(fileForBuffer.sizeHint());
+		size_t bytesRead = fileForBuffer.readAll(buffer);
+		doATest(std::string_view(buffer.data(), bytesRead), "hello hello hello hello\n");
+
+		auto throwsError = [] (auto function) {
+			try {
+				function();
+			} catch (std::runtime_error&) {
+				return true;
+			}
+			return false;
+		};
+		doATest(throwsError([&] {
+			std::array<char, 23> tooSmall = {};
+			IGzFile(data).readAll(tooSmall);
+		}), true);
+		doATest(throwsError([&] {
+			std::array<uint8_t, data.size()> corrupted = data;
+			corrupted[corrupted.size() - 8]++; // Damage the checksum
+			IGzFile(corrupted).readAll();
+		}), true);
+	}
+
+	{
+		std::cout << "Testing Deflate into a buffer" << std::endl;
+		std::string text;
+		for (int i = 0; i < 1000; i++) {
+			text += "Line " + std::to_string(i * i % 97) + "\n";
+		}
+		std::vector<uint8_t> compressed = writeDeflateIntoVector<DefaultCompressionSettings>(text);
+		std::vector<char> buffer(text.size());
+		size_t size = readDeflateIntoBuffer(compressed, buffer);
+		doATest(std::string_view(buffer.data(), size) == text, true);
+		std::vector<char> smallBuffer(text.size() - 1);
+		bool failed = false;
+		try {
+			readDeflateIntoBuffer(compressed, smallBuffer);
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+
+		// Without lookup tables, the end of the block must also be found when the buffer is exactly full
+		size = readDeflateIntoBuffer<MinDecompressionSettings>(compressed, buffer);
+		doATest(std::string_view(buffer.data(), size) == text, true);
+		std::string longText;
+		for (int i = 0; longText.size() < 200000; i++) {
+			longText += "Line " + std::to_string(i * i % 9973) + "\n";
+		}
+		longText.resize(200000);
+		std::vector<uint8_t> longCompressed = writeDeflateIntoVector<DefaultCompressionSettings>(longText);
+		std::vector<char> longBuffer(longText.size());
+		size = readDeflateIntoBuffer<MinDecompressionSettings>(longCompressed, longBuffer);
+		doATest(std::string_view(longBuffer.data(), size) == longText, true);
 	}
 
 	{
@@ -859,6 +1227,9 @@ int main(int, char**) {
 				doATest(line, linesExpected.at(i));
 			}
 		}
+
+		std::cout << "Testing size hint" << std::endl;
+		doATest(gzSizeHint(data), size_t(15));
 	}
 
 	{
@@ -884,6 +1255,952 @@ int main(int, char**) {
 		});
 	}
 
+	{
+		std::cout << "Testing reading in place" << std::endl;
+		std::string text;
+		for (int i = 0; i < 5000; i++) {
+			text += "Row " + std::to_string(i * 7 % 1013) + "\n";
+		}
+		std::vector<uint8_t> compressed = {};
+		{
+			OGzFile<DefaultCompressionSettings, std::string> compressor(GzFileInfo<std::string>("mapped"), [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressor.writeSome(std::string_view(text));
+		}
+		std::vector<char> fromSpan = IMappedGzFile<>(compressed).readAll();
+		doATest(std::string_view(fromSpan.data(), fromSpan.size()) == text, true);
+		doATest(IMappedGzFile<>(compressed).info().name, "mapped");
+
+		const std::string fileName = "ezgz_test_mapped.gz";
+		{
+			std::ofstream file(fileName, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+		}
+		IMappedGzFile<> mapped(fileName);
+		doATest(mapped.sizeHint(), text.size());
+		std::string fromFile;
+		while (std::optional<std::span<const char>> batch = mapped.readSome()) {
+			fromFile.append(batch->data(), batch->size());
+		}
+		doATest(fromFile == text, true);
+		std::remove(fileName.c_str());
+
+		bool failed = false;
+		try {
+			IMappedGzFile<>(std::span<const uint8_t>(compressed.data(), compressed.size() - 20)).readAll();
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+	}
+
+	{
+		std::cout << "Testing parallel decompression" << std::endl;
+		std::string text;
+		for (int i = 0; i < 40000; i++) {
+			text += "Entry " + std::to_string(i * 7919 % 10007) + (i % 3 ? " ok\n" : " failed, retrying\n");
+		}
+		std::vector<uint8_t> compressed = {};
+		{
+			OGzFile<DenseCompressionSettings, std::string> compressor(GzFileInfo<std::string>("parallel"), [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressor.writeSome(std::string_view(text));
+		}
+
+		IParallelGzFile<> allAtOnce(compressed, 3, 10000);
+		doATest(allAtOnce.info().name, "parallel");
+		doATest(allAtOnce.sizeHint(), text.size());
+		std::vector<char> decompressed = allAtOnce.readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+
+		IParallelGzFile<> inBatches(compressed, 2, 3000);
+		std::string fromBatches;
+		bool keptBytesMatch = true;
+		while (std::optional<std::span<const char>> batch = inBatches.readSome(10)) {
+			if (!fromBatches.empty() && memcmp(batch->data() - 10, fromBatches.data() + fromBatches.size() - 10, 10) != 0) {
+				keptBytesMatch = false;
+			}
+			fromBatches.append(batch->data(), batch->size());
+		}
+		doATest(fromBatches == text, true);
+		doATest(keptBytesMatch, true);
+
+		bool failed = false;
+		try {
+			std::vector<uint8_t> corrupted = compressed;
+			corrupted[corrupted.size() - 8]++; // Damage the checksum
+			IParallelGzFile<>(corrupted, 2, 5000).readAll();
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+	}
+
+	{
+		std::cout << "Testing seeking with an index" << std::endl;
+		std::string text;
+		for (int i = 0; i < 100000; i++) {
+			text += "Record " + std::to_string(i) + ": " + std::to_string(i * 2654435761u % 1000003) + "\n";
+		}
+		std::vector<uint8_t> compressed = {};
+		{
+			OGzFile<DenseCompressionSettings, std::string> compressor(GzFileInfo<std::string>("indexed"), [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressor.writeSome(std::string_view(text));
+		}
+
+		GzIndex index = buildGzIndex(compressed, 100000);
+		doATest(index.decompressedSize, text.size());
+		doATest(index.checkpoints.size() > 10, true);
+		std::vector<char> saved;
+		index.save([&] (std::span<const char> batch) {
+			saved.insert(saved.end(), batch.begin(), batch.end());
+		});
+		GzIndex loaded = GzIndex::load(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(saved.data()), saved.size()));
+		doATest(loaded.checkpoints.size(), index.checkpoints.size());
+		doATest(loaded.checkpoints.back().inputBit, index.checkpoints.back().inputBit);
+		doATest(loaded.checkpoints.back().window == index.checkpoints.back().window, true);
+
+		IGzFile<> file(compressed);
+		file.seek(loaded, 1234567);
+		std::string afterSeek;
+		while (afterSeek.size() < 5000) {
+			std::span<const char> batch = *file.readSome();
+			afterSeek.append(batch.data(), batch.size());
+		}
+		doATest(afterSeek.substr(0, 5000) == text.substr(1234567, 5000), true);
+		file.seek(loaded, 100);
+		std::vector<char> rest = file.readAll();
+		doATest(std::string_view(rest.data(), rest.size()) == std::string_view(text).substr(100), true);
+
+		IMappedGzFile<> mapped(compressed);
+		mapped.seek(index, text.size() - 20);
+		std::vector<char> end = mapped.readAll();
+		doATest(std::string_view(end.data(), end.size()) == std::string_view(text).substr(text.size() - 20), true);
+
+		IGzStream stream(compressed);
+		stream.setIndex(index);
+		stream.seekg(2000000);
+		std::string line;
+		std::getline(stream, line);
+		doATest(line == text.substr(2000000, text.find('\n', 2000000) - 2000000), true);
+		doATest(size_t(stream.tellg()), text.find('\n', 2000000) + 1);
+		stream.seekg(-7, std::ios_base::end);
+		std::getline(stream, line);
+		doATest(line == text.substr(text.size() - 7, 6), true);
+
+		bool failed = false;
+		try {
+			IGzFile<>(compressed).seek(index, text.size() + 1);
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+	}
+
+	{
+		std::cout << "Testing BGZF decompression" << std::endl;
+		std::string text;
+		for (int i = 0; i < 60000; i++) {
+			text += "chr" + std::to_string(i % 23 + 1) + "\t" + std::to_string(i * 2654435761u % 248956422) + "\tACGT\n";
+		}
+		std::vector<uint8_t> compressed = {};
+		std::vector<uint64_t> blockOffsets = {};
+		auto addBlock = [&] (std::string_view contents) {
+			std::vector<uint8_t> deflated = writeDeflateIntoVector<DefaultCompressionSettings>(contents);
+			uint16_t blockSize = uint16_t(20 + deflated.size() + 8 - 1);
+			GzFileInfo<std::string> header("");
+			header.extraData = {'B', 'C', 2, 0, uint8_t(blockSize & 0xff), uint8_t(blockSize >> 8)};
+			blockOffsets.push_back(compressed.size());
+			header.writeOut([&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressed.insert(compressed.end(), deflated.begin(), deflated.end());
+			std::array<uint32_t, 2> trailer = {FastCrc32()(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(contents.data()), contents.size())), uint32_t(contents.size())};
+			compressed.insert(compressed.end(), reinterpret_cast<uint8_t*>(trailer.data()), reinterpret_cast<uint8_t*>(trailer.data()) + sizeof(trailer));
+		};
+		constexpr size_t blockSize = 50000;
+		for (size_t start = 0; start < text.size(); start += blockSize) {
+			addBlock(std::string_view(text).substr(start, blockSize));
+		}
+		constexpr std::array<uint8_t, 28> endOfFile = {0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 'B', 'C', 0x02, 0, 0x1b, 0, 0x03, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+		compressed.insert(compressed.end(), endOfFile.begin(), endOfFile.end());
+
+		std::vector<char> decompressed = IBgzfFile<>(compressed, 3, 20000).readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+
+		IBgzfFile<> inBatches(compressed, 2, 40000);
+		std::string fromBatches;
+		bool keptBytesMatch = true;
+		while (std::optional<std::span<const char>> batch = inBatches.readSome(10)) {
+			if (!fromBatches.empty() && memcmp(batch->data() - 10, fromBatches.data() + fromBatches.size() - 10, 10) != 0) {
+				keptBytesMatch = false;
+			}
+			fromBatches.append(batch->data(), batch->size());
+		}
+		doATest(fromBatches == text, true);
+		doATest(keptBytesMatch, true);
+		doATest(inBatches.virtualOffset(), uint64_t(compressed.size()) << 16);
+
+		IBgzfFile<> seeking(compressed, 2, 1);
+		seeking.seek((blockOffsets[5] << 16) | 1234);
+		std::optional<std::span<const char>> afterSeek = seeking.readSome();
+		doATest(std::string_view(afterSeek->data(), afterSeek->size()) == std::string_view(text).substr(5 * blockSize + 1234, blockSize - 1234), true);
+		doATest(seeking.virtualOffset(), blockOffsets[6] << 16);
+		seeking.seek(blockOffsets[2] << 16);
+		std::vector<char> rest(text.size());
+		rest.resize(seeking.readAll(rest));
+		doATest(std::string_view(rest.data(), rest.size()) == std::string_view(text).substr(2 * blockSize), true);
+
+		bool failed = false;
+		try {
+			std::vector<uint8_t> corrupted = compressed;
+			corrupted[blockOffsets[3] - 8]++; // Damage the checksum of a block in the middle
+			IBgzfFile<>(corrupted, 2, 1).readAll();
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+	}
+
+	{
+		std::cout << "Testing BGZF compression" << std::endl;
+		std::string text;
+		for (int i = 0; i < 30000; i++) {
+			text += "read" + std::to_string(i) + "\t" + std::to_string(i * 2654435761u % 1000003) + "\tGATTACA\n";
+		}
+		uint32_t randomState = 42;
+		for (int i = 0; i < 100000; i++) {
+			randomState = randomState * 1664525 + 1013904223;
+			text += char(randomState >> 24); // Incompressible data
+		}
+		auto compress = [&] (int threads) {
+			std::vector<uint8_t> compressed;
+			OBgzfFile<> compressor([&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			}, threads);
+			compressor.writeSome(std::string_view(text).substr(0, 12345));
+			compressor.writeSome(std::string_view(text).substr(12345));
+			compressor.finish();
+			return compressed;
+		};
+		std::vector<uint8_t> compressed = compress(1);
+		doATest(compress(3) == compressed, true);
+		doATest(std::equal(Detail::bgzfEndOfFile.begin(), Detail::bgzfEndOfFile.end(), compressed.end() - Detail::bgzfEndOfFile.size()), true);
+
+		std::vector<char> decompressed = IBgzfFile<>(compressed, 2).readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		Detail::BgzfBlock first = Detail::parseBgzfBlock(compressed, 0);
+		doATest(first.deflateStart, 18u);
+		std::vector<char> firstBlock = IGzFile<>(std::span<const uint8_t>(compressed.data(), first.end)).readAll();
+		doATest(std::string_view(firstBlock.data(), firstBlock.size()) == std::string_view(text).substr(0, OBgzfFile<>::blockInputSize), true);
+	}
+
+	{
+		std::cout << "Testing multiple members" << std::endl;
+		std::vector<std::string> parts;
+		std::vector<uint8_t> compressed = {};
+		std::string text;
+		for (int part = 0; part < 6; part++) {
+			std::string contents;
+			for (int i = 0; i < 3000 * (part + 1); i++) {
+				contents += "Part " + std::to_string(part) + " line " + std::to_string(i * 40503 % 65521) + "\n";
+			}
+			OGzFile<DefaultCompressionSettings, std::string> compressor(GzFileInfo<std::string>("part" + std::to_string(part)), [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressor.writeSome(std::string_view(contents));
+			text += contents;
+		}
+
+		std::vector<char> decompressed = IGzFile<>(compressed).readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		IMappedGzFile<> mapped(compressed);
+		doATest(mapped.info().name, "part0");
+		std::vector<char> inBuffer(text.size());
+		doATest(mapped.readAll(inBuffer), text.size());
+		doATest(std::string_view(inBuffer.data(), inBuffer.size()) == text, true);
+
+		std::string fromBatches;
+		// The test function's stack would get too large
+		auto inBatches = std::make_unique<IGzFile<>>([&, position = size_t(0)] (std::span<uint8_t> batch) mutable {
+			int copied = int(std::min(batch.size(), compressed.size() - position));
+			memcpy(batch.data(), compressed.data() + position, copied);
+			position += copied;
+			return copied;
+		});
+		while (std::optional<std::span<const char>> batch = inBatches->readSome()) {
+			fromBatches.append(batch->data(), batch->size());
+		}
+		doATest(fromBatches == text, true);
+
+		auto stream = std::make_unique<IGzStream>(compressed);
+		std::string line;
+		int lines = 0;
+		while (std::getline(*stream, line)) {
+			lines++;
+		}
+		doATest(lines, int(std::count(text.begin(), text.end(), '\n')));
+
+		GzIndex index = buildGzIndex(compressed, 50000);
+		doATest(index.decompressedSize, text.size());
+		IMappedGzFile<> seeking(compressed);
+		seeking.seek(index, text.size() - 100000);
+		std::vector<char> rest = seeking.readAll();
+		doATest(std::string_view(rest.data(), rest.size()) == std::string_view(text).substr(text.size() - 100000), true);
+
+		std::vector<uint8_t> padded = compressed;
+		padded.resize(padded.size() + 100); // Zeroes after the end are ignored
+		doATest(IMappedGzFile<>(padded).readAll().size(), text.size());
+		for (const std::vector<uint8_t>& tail : {std::vector<uint8_t>{0x1f, 0x00, 0x42, 0x13}, std::vector<uint8_t>{0x1f, 0x8b}}) {
+			std::vector<uint8_t> withTail = compressed;
+			withTail.insert(withTail.end(), tail.begin(), tail.end()); // Not a header of another member
+			doATest(IMappedGzFile<>(withTail).readAll().size(), text.size());
+			doATest(IGzFile<>(withTail).readAll().size(), text.size());
+		}
+
+		std::vector<char> inParallel = IParallelMembersGzFile<>(compressed, 3).readAll();
+		doATest(std::string_view(inParallel.data(), inParallel.size()) == text, true);
+		IParallelMembersGzFile<> parallelBatches(padded, 2);
+		std::string fromParallelBatches;
+		while (std::optional<std::span<const char>> batch = parallelBatches.readSome(10)) {
+			fromParallelBatches.append(batch->data(), batch->size());
+		}
+		doATest(fromParallelBatches == text, true);
+
+		std::vector<char> inParallelChunks = IParallelGzFile<>(compressed, 3, 40000).readAll();
+		doATest(std::string_view(inParallelChunks.data(), inParallelChunks.size()) == text, true);
+		IParallelGzFile<> parallelChunkBatches(padded, 2, 40000);
+		std::string fromParallelChunkBatches;
+		while (std::optional<std::span<const char>> batch = parallelChunkBatches.readSome(10)) {
+			fromParallelChunkBatches.append(batch->data(), batch->size());
+		}
+		doATest(fromParallelChunkBatches == text, true);
+		std::vector<char> parallelBuffer(text.size());
+		doATest(IParallelGzFile<>(compressed, 2, 70000).readAll(parallelBuffer), text.size());
+		doATest(std::string_view(parallelBuffer.data(), parallelBuffer.size()) == text, true);
+
+		bool failed = false;
+		try {
+			std::vector<uint8_t> corrupted = compressed;
+			corrupted[corrupted.size() - 8]++; // Damage the checksum of the last member
+			IParallelMembersGzFile<>(corrupted, 2).readAll();
+		} catch (std::runtime_error&) {
+			failed = true;
+		}
+		doATest(failed, true);
+	}
+
+	{
+		std::cout << "Testing multiple small members" << std::endl;
+		std::vector<uint8_t> compressed = {};
+		std::string text;
+		for (int part = 0; part < 5; part++) {
+			std::string contents;
+			for (int i = 0; i < 200 * (part + 1); i++) {
+				contents += "Small " + std::to_string(part) + " line " + std::to_string(i * 40503 % 65521) + "\n";
+			}
+			auto compressor = std::make_unique<OGzFile<DefaultCompressionSettings, std::string>>(GzFileInfo<std::string>("small"), [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressor->writeSome(std::string_view(contents));
+			text += contents;
+		}
+
+		std::vector<char> decompressed = std::make_unique<IGzFile<>>(compressed)->readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		for (int keeping : {0, 10, 40000}) {
+			auto inBatches = std::make_unique<IMappedGzFile<>>(compressed);
+			std::string fromBatches;
+			while (std::optional<std::span<const char>> batch = inBatches->readSome(keeping)) {
+				fromBatches.append(batch->data(), batch->size());
+			}
+			doATest(fromBatches == text, true);
+		}
+
+		auto stream = std::make_unique<IGzStream>(compressed);
+		std::string fromStream((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+		doATest(fromStream == text, true);
+
+		GzIndex index = buildGzIndex(compressed, 1000);
+		for (size_t target : {size_t(10), text.size() / 2, text.size() - 5}) {
+			auto seeking = std::make_unique<IMappedGzFile<>>(compressed);
+			seeking->seek(index, target);
+			std::vector<char> rest = seeking->readAll();
+			doATest(std::string_view(rest.data(), rest.size()) == std::string_view(text).substr(target), true);
+		}
+
+		std::vector<uint8_t> withLargeMember = compressed;
+		std::string largeText;
+		for (int i = 0; i < 20000; i++) {
+			largeText += "Large line " + std::to_string(i * 7919 % 10007) + "\n";
+		}
+		auto largeCompressor = std::make_unique<OGzFile<DefaultCompressionSettings, std::string>>(GzFileInfo<std::string>("large"), [&] (std::span<const char> batch) {
+			withLargeMember.insert(withLargeMember.end(), batch.begin(), batch.end());
+		});
+		largeCompressor->writeSome(std::string_view(largeText));
+		largeCompressor.reset(); // Writes the trailer
+		std::vector<char> mixed = std::make_unique<IGzFile<>>(withLargeMember)->readAll();
+		doATest(std::string_view(mixed.data(), mixed.size()) == text + largeText, true);
+	}
+
+	{
+		std::cout << "Testing parallel compression" << std::endl;
+		std::string text;
+		for (int i = 0; i < 40000; i++) {
+			text += "Entry " + std::to_string(i * 7919 % 10007) + " refers to entry " + std::to_string(i / 3) + "\n";
+		}
+		auto crc = [] (std::span<const uint8_t> data) {
+			return FastCrc32()(data);
+		};
+		std::span<const uint8_t> textBytes(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+		doATest(crc32Combine(crc(textBytes.subspan(0, 1000)), crc(textBytes.subspan(1000)), text.size() - 1000), crc(textBytes));
+		doATest(crc32Combine(crc(textBytes), 0, 0), crc(textBytes));
+
+		GzFileInfo<std::string> header("entries");
+		header.modificationTime = 0; // Must not differ between the runs
+		auto compress = [&] (int threads) {
+			std::vector<uint8_t> compressed;
+			OParallelGzFile<> compressor(header, [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			}, threads, 50000);
+			compressor.writeSome(std::string_view(text).substr(0, 12345));
+			compressor.writeSome(std::string_view(text).substr(12345));
+			compressor.finish();
+			return compressed;
+		};
+		std::vector<uint8_t> compressed = compress(1);
+		doATest(compress(3) == compressed, true);
+		doATest(compressed.size() < text.size() / 4, true);
+
+		// The test function's stack would get too large
+		auto decompressor = std::make_unique<IMappedGzFile<>>(compressed);
+		doATest(decompressor->info().name, "entries");
+		std::vector<char> decompressed = decompressor->readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		doATest(IParallelGzFile<>(compressed, 2).readAll().size(), text.size());
+
+		std::vector<uint8_t> empty;
+		OParallelGzFile<>(GzFileInfo<std::string>("empty"), [&] (std::span<const char> batch) {
+			empty.insert(empty.end(), batch.begin(), batch.end());
+		});
+		doATest(std::make_unique<IMappedGzFile<>>(empty)->readAll().size(), 0u);
+
+		// Incompressible data make the compressed output larger than the chunk
+		std::string random(300000, '\0');
+		uint32_t randomState = 11;
+		for (char& letter : random) {
+			randomState = randomState * 1664525 + 1013904223;
+			letter = char(randomState >> 24);
+		}
+		for (size_t chunkSize : {size_t(50000), size_t(100000), size_t(200000)}) {
+			std::vector<uint8_t> randomCompressed;
+			{
+				OParallelGzFile<> compressor(header, [&] (std::span<const char> batch) {
+					randomCompressed.insert(randomCompressed.end(), batch.begin(), batch.end());
+				}, 2, chunkSize);
+				compressor.writeSome(std::string_view(random));
+			}
+			std::vector<char> randomDecompressed = std::make_unique<IMappedGzFile<>>(randomCompressed)->readAll();
+			doATest(std::string_view(randomDecompressed.data(), randomDecompressed.size()) == random, true);
+		}
+	}
+
+	{
+		std::cout << "Testing parallel checksum" << std::endl;
+		std::vector<uint8_t> data(ParallelCrc32::minPieceSize * 3 + 12345);
+		uint32_t randomState = 7;
+		for (uint8_t& byte : data) {
+			randomState = randomState * 1664525 + 1013904223;
+			byte = uint8_t(randomState >> 24);
+		}
+		std::span<const uint8_t> dataSpan = data;
+		uint32_t expected = FastCrc32()(dataSpan);
+		doATest(ParallelCrc32(4)(dataSpan), expected);
+		doATest(ParallelCrc32()(dataSpan), expected);
+		ParallelCrc32 inParts(3);
+		inParts(dataSpan.subspan(0, 1000));
+		inParts(dataSpan.subspan(1000, data.size() - 2000));
+		doATest(inParts(dataSpan.subspan(data.size() - 1000)), expected);
+		doATest(inParts(), expected);
+
+		struct ParallelChecksumSettings : DefaultDecompressionSettings {
+			using Checksum = ParallelCrc32;
+		};
+		std::string text;
+		for (int i = 0; i < 100000; i++) {
+			text += "Line " + std::to_string(i) + " of many\n";
+		}
+		std::vector<uint8_t> compressed;
+		OParallelGzFile<>(GzFileInfo<std::string>("lines"), [&] (std::span<const char> batch) {
+			compressed.insert(compressed.end(), batch.begin(), batch.end());
+		}).writeSome(std::string_view(text));
+		// The test function's stack would get too large
+		std::vector<char> decompressed = std::make_unique<IGzFile<ParallelChecksumSettings>>(compressed)->readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+	}
+
+	{
+		std::cout << "Testing hardware checksum" << std::endl;
+		std::vector<uint8_t> data(5000);
+		uint32_t randomState = 11;
+		for (uint8_t& byte : data) {
+			randomState = randomState * 1664525 + 1013904223;
+			byte = uint8_t(randomState >> 24);
+		}
+		std::span<const uint8_t> dataSpan = data;
+		bool allMatch = true;
+		for (size_t size : {0, 15, 64, 100, 256, 300, 1000, 4990}) {
+			for (size_t offset : {0, 3}) {
+				std::span<const uint8_t> part = dataSpan.subspan(offset, size);
+				HardwareCrc32 inParts;
+				inParts(part.subspan(0, size / 3));
+				allMatch &= (inParts(part.subspan(size / 3)) == FastCrc32()(part) && HardwareCrc32()(part) == FastCrc32()(part));
+			}
+		}
+		doATest(allMatch, true);
+		doATest(HardwareCrc32(FastCrc32()(dataSpan.subspan(0, 1000)))(dataSpan.subspan(1000)), FastCrc32()(dataSpan));
+	}
+
+	{
+		std::cout << "Testing Adler-32" << std::endl;
+		std::string_view name = "Wikipedia";
+		doATest(Adler32()(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(name.data()), name.size())), 0x11e60398u);
+		std::vector<uint8_t> data(30000, 0xff); // The largest bytes are the most likely to overflow
+		uint32_t randomState = 17;
+		for (size_t i = 10000; i < data.size(); i++) {
+			randomState = randomState * 1664525 + 1013904223;
+			data[i] = uint8_t(randomState >> 24);
+		}
+		std::span<const uint8_t> dataSpan = data;
+		bool allMatch = true;
+		for (size_t size : {0, 31, 32, 100, 5552, 5600, 12000, 19990}) {
+			for (size_t offset : {0, 5, 9000}) {
+				std::span<const uint8_t> part = dataSpan.subspan(offset, size);
+				HardwareAdler32 inParts;
+				inParts(part.subspan(0, size / 3));
+				allMatch &= (inParts(part.subspan(size / 3)) == Adler32()(part) && HardwareAdler32()(part) == Adler32()(part));
+			}
+		}
+		doATest(allMatch, true);
+	}
+
+	{
+		std::cout << "Testing zlib" << std::endl;
+		// Made by Python's zlib.compress()
+		std::vector<uint8_t> compressed = {0x78, 0x9c, 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0xa8, 0xca, 0xc9, 0x4c, 0xd2, 0x51, 0xc8, 0xc0,
+				0xca, 0x56, 0xe4, 0x2, 0x0, 0xeb, 0xc3, 0xc, 0x53};
+		// The test function's stack would get too large
+		std::vector<char> decompressed = std::make_unique<IZlibFile<>>(compressed)->readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()), "Hello zlib, hello zlib, hello zlib!\n");
+		compressed[compressed.size() - 1]++;
+		bool threw = false;
+		try {
+			std::make_unique<IZlibFile<>>(compressed)->readAll();
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		doATest(threw, true);
+
+		std::string text;
+		for (int i = 0; i < 3000; i++) {
+			text += "Line number " + std::to_string(i * i % 1013) + " of the zlib test\n";
+		}
+		std::vector<char> written;
+		{
+			auto compressor = std::make_unique<OZlibFile<>>(written);
+			compressor->writeSome(std::string_view(text));
+		}
+		doATest(written.size() < text.size() / 2, true);
+		std::span<const uint8_t> writtenBytes(reinterpret_cast<const uint8_t*>(written.data()), written.size());
+		std::vector<char> roundTrip = std::make_unique<IMappedZlibFile<>>(writtenBytes)->readAll();
+		doATest(std::string_view(roundTrip.data(), roundTrip.size()) == text, true);
+	}
+
+	{
+		std::cout << "Testing pipelined stream" << std::endl;
+		std::string text;
+		for (int i = 0; i < 50000; i++) {
+			text += "Line " + std::to_string(i * 7919 % 100003) + "\n";
+		}
+		std::vector<uint8_t> compressed;
+		{
+			GzFileInfo<std::string> header("lines");
+			auto compressor = std::make_unique<OGzFile<DefaultCompressionSettings, std::string>>(header, [&] (std::span<const char> batch) {
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			});
+			compressor->writeSome(std::string_view(text));
+		}
+		size_t position = 0;
+		IPipelinedGzStream file([&] (std::span<uint8_t> batch) {
+			int size = int(std::min<size_t>({batch.size(), 1000, compressed.size() - position}));
+			memcpy(batch.data(), compressed.data() + position, size);
+			position += size;
+			return size;
+		});
+		doATest(file.info().name, "lines");
+		std::string line;
+		bool allMatch = true;
+		for (int i = 0; i < 50000; i++) {
+			std::getline(file, line);
+			allMatch &= (line == "Line " + std::to_string(i * 7919 % 100003));
+		}
+		doATest(allMatch, true);
+		file.unget();
+		doATest(char(file.get()), '\n');
+		doATest(bool(std::getline(file, line)), false);
+		doATest(file.eof(), true);
+
+		compressed[compressed.size() - 5]++; // Breaks the checksum
+		IPipelinedGzStream broken(compressed);
+		while (std::getline(broken, line)) {}
+		doATest(broken.bad(), true);
+	}
+
+	{
+		std::cout << "Testing io_uring files" << std::endl;
+		std::string text;
+		uint32_t randomState = 5;
+		while (text.size() < 6000000) {
+			randomState = randomState * 1664525 + 1013904223;
+			text += std::to_string(randomState >> 8) + (randomState & 0x10 ? " " : "\n");
+		}
+		{
+			// The test function's stack would get too large
+			auto compressor = std::make_unique<OGzFile<IoUringCompressionSettings, std::string>>(GzFileInfo<std::string>("ezgz_test_uring"));
+			compressor->writeSome(std::string_view(text));
+		}
+		const std::string fileName = "ezgz_test_uring.gz";
+		std::vector<char> decompressed = std::make_unique<IGzFile<IoUringDecompressionSettings>>(fileName)->readAll();
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+
+		std::ifstream file(fileName, std::ios::binary);
+		std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		doATest(contents.size() > 2000000, true); // Spans several buffers
+		Detail::SeekableSource source = Detail::readFromFile(fileName, true);
+		source.seek(1000);
+		std::string readBack;
+		std::array<uint8_t, 77777> batch = {};
+		while (int size = source.read(batch)) {
+			readBack.append(reinterpret_cast<const char*>(batch.data()), size);
+		}
+		doATest(readBack == contents.substr(1000), true);
+
+		auto seeking = std::make_unique<IGzFile<IoUringDecompressionSettings>>(fileName);
+		seeking->seek(buildGzIndex(fileName), 4000000);
+		std::string fromPosition;
+		while (std::optional<std::span<const char>> part = seeking->readSome()) {
+			fromPosition.append(part->data(), part->size());
+		}
+		doATest(fromPosition == text.substr(4000000), true);
+		std::remove(fileName.c_str());
+	}
+
+	{
+		std::cout << "Testing statically dispatched sources and sinks" << std::endl;
+		std::string text;
+		for (int i = 0; i < 4000; i++) {
+			text += "Sourced line " + std::to_string(i * 31 % 997) + "\n";
+		}
+		std::vector<uint8_t> compressed;
+		auto sink = [&compressed] (std::span<const char> batch) {
+			compressed.insert(compressed.end(), batch.begin(), batch.end());
+		};
+		{
+			// The test function's stack would get too large
+			auto compressor = std::make_unique<ODeflateArchive<DefaultCompressionSettings, NoChecksum, decltype(sink)>>(sink);
+			compressor->writeSome(std::string_view(text));
+		}
+		doATest(compressed.size() < text.size() / 2, true);
+		std::vector<uint8_t> fromHelper = writeDeflateIntoVector<DefaultCompressionSettings>(std::span<const char>(text.data(), text.size()));
+		doATest(fromHelper == compressed, true);
+
+		auto source = [&compressed, position = size_t(0)] (std::span<uint8_t> batch) mutable -> int {
+			int filling = int(std::min(batch.size(), compressed.size() - position));
+			memcpy(batch.data(), compressed.data() + position, filling);
+			position += filling;
+			return filling;
+		};
+		std::vector<char> decompressed = readDeflateIntoVector(source);
+		doATest(std::string_view(decompressed.data(), decompressed.size()) == text, true);
+		std::vector<char> fromArchive = std::make_unique<ISourcedDeflateArchive<decltype(source)>>(source)->readAll();
+		doATest(std::string_view(fromArchive.data(), fromArchive.size()) == text, true);
+
+		std::vector<uint8_t> gzipped;
+		{
+			OGzFile<DefaultCompressionSettings, std::string> compressor(GzFileInfo<std::string>("sourced"), [&] (std::span<const char> batch) {
+				gzipped.insert(gzipped.end(), batch.begin(), batch.end());
+			});
+			compressor.writeSome(std::string_view(text));
+		}
+		auto gzipSource = [&gzipped, position = size_t(0)] (std::span<uint8_t> batch) mutable -> int {
+			int filling = int(std::min<size_t>({batch.size(), gzipped.size() - position, 1000}));
+			memcpy(batch.data(), gzipped.data() + position, filling);
+			position += filling;
+			return filling;
+		};
+		auto reader = std::make_unique<ISourcedGzFile<decltype(gzipSource)>>(gzipSource);
+		doATest(reader->info().name, "sourced");
+		std::vector<char> fromGz = reader->readAll();
+		doATest(std::string_view(fromGz.data(), fromGz.size()) == text, true);
+	}
+
+	{
+		std::cout << "Testing resetting and pooling" << std::endl;
+		std::vector<std::string> texts;
+		std::vector<std::vector<uint8_t>> payloads;
+		for (int i = 0; i < 8; i++) {
+			std::string text;
+			for (int j = 0; j < 200 + i * 300; j++) {
+				text += "{\"payload\": " + std::to_string(i) + ", \"item\": " + std::to_string(j * 13 % 101) + "}\n";
+			}
+			std::vector<uint8_t> compressed;
+			{
+				OGzFile<DefaultCompressionSettings, std::string> compressor(GzFileInfo<std::string>("payload" + std::to_string(i)), [&] (std::span<const char> batch) {
+					compressed.insert(compressed.end(), batch.begin(), batch.end());
+				});
+				compressor.writeSome(std::string_view(text));
+			}
+			texts.push_back(std::move(text));
+			payloads.push_back(std::move(compressed));
+		}
+
+		// The test function's stack would get too large
+		auto reused = std::make_unique<IGzFile<>>(payloads[0]);
+		std::vector<char> first = reused->readAll();
+		doATest(std::string_view(first.data(), first.size()) == texts[0], true);
+		reused->reset(payloads[1]);
+		doATest(reused->info().name, "payload1");
+		std::string partial;
+		std::optional<std::span<const char>> batch = reused->readSome();
+		partial.append(batch->data(), batch->size());
+		doATest(partial.size() > 0 && texts[1].compare(0, partial.size(), partial) == 0, true);
+		reused->reset([&payloads, position = size_t(0)] (std::span<uint8_t> batch) mutable -> int {
+			int filling = int(std::min<size_t>({batch.size(), payloads[2].size() - position, 700}));
+			memcpy(batch.data(), payloads[2].data() + position, filling);
+			position += filling;
+			return filling;
+		});
+		std::vector<char> third = reused->readAll();
+		doATest(std::string_view(third.data(), third.size()) == texts[2], true);
+
+		ContextPool<IMappedGzFile<>> pool(2);
+		const IMappedGzFile<>* firstUsed = nullptr;
+		{
+			ContextPool<IMappedGzFile<>>::Lease lease = pool.acquire(payloads[3]);
+			firstUsed = &*lease;
+			doATest(lease->sizeHint(), texts[3].size());
+			std::vector<char> decompressed = lease->readAll();
+			doATest(std::string_view(decompressed.data(), decompressed.size()) == texts[3], true);
+		}
+		doATest(pool.idleCount(), size_t(1));
+		{
+			ContextPool<IMappedGzFile<>>::Lease lease = pool.acquire(payloads[4]);
+			doATest(&*lease == firstUsed, true);
+			doATest(lease->info().name, "payload4");
+			std::vector<char> decompressed = lease->readAll();
+			doATest(std::string_view(decompressed.data(), decompressed.size()) == texts[4], true);
+		}
+
+		std::vector<uint8_t> corrupted = payloads[5];
+		corrupted[0] ^= 0xff;
+		bool threw = false;
+		try {
+			pool.acquire(corrupted);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		doATest(threw, true);
+		doATest(pool.idleCount(), size_t(1));
+
+		std::atomic<int> correct = 0;
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 3; i++) {
+			threads.emplace_back([&, i] {
+				for (int j = 0; j < 10; j++) {
+					int which = (i + j) % int(payloads.size());
+					std::vector<char> decompressed = pool.acquire(payloads[which])->readAll();
+					correct += (std::string_view(decompressed.data(), decompressed.size()) == texts[which]);
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		doATest(correct.load(), 30);
+		doATest(pool.idleCount() <= 2, true);
+	}
+
+	{
+		std::cout << "Testing batch decompression" << std::endl;
+		std::vector<std::string> texts;
+		std::vector<std::vector<uint8_t>> compressed;
+		for (int i = 0; i < 40; i++) {
+			std::string text;
+			for (int j = 0; j < 50 + i * 37; j++) {
+				text += "Message " + std::to_string(i) + " field " + std::to_string(j * 7 % 23) + "\n";
+			}
+			compressed.emplace_back();
+			{
+				OGzFile<DefaultCompressionSettings, std::string> compressor(GzFileInfo<std::string>("message"), [&] (std::span<const char> batch) {
+					compressed.back().insert(compressed.back().end(), batch.begin(), batch.end());
+				});
+				compressor.writeSome(std::string_view(text));
+			}
+			texts.push_back(std::move(text));
+		}
+		std::vector<std::span<const uint8_t>> files(compressed.begin(), compressed.end());
+
+		IGzBatch<> batch(3);
+		std::vector<std::vector<char>> decompressed = batch.readAll(files);
+		int correct = 0;
+		for (int i = 0; i < std::ssize(texts); i++) {
+			correct += (std::string_view(decompressed[i].data(), decompressed[i].size()) == texts[i]);
+		}
+		doATest(correct, int(texts.size()));
+
+		std::vector<char> storage;
+		std::vector<size_t> offsets;
+		for (std::span<const uint8_t> file : files) {
+			offsets.push_back(storage.size());
+			storage.resize(storage.size() + gzSizeHint(file));
+		}
+		doATest(storage.size(), std::accumulate(texts.begin(), texts.end(), size_t(0), [] (size_t sum, const std::string& text) {
+			return sum + text.size();
+		}));
+		std::vector<std::span<char>> buffers;
+		for (int i = 0; i < std::ssize(files); i++) {
+			size_t end = (i + 1 < std::ssize(files)) ? offsets[i + 1] : storage.size();
+			buffers.emplace_back(storage.data() + offsets[i], end - offsets[i]);
+		}
+		std::vector<size_t> sizes = batch.readAll(files, buffers);
+		correct = 0;
+		for (int i = 0; i < std::ssize(texts); i++) {
+			correct += (sizes[i] == texts[i].size() && std::string_view(buffers[i].data(), sizes[i]) == texts[i]);
+		}
+		doATest(correct, int(texts.size()));
+
+		std::vector<uint8_t> corrupted = compressed[20];
+		corrupted[corrupted.size() / 2] ^= 0x55;
+		files[20] = corrupted;
+		bool threw = false;
+		try {
+			batch.readAll(files);
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		doATest(threw, true);
+		files[20] = compressed[20];
+		doATest(batch.readAll(files)[39].size(), texts[39].size());
+	}
+
+#if EZGZ_HAS_COROUTINES
+	{
+		std::cout << "Testing coroutines" << std::endl;
+		std::deque<std::coroutine_handle<>> scheduled;
+		struct Reschedule { // Suspends and lets other coroutines run first, like waiting for I/O
+			std::deque<std::coroutine_handle<>>& scheduled;
+			bool await_ready() { return false; }
+			void await_suspend(std::coroutine_handle<> handle) { scheduled.push_back(handle); }
+			void await_resume() {}
+		};
+		auto runScheduled = [&] {
+			while (!scheduled.empty()) {
+				std::coroutine_handle<> next = scheduled.front();
+				scheduled.pop_front();
+				next.resume();
+			}
+		};
+
+		std::string text;
+		for (int i = 0; i < 40000; i++) {
+			text += "Asynchronous line " + std::to_string(i * 40503 % 65537) + "\n";
+		}
+		std::vector<uint8_t> compressed;
+		auto writer = [&] () -> AsyncTask<size_t> {
+			OAsyncGzFile<> compressor([&] (std::span<const char> batch) -> AsyncTask<void> {
+				co_await Reschedule{scheduled};
+				compressed.insert(compressed.end(), batch.begin(), batch.end());
+			}, GzFileInfo<std::string>("async"));
+			for (size_t position = 0; position < text.size(); position += 100000) {
+				co_await compressor.writeSome(std::string_view(text).substr(position, 100000));
+			}
+			co_await compressor.finish();
+			co_return compressed.size();
+		};
+		AsyncTask<size_t> writing = writer();
+		writing.start();
+		runScheduled();
+		doATest(writing.done(), true);
+		doATest(writing.get(), compressed.size());
+
+		auto reader = [&] (std::span<const uint8_t> data, std::string& output) -> AsyncTask<void> {
+			size_t position = 0;
+			IAsyncGzFile<> input([&] (std::span<uint8_t> batch) -> AsyncTask<int> {
+				co_await Reschedule{scheduled};
+				int size = int(std::min<size_t>({batch.size(), 3000, data.size() - position}));
+				memcpy(batch.data(), data.data() + position, size);
+				position += size;
+				co_return size;
+			});
+			while (std::optional<std::span<const char>> batch = co_await input.readSome()) {
+				output.append(batch->data(), batch->size());
+			}
+			if (input.info().name != "async") {
+				throw std::runtime_error("Wrong header");
+			}
+		};
+		std::string first;
+		std::string second;
+		std::vector<uint8_t> corrupted = compressed;
+		corrupted[corrupted.size() / 2] ^= 0x55;
+		std::string third;
+		AsyncTask<void> firstReading = reader(compressed, first);
+		AsyncTask<void> secondReading = reader(compressed, second);
+		AsyncTask<void> thirdReading = reader(corrupted, third);
+		firstReading.start();
+		secondReading.start();
+		thirdReading.start();
+		runScheduled();
+		doATest(firstReading.done() && secondReading.done() && thirdReading.done(), true);
+		firstReading.get();
+		secondReading.get();
+		doATest(first == text, true);
+		doATest(second == text, true);
+		bool threw = false;
+		try {
+			thirdReading.get();
+		} catch (std::runtime_error&) {
+			threw = true;
+		}
+		doATest(threw, true);
+
+		// Like flushing after every byte, a block with a single byte is followed by an empty block, with much more input than output
+		std::string flushedText = text.substr(0, 300000);
+		std::vector<uint8_t> flushed = {0x1f, 0x8b, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 'a', 's', 'y', 'n', 'c', 0x00};
+		for (char byte : flushedText) {
+			flushed.insert(flushed.end(), {0x00, 0x01, 0x00, 0xfe, 0xff, uint8_t(byte), 0x00, 0x00, 0x00, 0xff, 0xff});
+		}
+		flushed.insert(flushed.end(), {0x01, 0x00, 0x00, 0xff, 0xff});
+		for (uint32_t value : {uint32_t(FastCrc32()(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(flushedText.data()), flushedText.size()))),
+				uint32_t(flushedText.size())}) {
+			for (int i = 0; i < 4; i++) {
+				flushed.push_back(uint8_t(value >> (i * 8)));
+			}
+		}
+		std::string fromFlushed;
+		AsyncTask<void> flushedReading = reader(flushed, fromFlushed);
+		flushedReading.start();
+		runScheduled();
+		doATest(flushedReading.done(), true);
+		flushedReading.get();
+		doATest(fromFlushed == flushedText, true);
+	}
+#endif
+
 	std::cout << "Passed: " << (tests - errors) << " / " << tests << ", errors: " << errors << std::endl;
 	return errors != 0;
 }